@@ -1,6 +1,19 @@
 #include "pch.h"
+#include <chrono>
 #include <fstream>
+#include <functional>
+#include <numeric>
+#include "../magneto_lib/BoundaryAlgorithms.h"
 #include "../magneto_lib/Job.h"
+#include "../magneto_lib/fft_tools.h"
+#include "../magneto_lib/FlatLattice.h"
+#include "../magneto_lib/LatticeAlgorithms.h"
+#include "../magneto_lib/MultispinMetropolis.h"
+#include "../magneto_lib/physics_tools.h"
+#include "../magneto_lib/RandomBondAlgorithms.h"
+#include "../magneto_lib/SnapshotPipeline.h"
+#include "../magneto_lib/SpinModelAlgorithms.h"
+#include "../magneto_lib/StencilAlgorithms.h"
 
 namespace {
    std::string get_file_contents(const std::filesystem::path& path) {
@@ -15,6 +28,149 @@ namespace {
       filestream.close();
       return buffer.str();
    }
+
+
+   /// <summary>Energy per site -Sum s_i s_j / N of a periodic lattice</summary>
+   double get_energy(const magneto::LatticeType& lattice) {
+      const auto [Lx, Ly] = magneto::get_dimensions_of_lattice(lattice);
+      int sum = 0;
+      for (unsigned int i = 0; i < Ly; ++i) {
+         for (unsigned int j = 0; j < Lx; ++j)
+            sum += lattice[i][j] * (lattice[i][(j + 1) % Lx] + lattice[(i + 1) % Ly][j]);
+      }
+      return -sum * 1.0 / (Lx * Ly);
+   }
+
+
+   /// <summary>Exact mean energy per site of the periodic 4x4 lattice with J=1, summed over all states</summary>
+   double get_exact_4x4_energy(const double T) {
+      double weight_sum = 0.0;
+      double energy_sum = 0.0;
+      magneto::LatticeType lattice(4, std::vector<char>(4));
+      for (unsigned int state = 0; state < (1u << 16); ++state) {
+         for (unsigned int site = 0; site < 16; ++site)
+            lattice[site / 4][site % 4] = (state >> site) & 1 ? 1 : -1;
+         const double E = get_energy(lattice);
+         const double weight = std::exp(-16.0 * E / T);
+         weight_sum += weight;
+         energy_sum += weight * E;
+      }
+      return energy_sum / weight_sum;
+   }
+
+
+   /// <summary>Mean energy per site of a periodic LxL lattice over 20000 runs after 200 warmup
+   /// runs from the ordered state</summary>
+   double get_mean_energy(magneto::LatticeAlgorithm& algorithm, const unsigned int L) {
+      magneto::LatticeType lattice(L, std::vector<char>(L, 1));
+      double energy = 0.0;
+      for (unsigned int run = 0; run < 20200; ++run) {
+         algorithm.run(lattice);
+         if (run >= 200)
+            energy += get_energy(lattice) / 20000.0;
+      }
+      return energy;
+   }
+
+
+   /// <summary>Energy per site in units of J of a periodic Potts or clock lattice</summary>
+   template<class TModel>
+   double get_model_energy(const magneto::ModelLattice<TModel::bits>& lattice) {
+      const int q = lattice.q;
+      double energy = 0.0;
+      for (int i = 0; i < lattice.Ly; ++i) {
+         for (int j = 0; j < lattice.Lx; ++j) {
+            const int s = lattice.spins.get(i * lattice.Lx + j);
+            const int right = lattice.spins.get(i * lattice.Lx + (j + 1) % lattice.Lx);
+            const int down = lattice.spins.get((i + 1) % lattice.Ly * lattice.Lx + j);
+            energy += TModel::get_bond_energy((s - right + q) % q, q) + TModel::get_bond_energy((s - down + q) % q, q);
+         }
+      }
+      return energy / (lattice.Lx * lattice.Ly);
+   }
+
+
+   /// <summary>Exact mean energy per site in units of J of a periodic LxL Potts or clock model,
+   /// summed over all q^(L*L) states</summary>
+   template<class TModel>
+   double get_exact_model_energy(const int L, const int q, const int J, const double T) {
+      magneto::ModelLattice<TModel::bits> lattice{ L, L, q, magneto::PackedSpins<TModel::bits>(L * L) };
+      double weight_sum = 0.0;
+      double energy_sum = 0.0;
+      bool has_next = true;
+      while (has_next) {
+         const double E = get_model_energy<TModel>(lattice);
+         const double weight = std::exp(-J * L * L * E / T);
+         weight_sum += weight;
+         energy_sum += weight * E;
+
+         // Counts the states up like a number with L*L digits of base q
+         has_next = false;
+         for (int site = 0; site < L * L && !has_next; ++site) {
+            const int s = lattice.spins.get(site) + 1;
+            has_next = s < q;
+            lattice.spins.set(site, has_next ? s : 0);
+         }
+      }
+      return energy_sum / weight_sum;
+   }
+
+
+   /// <summary>Mean energy per site in units of J over 20000 runs after 200 warmup runs from random states</summary>
+   template<class TModel>
+   double get_model_mean_energy(magneto::ModelAlgorithm<TModel>& algorithm, const int L, const int q) {
+      std::mt19937 rng(1);
+      magneto::ModelLattice<TModel::bits> lattice{ L, L, q, magneto::PackedSpins<TModel::bits>(L * L) };
+      for (int site = 0; site < L * L; ++site)
+         lattice.spins.set(site, std::uniform_int_distribution<int>(0, q - 1)(rng));
+      double energy = 0.0;
+      for (unsigned int run = 0; run < 20200; ++run) {
+         algorithm.run(lattice);
+         if (run >= 200)
+            energy += get_model_energy<TModel>(lattice) / 20000.0;
+      }
+      return energy;
+   }
+
+
+   /// <summary>Exact mean energy per site of a 3x3 lattice with J=1 and the boundaries of the
+   /// geometry, summed over all states</summary>
+   double get_exact_3x3_energy(const double T, const magneto::Geometry& geometry) {
+      double weight_sum = 0.0;
+      double energy_sum = 0.0;
+      magneto::LatticeType lattice(3, std::vector<char>(3));
+      for (unsigned int state = 0; state < (1u << 9); ++state) {
+         for (unsigned int site = 0; site < 9; ++site)
+            lattice[site / 3][site % 3] = (state >> site) & 1 ? 1 : -1;
+         const double E = -magneto::get_boundary_energy_sum(lattice, geometry) / 9.0;
+         const double weight = std::exp(-9.0 * E / T);
+         weight_sum += weight;
+         energy_sum += weight * E;
+      }
+      return energy_sum / weight_sum;
+   }
+
+
+   /// <summary>Direct O(n^2) transform with the same kernel as FFTPlan</summary>
+   std::vector<std::complex<double>> get_naive_dft(const std::vector<std::complex<double>>& data) {
+      const double pi = 3.141592653589793;
+      const size_t n = data.size();
+      std::vector<std::complex<double>> result(n);
+      for (size_t k = 0; k < n; ++k) {
+         for (size_t j = 0; j < n; ++j)
+            result[k] += data[j] * std::polar(1.0, -2.0 * pi * static_cast<double>(j * k % n) / n);
+      }
+      return result;
+   }
+
+
+   magneto::LatticeType get_negated(magneto::LatticeType lattice) {
+      for (std::vector<char>& row : lattice) {
+         for (char& spin : row)
+            spin = -spin;
+      }
+      return lattice;
+   }
 }
 
 
@@ -33,14 +189,939 @@ public:
    //magneto::Job job1;
    //magneto::Job job2;
    //magneto::Job job3;
-   magneto::Job empty_job;
+   magneto::JsonJob empty_job;
 };
 
 
 TEST_F(Jobs, EqualityOperators) {
    EXPECT_TRUE(magneto::PhysicsConfig({ "file", "{E}" }) == magneto::PhysicsConfig({ "file", "{E}" }));
-   magneto::Job job1;
-   magneto::Job job2;
+   magneto::JsonJob job1;
+   magneto::JsonJob job2;
    EXPECT_TRUE(job1==job2);
 }
 
+
+TEST_F(Jobs, ParsesKeys) {
+   // Every config sets keys away from their defaults, the parsed job must equal the default job
+   // with these changes
+   using magneto::JsonJob;
+   const std::vector<std::pair<std::string, std::function<void(JsonJob&)>>> cases = {
+      { R"({"algorithm": "multispin"})", [](JsonJob& job) {job.algorithm = magneto::Algorithm::Multispin; } },
+      { R"({"batch_size": 16})", [](JsonJob& job) {job.batch_size = 16; } },
+      { R"({"correlation_path": "corr.txt", "structure_factor_path": "sf.txt", "correlation_stride": 5})", [](JsonJob& job) {
+         job.physics_config.m_correlation_path = "corr.txt";
+         job.physics_config.m_structure_factor_path = "sf.txt";
+         job.physics_config.m_correlation_stride = 5;
+      } },
+      { R"({"jackknife_bins": 50})", [](JsonJob& job) {job.physics_config.m_jackknife_bins = 50; } },
+      { R"({"temp": "adaptive", "adaptive_budget": 20, "adaptive_batch": 5})", [](JsonJob& job) {
+         job.temp_mode = magneto::TempStartMode::Adaptive;
+         job.adaptive_budget = 20;
+         job.adaptive_batch = 5;
+      } },
+      { R"({"temp": "normal"})", [](JsonJob& job) {job.temp_mode = magneto::TempStartMode::Normal; } },
+      { R"({"algorithm": "auto", "auto_pilot_runs": 50})", [](JsonJob& job) {
+         job.algorithm = magneto::Algorithm::Auto;
+         job.auto_pilot_runs = 50;
+      } },
+      // Multispin can't be part of a schedule and is dropped
+      { R"({"schedule": [{"alg": "SW", "n": 1}, {"alg": "metropolis", "n": 5}], "start_schedule": [{"alg": "multispin", "n": 2}, {"alg": "SW", "n": 3}]})", [](JsonJob& job) {
+         job.schedule = { { magneto::Algorithm::SW, 1 }, { magneto::Algorithm::Metropolis, 5 } };
+         job.start_schedule = { { magneto::Algorithm::SW, 3 } };
+      } },
+      { R"({"common_random_numbers": true})", [](JsonJob& job) {job.common_random_numbers = true; } },
+      { R"({"algorithm": "creutz", "J": 2})", [](JsonJob& job) {
+         job.algorithm = magneto::Algorithm::Creutz;
+         job.J = 2;
+      } },
+      { R"({"algorithm": "kawasaki"})", [](JsonJob& job) {job.algorithm = magneto::Algorithm::Kawasaki; } },
+      { R"({"bonds": "random", "bond_path": "bonds.txt", "bond_seed": 7, "antiferro_fraction": 0.25})", [](JsonJob& job) {
+         job.bond_mode = magneto::BondMode::Random;
+         job.bond_path = "bonds.txt";
+         job.bond_seed = 7;
+         job.antiferro_fraction = 0.25;
+      } },
+      { R"({"field": 0.5, "field_image": "field.png", "field_min": -2.0, "field_max": 3.0, "hysteresis_steps": 8, "hysteresis_field": 1.5, "hysteresis_iterations": 4, "hysteresis_path": "loop.txt"})", [](JsonJob& job) {
+         job.field = 0.5;
+         job.field_image = "field.png";
+         job.field_min = -2.0;
+         job.field_max = 3.0;
+         job.hysteresis_steps = 8;
+         job.hysteresis_field = 1.5;
+         job.hysteresis_iterations = 4;
+         job.physics_config.m_hysteresis_path = "loop.txt";
+      } },
+      { R"({"lattice": "nnn", "J2": -1})", [](JsonJob& job) {
+         job.lattice = magneto::LatticeGeometry::SquareNNN;
+         job.J2 = -1;
+      } },
+      { R"({"boundary_x": "antiperiodic", "boundary_y": "fixed_opposite"})", [](JsonJob& job) {
+         job.boundary_x = magneto::Boundary::Antiperiodic;
+         job.boundary_y = magneto::Boundary::FixedOpposite;
+      } },
+      { R"({"Lz": 8, "image_slice": 2})", [](JsonJob& job) {
+         job.Lz = 8;
+         job.image_mode.m_slice = 2;
+      } },
+      { R"({"spin_model": "clock", "q": 6})", [](JsonJob& job) {
+         job.spin_model = magneto::SpinModel::Clock;
+         job.q = 6;
+      } },
+      { R"({"t_protocol": "images", "t_protocol_start": 4.0, "t_protocol_sweeps": 60, "t_protocol_images": ["hot.png", "mid.png"], "protocol_path": "protocol.txt"})", [](JsonJob& job) {
+         job.t_protocol = magneto::TempProtocolMode::Images;
+         job.t_protocol_start = 4.0;
+         job.t_protocol_sweeps = 60;
+         job.t_protocol_images = { "hot.png", "mid.png" };
+         job.physics_config.m_protocol_path = "protocol.txt";
+      } },
+      { R"({"pipeline_depth": 4})", [](JsonJob& job) {job.pipeline_depth = 4; } },
+   };
+   for (const auto& [json, set_expected] : cases) {
+      JsonJob expected = empty_job;
+      set_expected(expected);
+      const JsonJob job = magneto::get_parsed_job(json);
+      EXPECT_TRUE(job == expected) << json;
+      EXPECT_FALSE(job == empty_job) << json;
+   }
+}
+
+
+TEST_F(Jobs, BatchesOnlyForMetropolis) {
+   const auto get_batch_size = [](const std::string& json) {
+      const auto job = magneto::get_job(magneto::get_parsed_job(json));
+      return job.has_value() ? std::get<0>(job.value()).m_batch_size : 0u;
+   };
+   EXPECT_EQ(get_batch_size(R"({"L": 8, "batch_size": 8})"), 8u);
+   EXPECT_EQ(get_batch_size(R"({"L": 8, "batch_size": 8, "algorithm": "SW"})"), 1u);
+   EXPECT_EQ(get_batch_size(R"({"L": 8, "batch_size": 8, "schedule": [{"alg": "metropolis", "n": 2}]})"), 1u);
+   EXPECT_EQ(get_batch_size(R"({"L": 8, "batch_size": 8, "boundary_x": "open"})"), 1u);
+}
+
+
+TEST_F(Jobs, RejectsCreutzWithoutCoupling) {
+   EXPECT_FALSE(magneto::get_job(magneto::get_parsed_job(std::string(R"({"algorithm": "creutz", "J": 0})"))).has_value());
+   EXPECT_FALSE(magneto::get_job(magneto::get_parsed_job(std::string(
+      R"({"J": 0, "schedule": [{"alg": "SW", "n": 1}, {"alg": "creutz", "n": 5}]})"
+   ))).has_value());
+}
+
+
+
+TEST(AutoAlgorithm, AutocorrelationTimeOfKnownSeries) {
+   // AR(1) with x' = rho*x + noise has tau_int = (1 + rho) / (2(1 - rho))
+   std::mt19937 rng(5);
+   std::normal_distribution<double> noise;
+   for (const double rho : { 0.0, 0.5, 0.8 }) {
+      std::vector<double> series(100000);
+      double x = 0.0;
+      for (double& value : series) {
+         x = rho * x + noise(rng);
+         value = x;
+      }
+      const double exact_tau = (1.0 + rho) / (2.0 * (1.0 - rho));
+      EXPECT_NEAR(magneto::get_integrated_autocorrelation_time(series), exact_tau, 0.1 * exact_tau) << "rho=" << rho;
+   }
+}
+
+
+TEST(AutoAlgorithm, SWDecorrelatesFasterAtTc) {
+   // The auto algorithm compares the larger tau of energy and magnetization. Near Tc, SW must win
+   // by far, otherwise it only wins through its time per step.
+   constexpr unsigned int L = 32;
+   const double Tc = 2.0 / std::log(1.0 + std::sqrt(2.0));
+   const auto get_tau = [&](magneto::LatticeAlgorithm& algorithm) {
+      magneto::IsingSystem system(1, magneto::LatticeType(L, std::vector<char>(L, 1)));
+      std::vector<double> energies;
+      std::vector<double> mags;
+      for (unsigned int run = 0; run < 3000; ++run) {
+         algorithm.run(system.get_lattice_nc());
+         if (run < 500)
+            continue;
+         const magneto::PhysicalMeasurement measurement = magneto::get_properties(system);
+         energies.emplace_back(measurement.energy);
+         mags.emplace_back(measurement.magnetization);
+      }
+      return std::max(magneto::get_integrated_autocorrelation_time(energies), magneto::get_integrated_autocorrelation_time(mags));
+   };
+   magneto::SW sw(1, Tc, L, L);
+   std::unique_ptr<magneto::LatticeAlgorithm> metropolis = magneto::get_specialized_algorithm<magneto::Metropolis>(1, L, L, Tc, L, L);
+   EXPECT_LT(5.0 * get_tau(sw), get_tau(*metropolis));
+}
+
+
+TEST(Multispin, MatchesScalarMetropolis) {
+   const std::array<double, 2> temps{ 2.0, 3.0 };
+   std::array<double, magneto::MultispinMetropolis::replica_count> replica_temps;
+   for (unsigned int lane = 0; lane < replica_temps.size(); ++lane)
+      replica_temps[lane] = temps[lane % temps.size()];
+   magneto::MultispinMetropolis multispin(1, replica_temps, magneto::LatticeType(4, std::vector<char>(4, 1)));
+   std::array<double, 2> multispin_energies{};
+   for (unsigned int sweep = 0; sweep < 2200; ++sweep) {
+      multispin.run();
+      if (sweep < 200)
+         continue;
+      const auto measurements = multispin.get_measurements();
+      for (unsigned int lane = 0; lane < replica_temps.size(); ++lane)
+         multispin_energies[lane % temps.size()] += measurements[lane].energy / (2000.0 * replica_temps.size() / temps.size());
+   }
+
+   for (size_t t = 0; t < temps.size(); ++t) {
+      std::unique_ptr<magneto::LatticeAlgorithm> scalar = magneto::get_specialized_algorithm<magneto::Metropolis>(1, 4, 4, temps[t], 4, 4);
+      magneto::LatticeType lattice(4, std::vector<char>(4, 1));
+      double scalar_energy = 0.0;
+      for (unsigned int sweep = 0; sweep < 20200; ++sweep) {
+         scalar->run(lattice);
+         if (sweep >= 200)
+            scalar_energy += get_energy(lattice) / 20000.0;
+      }
+      const double exact_energy = get_exact_4x4_energy(temps[t]);
+      EXPECT_NEAR(multispin_energies[t], exact_energy, 0.03);
+      EXPECT_NEAR(scalar_energy, exact_energy, 0.03);
+   }
+}
+
+
+TEST(ThreeDimensions, FlatAlgorithmsMatchExactEnergy) {
+   // 2x2x4 periodic lattice, x varies fastest. The extent 2 axes bond every pair twice, in the
+   // measurement as in the algorithms.
+   const std::array<int, 3> extents{ 2, 2, 4 };
+   const auto get_bond_sum = [&](const std::vector<char>& spins) {
+      const auto spin = [&](const int x, const int y, const int z) {
+         return spins[(x % 2) + 2 * ((y % 2) + 2 * (z % 4))];
+      };
+      int sum = 0;
+      for (int z = 0; z < 4; ++z) {
+         for (int y = 0; y < 2; ++y) {
+            for (int x = 0; x < 2; ++x)
+               sum += spin(x, y, z) * (spin(x + 1, y, z) + spin(x, y + 1, z) + spin(x, y, z + 1));
+         }
+      }
+      return sum;
+   };
+
+   constexpr double T = 5.0;
+   double weight_sum = 0.0;
+   double energy_sum = 0.0;
+   std::vector<char> spins(16);
+   for (unsigned int state = 0; state < (1u << 16); ++state) {
+      for (unsigned int site = 0; site < 16; ++site)
+         spins[site] = (state >> site) & 1 ? 1 : -1;
+      const int bond_sum = get_bond_sum(spins);
+      const double weight = std::exp(bond_sum / T);
+      weight_sum += weight;
+      energy_sum -= weight * bond_sum / 16.0;
+   }
+   const double exact_energy = energy_sum / weight_sum;
+
+   std::vector<std::unique_ptr<magneto::FlatLatticeAlgorithm<3>>> algorithms;
+   algorithms.emplace_back(std::make_unique<magneto::FlatMetropolis<3>>(1, T, extents));
+   algorithms.emplace_back(std::make_unique<magneto::FlatSW<3>>(1, T, extents));
+   for (const std::unique_ptr<magneto::FlatLatticeAlgorithm<3>>& algorithm : algorithms) {
+      magneto::FlatLattice<3> lattice{ extents, std::vector<char>(16, 1) };
+      double energy = 0.0;
+      for (unsigned int sweep = 0; sweep < 20200; ++sweep) {
+         algorithm->run(lattice);
+         if (sweep < 200)
+            continue;
+         const double measured_energy = magneto::get_flat_measurement(lattice).energy;
+         ASSERT_DOUBLE_EQ(measured_energy, -get_bond_sum(lattice.spins) / 16.0);
+         energy += measured_energy / 20000.0;
+      }
+      EXPECT_NEAR(energy, exact_energy, 0.03);
+   }
+}
+
+
+TEST(ThreeDimensions, SlicesAreZPlanes) {
+   const magneto::FlatLattice<3> lattice = magneto::get_randomized_flat_lattice<3>({ 3, 2, 4 });
+   for (int z = 0; z < 4; ++z) {
+      const magneto::LatticeType slice = magneto::get_lattice_slice(lattice, z);
+      ASSERT_EQ(magneto::get_dimensions_of_lattice(slice), std::make_pair(3u, 2u));
+      for (int y = 0; y < 2; ++y) {
+         for (int x = 0; x < 3; ++x)
+            EXPECT_EQ(slice[y][x], lattice.spins[x + 3 * (y + 2 * z)]);
+      }
+   }
+}
+
+
+TEST(CommonRandomNumbers, SameTemperatureGivesSameLattice) {
+   // The second lattice only starts after the first one is 200 sweeps ahead, so its early sweeps
+   // have long been evicted and must be regenerated identically
+   constexpr unsigned int L = 16;
+   const auto source = std::make_shared<magneto::CommonRandomSource>(L, L, 2);
+   const magneto::LatticeType start = magneto::get_randomized_system(L, L);
+   magneto::LatticeType first = start;
+   magneto::LatticeType second = start;
+   magneto::Metropolis<1, true> first_metropolis(1, 2.3, source);
+   magneto::Metropolis<1, true> second_metropolis(1, 2.3, source);
+   for (unsigned int sweep = 0; sweep < 200; ++sweep)
+      first_metropolis.run(first);
+   for (unsigned int sweep = 0; sweep < 200; ++sweep)
+      second_metropolis.run(second);
+   EXPECT_EQ(first, second);
+   EXPECT_NE(first, start);
+}
+
+
+TEST(CommonRandomNumbers, CloseTemperaturesStayCorrelated) {
+   // With common random numbers, a small change of T only changes a few decisions. Independent
+   // streams decorrelate the lattices completely.
+   constexpr unsigned int L = 32;
+   const magneto::LatticeType start(L, std::vector<char>(L, 1));
+   const auto get_overlap = [&](magneto::LatticeAlgorithm& a, magneto::LatticeAlgorithm& b) {
+      magneto::LatticeType lattice_a = start;
+      magneto::LatticeType lattice_b = start;
+      for (unsigned int sweep = 0; sweep < 10; ++sweep) {
+         a.run(lattice_a);
+         b.run(lattice_b);
+      }
+      int overlap = 0;
+      for (unsigned int i = 0; i < L; ++i) {
+         for (unsigned int j = 0; j < L; ++j)
+            overlap += lattice_a[i][j] * lattice_b[i][j];
+      }
+      return overlap * 1.0 / (L * L);
+   };
+   const auto source = std::make_shared<magneto::CommonRandomSource>(L, L, 2);
+   magneto::Metropolis<1, true> common_a(1, 4.0, source);
+   magneto::Metropolis<1, true> common_b(1, 4.01, source);
+   magneto::Metropolis<1, true> independent_a(1, 4.0, L, L);
+   magneto::Metropolis<1, true> independent_b(1, 4.01, L, L);
+   EXPECT_GT(get_overlap(common_a, common_b), 0.5);
+   EXPECT_LT(get_overlap(independent_a, independent_b), 0.3);
+}
+
+
+TEST(SpecializedKernels, MatchExactEnergy) {
+   // Every sign of J and both kinds of wrap: 4x4 has power of two sizes, 3x3 doesn't. The
+   // temperatures scale with |J|, so all of them are at T/|J| = 2.5. Single spin flips near Tc
+   // leave a statistical error of about 0.01.
+   const auto get_exact_3x3_periodic_energy = [](const int J, const double T) {
+      double weight_sum = 0.0;
+      double energy_sum = 0.0;
+      magneto::LatticeType lattice(3, std::vector<char>(3));
+      for (unsigned int state = 0; state < (1u << 9); ++state) {
+         for (unsigned int site = 0; site < 9; ++site)
+            lattice[site / 3][site % 3] = (state >> site) & 1 ? 1 : -1;
+         const double E = get_energy(lattice);
+         const double weight = std::exp(-9.0 * J * E / T);
+         weight_sum += weight;
+         energy_sum += weight * E;
+      }
+      return energy_sum / weight_sum;
+   };
+   constexpr double T = 2.5;
+   for (const int J : { 1, 2, -1, -2 }) {
+      std::unique_ptr<magneto::LatticeAlgorithm> power_of_two = magneto::get_specialized_algorithm<magneto::Metropolis>(J, 4, 4, std::abs(J) * T, 4, 4);
+      std::unique_ptr<magneto::LatticeAlgorithm> other_size = magneto::get_specialized_algorithm<magneto::Metropolis>(J, 3, 3, std::abs(J) * T, 3, 3);
+
+      // The 4x4 lattice is bipartite, so its antiferromagnet has the ferromagnet's energies
+      EXPECT_NEAR(get_mean_energy(*power_of_two, 4), J > 0 ? get_exact_4x4_energy(T) : -get_exact_4x4_energy(T), 0.04) << "J=" << J;
+      EXPECT_NEAR(get_mean_energy(*other_size, 3), get_exact_3x3_periodic_energy(J > 0 ? 1 : -1, T), 0.04) << "J=" << J;
+   }
+}
+
+
+TEST(SW, MatchesExactEnergy) {
+   for (const double T : { 1.8, 3.0 }) {
+      magneto::SW sw(1, T, 4, 4);
+      EXPECT_NEAR(get_mean_energy(sw, 4), get_exact_4x4_energy(T), 0.02) << "T=" << T;
+   }
+}
+
+
+TEST(Protocols, RampedAlgorithmsMatchExactEnergy) {
+   // Built hot and ramped down linearly through set_temperature(), as a protocol does. The
+   // algorithms must then sample the final temperature.
+   constexpr double T_start = 5.0;
+   constexpr double T = 2.0;
+   magneto::RandomStreams streams(4, 4);
+   const auto couplings = std::make_shared<magneto::BondCouplings>();
+   couplings->Lx = 4;
+   couplings->Ly = 4;
+   couplings->east.assign(16, 1);
+   couplings->south.assign(16, 1);
+   std::vector<std::unique_ptr<magneto::LatticeAlgorithm>> algorithms;
+   algorithms.emplace_back(magneto::get_specialized_algorithm<magneto::Metropolis>(1, 4, 4, T_start, streams));
+   algorithms.emplace_back(std::make_unique<magneto::SW>(1, T_start, streams));
+   algorithms.emplace_back(std::make_unique<magneto::StencilMetropolis<magneto::SquareStencil>>(1, 0, T_start, streams));
+   algorithms.emplace_back(std::make_unique<magneto::StencilSW<magneto::SquareStencil>>(1, 0, T_start, streams));
+   algorithms.emplace_back(std::make_unique<magneto::BondMetropolis<true>>(couplings, T_start, streams));
+   algorithms.emplace_back(std::make_unique<magneto::BondSW>(couplings, T_start, streams));
+   for (size_t a = 0; a < algorithms.size(); ++a) {
+      magneto::LatticeType lattice = magneto::get_randomized_system(4, 4);
+      for (unsigned int sweep = 0; sweep < 100; ++sweep) {
+         ASSERT_TRUE(algorithms[a]->set_temperature(T_start + (sweep + 1) / 100.0 * (T - T_start))) << "algorithm " << a;
+         algorithms[a]->run(lattice);
+      }
+      EXPECT_NEAR(get_mean_energy(*algorithms[a], 4), get_exact_4x4_energy(T), 0.02) << "algorithm " << a;
+   }
+}
+
+
+TEST(VariableTemperatures, LevelsMatchExactEnergy) {
+   // Every site has its own temperature within 1e-5 of T, so the algorithms sort them into 16 levels
+   for (const double T : { 1.8, 3.0 }) {
+      magneto::LatticeDType temperatures(4, std::vector<double>(4));
+      for (unsigned int site = 0; site < 16; ++site)
+         temperatures[site / 4][site % 4] = T + 1e-6 * site;
+      magneto::VariableSW sw(1, temperatures, 4, 4);
+      EXPECT_NEAR(get_mean_energy(sw, 4), get_exact_4x4_energy(T), 0.02) << "T=" << T;
+      std::unique_ptr<magneto::LatticeAlgorithm> metropolis = magneto::get_specialized_algorithm<magneto::VariableMetropolis>(1, 4, 4, temperatures, 4, 4);
+      EXPECT_NEAR(get_mean_energy(*metropolis, 4), get_exact_4x4_energy(T), 0.03) << "T=" << T;
+   }
+}
+
+
+TEST(VariableTemperatures, SWMatchesExactEnergyAfterTemperatureChanges) {
+   // Starting from both temperatures, every site moves to an existing level first, then to a new one
+   magneto::LatticeDType temperatures(4, std::vector<double>(4, 1.8));
+   for (unsigned int site = 0; site < 16; site += 2)
+      temperatures[site / 4][site % 4] = 3.0;
+   magneto::VariableSW sw(1, temperatures, 4, 4);
+   for (const double T : { 1.8, 3.0, 2.4 }) {
+      ASSERT_TRUE(sw.set_temperatures(magneto::LatticeDType(4, std::vector<double>(4, T))));
+      EXPECT_NEAR(get_mean_energy(sw, 4), get_exact_4x4_energy(T), 0.02) << "T=" << T;
+   }
+}
+
+
+TEST(Schedules, RunsComponentsInOrder) {
+   // Every component writes its name into the log when it runs
+   class LoggingAlgorithm : public magneto::LatticeAlgorithm {
+   public:
+      LoggingAlgorithm(const char name, std::string& log) : m_name(name), m_log(log) { }
+      virtual void run(magneto::LatticeType& /*lattice*/) { m_log += m_name; }
+   private:
+      char m_name;
+      std::string& m_log;
+   };
+
+   std::string log;
+   std::vector<magneto::ScheduledAlgorithm::Component> components;
+   components.emplace_back(std::make_unique<LoggingAlgorithm>('a', log), 2);
+   components.emplace_back(std::make_unique<LoggingAlgorithm>('b', log), 0);
+   components.emplace_back(std::make_unique<LoggingAlgorithm>('c', log), 3);
+   magneto::ScheduledAlgorithm schedule(std::move(components));
+   magneto::LatticeType lattice(4, std::vector<char>(4, 1));
+   schedule.run(lattice);
+   schedule.run(lattice);
+   EXPECT_EQ(log, "aacccaaccc");
+   EXPECT_FALSE(schedule.set_temperature(2.0));
+}
+
+
+TEST(Schedules, SharedStreamsMatchExactEnergy) {
+   // SW and Metropolis draw from the same streams. Only a schedule ending with SW has clusters.
+   constexpr double T = 2.5;
+   for (const bool ends_with_sw : { false, true }) {
+      magneto::RandomStreams streams(4, 4);
+      std::vector<magneto::ScheduledAlgorithm::Component> components;
+      if (ends_with_sw)
+         components.emplace_back(std::make_unique<magneto::Metropolis<1, true>>(1, T, streams), 2);
+      components.emplace_back(std::make_unique<magneto::SW>(1, T, streams), 1);
+      if (!ends_with_sw)
+         components.emplace_back(std::make_unique<magneto::Metropolis<1, true>>(1, T, streams), 2);
+      magneto::ScheduledAlgorithm schedule(std::move(components));
+      EXPECT_NEAR(get_mean_energy(schedule, 4), get_exact_4x4_energy(T), 0.02) << "ends with SW: " << ends_with_sw;
+      EXPECT_EQ(schedule.get_cluster_statistics().has_value(), ends_with_sw);
+   }
+}
+
+
+TEST(Kawasaki, ConservesMagnetization) {
+   const auto get_magnetization = [](const magneto::LatticeType& lattice) {
+      int sum = 0;
+      for (const std::vector<char>& row : lattice)
+         sum += std::accumulate(std::cbegin(row), std::cend(row), 0);
+      return sum;
+   };
+
+   // 256x256 is large enough for the rows of a pair class to run in parallel
+   for (const int L : { 8, 256 }) {
+      magneto::LatticeType lattice = magneto::get_randomized_system(L, L);
+      const magneto::LatticeType start = lattice;
+      const int magnetization = get_magnetization(lattice);
+      magneto::Kawasaki kawasaki(1, 2.0, L, L);
+      const unsigned int sweeps = L == 8 ? 2000 : 20;
+      for (unsigned int sweep = 0; sweep < sweeps; ++sweep) {
+         kawasaki.run(lattice);
+         ASSERT_EQ(get_magnetization(lattice), magnetization) << "L=" << L << ", sweep " << sweep;
+      }
+      EXPECT_NE(lattice, start) << "L=" << L;
+   }
+}
+
+
+TEST(Creutz, ConservesEnergy) {
+   // 256x256 is large enough for the rows of a phase to run in parallel
+   for (const int L : { 16, 256 }) {
+      magneto::LatticeType lattice = magneto::get_randomized_system(L, L);
+      magneto::CreutzDemon creutz(1, 2.5, L, L);
+      const auto get_total_energy = [&]() {return std::lround(get_energy(lattice) * L * L) + creutz.get_demon_energy(); };
+      const long total_energy = get_total_energy();
+      const unsigned int sweeps = L == 16 ? 2000 : 20;
+      for (unsigned int sweep = 0; sweep < sweeps; ++sweep) {
+         creutz.run(lattice);
+         ASSERT_EQ(get_total_energy(), total_energy) << "L=" << L << ", sweep " << sweep;
+      }
+   }
+}
+
+
+TEST(Creutz, DemonTemperatureTracksT) {
+   // The lattice is equilibrated at T by SW, the demons then measure its temperature. Its
+   // energy is fixed from then on, so it needs to be large for T to fluctuate little.
+   constexpr unsigned int L = 128;
+   for (const double T : { 2.0, 3.0 }) {
+      magneto::LatticeType lattice(L, std::vector<char>(L, 1));
+      magneto::SW sw(1, T, L, L);
+      for (unsigned int run = 0; run < 200; ++run)
+         sw.run(lattice);
+      magneto::CreutzDemon creutz(1, T, L, L);
+      for (unsigned int sweep = 0; sweep < 2000; ++sweep)
+         creutz.run(lattice);
+      const std::optional<double> measured_T = creutz.get_measured_temperature();
+      ASSERT_TRUE(measured_T.has_value()) << "T=" << T;
+      EXPECT_NEAR(measured_T.value(), T, 0.1);
+   }
+}
+
+
+TEST(SpinModels, WolffMatchesExactEnergy) {
+   using Potts = magneto::PottsModel<2>;
+   using Clock2 = magneto::ClockModel<1>;
+   using Clock4 = magneto::ClockModel<2>;
+   using Clock5 = magneto::ClockModel<4>;
+   magneto::ModelWolff<Potts> potts(1, 1.0, 3);
+   EXPECT_NEAR(get_model_mean_energy(potts, 3, 3), get_exact_model_energy<Potts>(3, 3, 1, 1.0), 0.03);
+   magneto::ModelWolff<Potts> antiferro_potts(-1, 1.0, 3);
+   EXPECT_NEAR(get_model_mean_energy(antiferro_potts, 3, 3), get_exact_model_energy<Potts>(3, 3, -1, 1.0), 0.03);
+   magneto::ModelWolff<Clock4> clock4(1, 1.0, 4);
+   EXPECT_NEAR(get_model_mean_energy(clock4, 3, 4), get_exact_model_energy<Clock4>(3, 4, 1, 1.0), 0.03);
+   magneto::ModelWolff<Clock5> clock5(1, 1.0, 5);
+   EXPECT_NEAR(get_model_mean_energy(clock5, 3, 5), get_exact_model_energy<Clock5>(3, 5, 1, 1.0), 0.03);
+
+   // The two state clock model is the Ising model
+   magneto::ModelWolff<Clock2> ising(1, 2.5, 2);
+   EXPECT_NEAR(get_model_mean_energy(ising, 4, 2), get_exact_4x4_energy(2.5), 0.03);
+}
+
+
+TEST(SpinModels, MetropolisMatchesExactEnergy) {
+   using Potts = magneto::PottsModel<2>;
+   using Clock5 = magneto::ClockModel<4>;
+   magneto::ModelMetropolis<Potts> potts(1, 1.0, 3);
+   EXPECT_NEAR(get_model_mean_energy(potts, 3, 3), get_exact_model_energy<Potts>(3, 3, 1, 1.0), 0.03);
+   magneto::ModelMetropolis<Potts> antiferro_potts(-1, 1.0, 3);
+   EXPECT_NEAR(get_model_mean_energy(antiferro_potts, 3, 3), get_exact_model_energy<Potts>(3, 3, -1, 1.0), 0.03);
+   magneto::ModelMetropolis<Clock5> clock5(1, 1.0, 5);
+   EXPECT_NEAR(get_model_mean_energy(clock5, 3, 5), get_exact_model_energy<Clock5>(3, 5, 1, 1.0), 0.03);
+}
+
+
+TEST(SpinModels, PottsSWMatchesExactEnergy) {
+   using Potts = magneto::PottsModel<2>;
+   magneto::PottsSW<Potts> q3(1, 1.0, 3);
+   EXPECT_NEAR(get_model_mean_energy(q3, 3, 3), get_exact_model_energy<Potts>(3, 3, 1, 1.0), 0.03);
+   magneto::PottsSW<Potts> q4(1, 0.8, 4);
+   EXPECT_NEAR(get_model_mean_energy(q4, 3, 4), get_exact_model_energy<Potts>(3, 4, 1, 0.8), 0.03);
+}
+
+
+TEST(Multispin, AcceptsEveryFlipWithoutCoupling) {
+   // J=0 accepts with probability 1, so one sweep negates every replica
+   std::array<double, magneto::MultispinMetropolis::replica_count> temps;
+   temps.fill(1.0);
+   const magneto::LatticeType initial = magneto::get_randomized_system(8, 8);
+   magneto::MultispinMetropolis multispin(0, temps, initial);
+   multispin.run();
+   for (unsigned int lane = 0; lane < temps.size(); ++lane)
+      EXPECT_EQ(multispin.get_replica_lattice(lane), get_negated(initial));
+}
+
+
+TEST(FFT, RoundTrip) {
+   std::mt19937 rng(1);
+   std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+   // Radix-2 and Bluestein lengths
+   for (const size_t n : { 1, 2, 8, 64, 3, 7, 12, 100 }) {
+      std::vector<std::complex<double>> data(n);
+      for (std::complex<double>& value : data)
+         value = { uniform(rng), uniform(rng) };
+      const magneto::FFTPlan plan(n);
+      std::vector<std::complex<double>> transformed(data);
+      plan.transform(transformed.data());
+      const std::vector<std::complex<double>> expected = get_naive_dft(data);
+      for (size_t k = 0; k < n; ++k)
+         EXPECT_NEAR(std::abs(transformed[k] - expected[k]), 0.0, 1e-9) << "n=" << n << ", k=" << k;
+      plan.transform(transformed.data(), true);
+      for (size_t k = 0; k < n; ++k)
+         EXPECT_NEAR(std::abs(transformed[k] - data[k]), 0.0, 1e-9) << "n=" << n << ", k=" << k;
+   }
+}
+
+
+TEST(FFT, PowerSpectrumGivesAutocorrelation) {
+   // Wiener-Khinchin: the inverse of |F(k)|^2 is the circular autocorrelation times N
+   std::mt19937 rng(2);
+   std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+   for (const auto& [Lx, Ly] : { std::pair<size_t, size_t>{ 8, 4 }, { 6, 5 }, { 7, 3 } }) {
+      std::vector<double> field(Lx * Ly);
+      for (double& value : field)
+         value = uniform(rng);
+      const magneto::FFTPlan plan_x(Lx);
+      const magneto::FFTPlan plan_y(Ly);
+      const std::vector<double> correlation = magneto::get_inverse_transform_real(
+         magneto::get_power_spectrum(field, plan_x, plan_y), plan_x, plan_y
+      );
+      for (size_t dy = 0; dy < Ly; ++dy) {
+         for (size_t dx = 0; dx < Lx; ++dx) {
+            double expected = 0.0;
+            for (size_t i = 0; i < Ly; ++i) {
+               for (size_t j = 0; j < Lx; ++j)
+                  expected += field[i * Lx + j] * field[((i + dy) % Ly) * Lx + (j + dx) % Lx];
+            }
+            EXPECT_NEAR(correlation[dy * Lx + dx], expected, 1e-9) << Lx << "x" << Ly << ", r=(" << dx << "," << dy << ")";
+         }
+      }
+   }
+}
+
+
+TEST(Jackknife, MomentErrorsMatchBinStandardError) {
+   // For a plain mean over equal bins, the jackknife error reduces to the standard error of the
+   // bin means
+   constexpr unsigned int bin_count = 4;
+   constexpr unsigned int bin_size = 10;
+   magneto::MomentAccumulator accumulator(bin_count * bin_size, bin_count);
+   magneto::PhysicalProperties properties;
+   properties.T = 2.0;
+   properties.Lx = 4;
+   properties.Ly = 4;
+   std::vector<double> bin_means_m2(bin_count, 0.0);
+   std::vector<double> bin_means_m4(bin_count, 0.0);
+   for (unsigned int i = 0; i < bin_count * bin_size; ++i) {
+      magneto::PhysicalMeasurement measurement;
+      measurement.magnetization = 0.1 + 0.02 * ((i * 7) % 11);
+      accumulator.add(measurement);
+      properties.measurements.emplace_back(measurement);
+      const double m2 = measurement.magnetization * measurement.magnetization;
+      bin_means_m2[i / bin_size] += m2 / bin_size;
+      bin_means_m4[i / bin_size] += m2 * m2 / bin_size;
+   }
+   properties.moment_bins = accumulator.get_bins();
+   ASSERT_EQ(properties.moment_bins.size(), bin_count);
+
+   const auto get_mean_and_error = [](const std::vector<double>& values) {
+      const double n = static_cast<double>(values.size());
+      double mean = 0.0;
+      for (const double value : values)
+         mean += value / n;
+      double square_sum = 0.0;
+      for (const double value : values)
+         square_sum += (value - mean) * (value - mean);
+      return std::make_pair(mean, std::sqrt(square_sum / (n * (n - 1.0))));
+   };
+   const auto [m2, m2_err] = get_mean_and_error(bin_means_m2);
+   const auto [m4, m4_err] = get_mean_and_error(bin_means_m4);
+
+   const magneto::PhysicsResult result = magneto::get_physical_results(properties);
+   EXPECT_NEAR(result.m2, m2, 1e-12);
+   EXPECT_NEAR(result.m2_err, m2_err, 1e-12);
+   EXPECT_NEAR(result.m4, m4, 1e-12);
+   EXPECT_NEAR(result.m4_err, m4_err, 1e-12);
+   EXPECT_NEAR(result.binder, 1.0 - m4 / (3.0 * m2 * m2), 1e-12);
+   EXPECT_GT(result.binder_err, 0.0);
+}
+
+
+TEST(Jackknife, BinderOfOrderedStateIsTwoThirds) {
+   // |m| constant gives <m^4> = <m^2>^2, so U4 = 2/3 in every jackknife sample
+   magneto::MomentAccumulator accumulator(100, 10);
+   magneto::PhysicalProperties properties;
+   properties.T = 1.0;
+   properties.Lx = 4;
+   properties.Ly = 4;
+   for (unsigned int i = 0; i < 100; ++i) {
+      magneto::PhysicalMeasurement measurement;
+      measurement.magnetization = i % 3 == 0 ? -0.75 : 0.75;
+      accumulator.add(measurement);
+      properties.measurements.emplace_back(measurement);
+   }
+   properties.moment_bins = accumulator.get_bins();
+   const magneto::PhysicsResult result = magneto::get_physical_results(properties);
+   EXPECT_NEAR(result.binder, 2.0 / 3.0, 1e-12);
+   EXPECT_NEAR(result.binder_err, 0.0, 1e-12);
+   EXPECT_NEAR(result.m2_err, 0.0, 1e-12);
+}
+
+
+TEST(SnapshotPipeline, SnapshotsArriveInOrderAndComplete) {
+   // Every iteration is written into the lattice bits, so the consumer can check the copied state
+   constexpr unsigned int L = 4;
+   constexpr unsigned int iterations = 2000;
+   const auto get_system = [&](const unsigned int iteration) {
+      magneto::LatticeType lattice(L, std::vector<char>(L));
+      for (unsigned int bit = 0; bit < L * L; ++bit)
+         lattice[bit / L][bit % L] = (iteration >> bit) & 1 ? 1 : -1;
+      return magneto::IsingSystem(1, lattice);
+   };
+   const magneto::IsingSystem final_system = get_system(12345);
+
+   // A consumer that is sometimes slow fills the ring, one that is never slow doesn't
+   for (const unsigned int slow_every : { 7u, iterations }) {
+      std::vector<unsigned int> consumed;
+      bool has_final = false;
+      bool is_final_last = true;
+      bool lattices_match = true;
+      magneto::SnapshotPipeline pipeline(get_system(0), 3, [&](const magneto::Snapshot& snapshot) {
+         is_final_last = is_final_last && !has_final;
+         if (snapshot.is_final) {
+            has_final = true;
+            lattices_match = lattices_match && snapshot.system.get_lattice() == final_system.get_lattice();
+            return;
+         }
+         lattices_match = lattices_match && snapshot.system.get_lattice() == get_system(snapshot.iteration).get_lattice();
+         consumed.emplace_back(snapshot.iteration);
+         if (snapshot.iteration % slow_every == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+      });
+      for (unsigned int iteration = 0; iteration < iterations; ++iteration)
+         pipeline.push(get_system(iteration), std::nullopt, iteration);
+      pipeline.finish(final_system);
+
+      std::vector<unsigned int> expected(iterations);
+      std::iota(std::begin(expected), std::end(expected), 0u);
+      EXPECT_EQ(consumed, expected) << "slow every " << slow_every;
+      EXPECT_TRUE(has_final);
+      EXPECT_TRUE(is_final_last);
+      EXPECT_TRUE(lattices_match);
+   }
+}
+
+
+TEST(Energy, CouplingsMatchUniformLattice) {
+   // Energies are in units of J, so couplings that are all J give the uniform lattice energy
+   const magneto::LatticeType grid = magneto::get_randomized_system(8, 6);
+   for (const int J : { 1, 2, -1 }) {
+      auto couplings = std::make_shared<magneto::BondCouplings>();
+      couplings->Lx = 8;
+      couplings->Ly = 6;
+      couplings->east.assign(8 * 6, static_cast<signed char>(J));
+      couplings->south.assign(8 * 6, static_cast<signed char>(J));
+      const magneto::IsingSystem uniform_system(J, grid);
+      const magneto::IsingSystem bond_system(J, grid, couplings);
+      EXPECT_NEAR(magneto::get_properties(bond_system).energy, magneto::get_properties(uniform_system).energy, 1e-12) << "J=" << J;
+   }
+}
+
+
+TEST(Energy, RandomCouplingsKeepTheSignOfJ) {
+   // Without antiferromagnetic bonds, random couplings are the uniform lattice, also for J<0
+   const magneto::LatticeType grid = magneto::get_randomized_system(8, 6);
+   for (const int J : { 1, -1, -2 }) {
+      const auto couplings = std::make_shared<const magneto::BondCouplings>(magneto::get_random_couplings(8, 6, J, 0.0, 3));
+      const magneto::IsingSystem uniform_system(J, grid);
+      const magneto::IsingSystem bond_system(J, grid, couplings);
+      EXPECT_NEAR(magneto::get_properties(bond_system).energy, magneto::get_properties(uniform_system).energy, 1e-12) << "J=" << J;
+   }
+}
+
+
+TEST(Energy, FieldInUnitsOfJ) {
+   // All spins up: -2 per site from the bonds and -h/J from the field
+   const magneto::LatticeType grid(4, std::vector<char>(4, 1));
+   const auto field = std::make_shared<magneto::ExternalField>();
+   field->h = 0.5;
+   for (const int J : { 1, 2, -1 }) {
+      const magneto::IsingSystem system(J, grid, nullptr, field);
+      EXPECT_NEAR(magneto::get_properties(system).energy, -2.0 - 0.5 / J, 1e-12) << "J=" << J;
+   }
+}
+
+
+TEST(Energy, StencilsInUnitsOfJ) {
+   // Anisotropic with J2 = J is the square lattice
+   const magneto::LatticeType grid = magneto::get_randomized_system(8, 6);
+   for (const int J : { 1, 2, -1 }) {
+      magneto::Geometry anisotropic;
+      anisotropic.lattice = magneto::LatticeGeometry::Anisotropic;
+      anisotropic.J2 = J;
+      const double square_energy = magneto::get_properties(magneto::IsingSystem(J, grid)).energy;
+      EXPECT_NEAR(magneto::get_properties(magneto::IsingSystem(J, grid, nullptr, nullptr, anisotropic)).energy, square_energy, 1e-12) << "J=" << J;
+
+      // Three bonds per site on the aligned triangular lattice
+      magneto::Geometry triangular;
+      triangular.lattice = magneto::LatticeGeometry::Triangular;
+      const magneto::LatticeType aligned(6, std::vector<char>(6, 1));
+      EXPECT_NEAR(magneto::get_properties(magneto::IsingSystem(J, aligned, nullptr, nullptr, triangular)).energy, -3.0, 1e-12) << "J=" << J;
+   }
+}
+
+
+TEST(Geometries, StencilAlgorithmsMatchExactEnergy) {
+   // Energies per site in units of J on 4x4 lattices of every geometry, exact by summing all states
+   constexpr double T = 3.0;
+   const auto get_stencil_energy = [](const magneto::LatticeType& lattice, const magneto::Geometry& geometry) {
+      return -magneto::get_stencil_energy_sum(lattice, 1, geometry) / 16.0;
+   };
+   std::vector<magneto::Geometry> geometries(4);
+   geometries[0].lattice = magneto::LatticeGeometry::Triangular;
+   geometries[1].lattice = magneto::LatticeGeometry::Honeycomb;
+   geometries[2].lattice = magneto::LatticeGeometry::SquareNNN;
+   geometries[2].J2 = -1;
+   geometries[3].lattice = magneto::LatticeGeometry::Anisotropic;
+   geometries[3].J2 = 2;
+   for (const magneto::Geometry& geometry : geometries) {
+      double weight_sum = 0.0;
+      double energy_sum = 0.0;
+      magneto::LatticeType lattice(4, std::vector<char>(4));
+      for (unsigned int state = 0; state < (1u << 16); ++state) {
+         for (unsigned int site = 0; site < 16; ++site)
+            lattice[site / 4][site % 4] = (state >> site) & 1 ? 1 : -1;
+         const double E = get_stencil_energy(lattice, geometry);
+         const double weight = std::exp(-16.0 * E / T);
+         weight_sum += weight;
+         energy_sum += weight * E;
+      }
+      const double exact_energy = energy_sum / weight_sum;
+
+      magneto::RandomStreams streams(4, 4);
+      std::vector<std::unique_ptr<magneto::LatticeAlgorithm>> algorithms;
+      algorithms.emplace_back(magneto::get_stencil_algorithm<magneto::StencilMetropolis>(geometry.lattice, 1, geometry.J2, T, streams));
+      algorithms.emplace_back(magneto::get_stencil_algorithm<magneto::StencilSW>(geometry.lattice, 1, geometry.J2, T, streams));
+      for (const std::unique_ptr<magneto::LatticeAlgorithm>& algorithm : algorithms) {
+         magneto::LatticeType state(4, std::vector<char>(4, 1));
+         double energy = 0.0;
+         for (unsigned int sweep = 0; sweep < 20200; ++sweep) {
+            algorithm->run(state);
+            if (sweep >= 200)
+               energy += get_stencil_energy(state, geometry) / 20000.0;
+         }
+         EXPECT_NEAR(energy, exact_energy, 0.04) << "geometry " << static_cast<int>(geometry.lattice);
+      }
+   }
+}
+
+
+TEST(Boundaries, EnergyWithGhostSpins) {
+   // Fixed x: +1 ghosts left and right. Fixed opposite y: +1 ghosts above, -1 below.
+   magneto::Geometry geometry;
+   geometry.boundary_x = magneto::Boundary::Fixed;
+   geometry.boundary_y = magneto::Boundary::FixedOpposite;
+   const magneto::LatticeType up(3, std::vector<char>(3, 1));
+   const magneto::LatticeType down(3, std::vector<char>(3, -1));
+
+   // 12 inner bonds, plus 6 x ghosts and 3 - 3 y ghosts
+   EXPECT_EQ(magneto::get_boundary_energy_sum(up, geometry), 18);
+   EXPECT_EQ(magneto::get_boundary_energy_sum(down, geometry), 6);
+}
+
+
+TEST(Boundaries, MixedCornersMatchExactEnergy) {
+   // The lower corners have a +1 and a -1 ghost, whose bonds must pin clusters separately
+   magneto::Geometry geometry;
+   geometry.boundary_x = magneto::Boundary::Fixed;
+   geometry.boundary_y = magneto::Boundary::FixedOpposite;
+   constexpr double T = 2.0;
+   const double exact_energy = get_exact_3x3_energy(T, geometry);
+   magneto::RandomStreams streams(3, 3);
+   std::vector<std::unique_ptr<magneto::LatticeAlgorithm>> algorithms;
+   algorithms.emplace_back(std::make_unique<magneto::BoundarySW>(1, T, geometry, streams));
+   algorithms.emplace_back(std::make_unique<magneto::BoundaryMetropolis>(1, T, geometry, streams));
+   for (const std::unique_ptr<magneto::LatticeAlgorithm>& algorithm : algorithms) {
+      magneto::LatticeType lattice(3, std::vector<char>(3, 1));
+      double energy = 0.0;
+      for (unsigned int sweep = 0; sweep < 40200; ++sweep) {
+         algorithm->run(lattice);
+         if (sweep >= 200)
+            energy -= magneto::get_boundary_energy_sum(lattice, geometry) / (9.0 * 40000.0);
+      }
+      EXPECT_NEAR(energy, exact_energy, 0.02);
+   }
+}
+
+
+TEST(Boundaries, TwistedBoundariesMatchExactEnergy) {
+   // Bond sums written out independently of get_boundary_energy_sum: helical or antiperiodic
+   // in x, periodic in y
+   const auto get_bond_sum = [](const magneto::LatticeType& lattice, const magneto::Boundary boundary_x) {
+      const int Ly = static_cast<int>(lattice.size());
+      const int Lx = static_cast<int>(lattice[0].size());
+      int sum = 0;
+      for (int i = 0; i < Ly; ++i) {
+         for (int j = 0; j < Lx; ++j) {
+            int right = 0;
+            if (j + 1 < Lx)
+               right = lattice[i][j + 1];
+            else if (boundary_x == magneto::Boundary::Helical)
+               right = lattice[(i + 1) % Ly][0];
+            else
+               right = -lattice[i][0];
+            sum += lattice[i][j] * (right + lattice[(i + 1) % Ly][j]);
+         }
+      }
+      return sum;
+   };
+
+   constexpr double T = 2.0;
+   for (const magneto::Boundary boundary_x : { magneto::Boundary::Helical, magneto::Boundary::Antiperiodic }) {
+      magneto::Geometry geometry;
+      geometry.boundary_x = boundary_x;
+      double weight_sum = 0.0;
+      double energy_sum = 0.0;
+      magneto::LatticeType lattice(3, std::vector<char>(3));
+      for (unsigned int state = 0; state < (1u << 9); ++state) {
+         for (unsigned int site = 0; site < 9; ++site)
+            lattice[site / 3][site % 3] = (state >> site) & 1 ? 1 : -1;
+         const int bond_sum = get_bond_sum(lattice, boundary_x);
+         ASSERT_EQ(magneto::get_boundary_energy_sum(lattice, geometry), bond_sum) << "state " << state;
+         const double weight = std::exp(bond_sum / T);
+         weight_sum += weight;
+         energy_sum -= weight * bond_sum / 9.0;
+      }
+      const double exact_energy = energy_sum / weight_sum;
+
+      magneto::RandomStreams streams(3, 3);
+      std::vector<std::unique_ptr<magneto::LatticeAlgorithm>> algorithms;
+      algorithms.emplace_back(std::make_unique<magneto::BoundarySW>(1, T, geometry, streams));
+      algorithms.emplace_back(std::make_unique<magneto::BoundaryMetropolis>(1, T, geometry, streams));
+      for (const std::unique_ptr<magneto::LatticeAlgorithm>& algorithm : algorithms) {
+         magneto::LatticeType state(3, std::vector<char>(3, 1));
+         double energy = 0.0;
+         for (unsigned int sweep = 0; sweep < 40200; ++sweep) {
+            algorithm->run(state);
+            if (sweep >= 200)
+               energy -= get_bond_sum(state, boundary_x) / (9.0 * 40000.0);
+         }
+         EXPECT_NEAR(energy, exact_energy, 0.02) << "boundary " << static_cast<int>(boundary_x);
+      }
+   }
+}
+
+
+TEST(Boundaries, SetTemperatureMatchesExactEnergy) {
+   // Built hot and cooled down through set_temperature(), as an annealing protocol does
+   magneto::Geometry geometry;
+   geometry.boundary_x = magneto::Boundary::Open;
+   geometry.boundary_y = magneto::Boundary::Fixed;
+   constexpr double T = 1.5;
+   const double exact_energy = get_exact_3x3_energy(T, geometry);
+   magneto::RandomStreams streams(3, 3);
+   std::vector<std::unique_ptr<magneto::LatticeAlgorithm>> algorithms;
+   algorithms.emplace_back(std::make_unique<magneto::BoundarySW>(1, 10.0, geometry, streams));
+   algorithms.emplace_back(std::make_unique<magneto::BoundaryMetropolis>(1, 10.0, geometry, streams));
+   for (const std::unique_ptr<magneto::LatticeAlgorithm>& algorithm : algorithms) {
+      ASSERT_TRUE(algorithm->set_temperature(T));
+      magneto::LatticeType lattice(3, std::vector<char>(3, 1));
+      double energy = 0.0;
+      for (unsigned int sweep = 0; sweep < 20200; ++sweep) {
+         algorithm->run(lattice);
+         if (sweep >= 200)
+            energy -= magneto::get_boundary_energy_sum(lattice, geometry) / (9.0 * 20000.0);
+      }
+      EXPECT_NEAR(energy, exact_energy, 0.02);
+   }
+}
@@ -0,0 +1,101 @@
+#include "BatchedMetropolis.h"
+#include "random_buffers.h"
+
+#include <cmath>
+
+
+namespace {
+
+   std::vector<double> get_acceptance_probabilities(const int J, const std::vector<double>& temps, const int dE_over_J) {
+      std::vector<double> probabilities;
+      probabilities.reserve(temps.size());
+      for (const double T : temps)
+         probabilities.emplace_back(std::exp(-dE_over_J * std::abs(J) / T));
+      return probabilities;
+   }
+
+} // namespace {}
+
+
+magneto::BatchedMetropolis::BatchedMetropolis(
+   const int J, const std::vector<double>& temps, const LatticeType& initial_state, const int max_rng_threads /*= 2*/
+)
+   : m_batch_size(temps.size())
+   , m_Lx(get_dimensions_of_lattice(initial_state).first)
+   , m_Ly(get_dimensions_of_lattice(initial_state).second)
+   , m_lattice_index_buffer(LatticeIndexGetter(m_Lx * m_Ly, m_Lx, m_Ly), max_rng_threads)
+   , m_random_buffer(RandomBufferGetter(m_Lx * m_Ly * m_batch_size), max_rng_threads)
+   , m_p4(get_acceptance_probabilities(J, temps, 4))
+   , m_p8(get_acceptance_probabilities(J, temps, 8))
+   , m_J_sign(J < 0 ? -1 : 1)
+{
+   m_spins.reserve(m_Lx * m_Ly * m_batch_size);
+   for (unsigned int i = 0; i < m_Ly; ++i) {
+      for (unsigned int j = 0; j < m_Lx; ++j)
+         m_spins.insert(std::end(m_spins), m_batch_size, initial_state[i][j]);
+   }
+}
+
+
+void magneto::BatchedMetropolis::run() {
+   const size_t B = m_batch_size;
+   const IndexPairVector& indices = m_lattice_index_buffer.get_buffer();
+   const std::vector<double>& randoms = m_random_buffer.get_buffer();
+   for (size_t step = 0; step < indices.size(); ++step) {
+      // Neighbour offsets are computed once for the whole batch
+      const auto [i, j] = indices[step];
+      char* s = &m_spins[(i * m_Lx + j) * B];
+      const char* right = &m_spins[(i * m_Lx + (j + 1) % m_Lx) * B];
+      const char* left = &m_spins[(i * m_Lx + (j - 1 + m_Lx) % m_Lx) * B];
+      const char* down = &m_spins[(((i + 1) % m_Ly) * m_Lx + j) * B];
+      const char* up = &m_spins[(((i - 1 + m_Ly) % m_Ly) * m_Lx + j) * B];
+      const double* r = &randoms[step * B];
+      for (size_t b = 0; b < B; ++b) {
+         // dE = 2|J|k
+         const int k = m_J_sign * s[b] * (right[b] + left[b] + down[b] + up[b]);
+         const double p = k == 4 ? m_p8[b] : m_p4[b];
+         const bool flip = k <= 0 || r[b] < p;
+         s[b] = flip ? -s[b] : s[b];
+      }
+   }
+
+   m_random_buffer.refill();
+   m_lattice_index_buffer.refill();
+}
+
+
+std::vector<magneto::PhysicalMeasurement> magneto::BatchedMetropolis::get_measurements() const {
+   const size_t B = m_batch_size;
+   std::vector<long long> E(B, 0);
+   std::vector<long long> m(B, 0);
+   for (unsigned int i = 0; i < m_Ly; ++i) {
+      for (unsigned int j = 0; j < m_Lx; ++j) {
+         const char* s = &m_spins[(i * m_Lx + j) * B];
+         const char* right = &m_spins[(i * m_Lx + (j + 1) % m_Lx) * B];
+         const char* down = &m_spins[(((i + 1) % m_Ly) * m_Lx + j) * B];
+         for (size_t b = 0; b < B; ++b) {
+            E[b] -= s[b] * (right[b] + down[b]);
+            m[b] += s[b];
+         }
+      }
+   }
+
+   // Same normalization as get_E() and get_m_abs()
+   const double N = 1.0 * m_Lx * m_Ly;
+   std::vector<PhysicalMeasurement> measurements(B);
+   for (size_t b = 0; b < B; ++b) {
+      measurements[b].energy = E[b] / N;
+      measurements[b].magnetization = std::abs(m[b]) / N;
+   }
+   return measurements;
+}
+
+
+magneto::LatticeType magneto::BatchedMetropolis::get_lattice(const size_t lattice_index) const {
+   LatticeType lattice(m_Ly, std::vector<char>(m_Lx));
+   for (unsigned int i = 0; i < m_Ly; ++i) {
+      for (unsigned int j = 0; j < m_Lx; ++j)
+         lattice[i][j] = m_spins[(i * m_Lx + j) * m_batch_size + lattice_index];
+   }
+   return lattice;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "types.h"
+#include "IsingSystem.h"
+#include "BufferStructure.h"
+
+
+namespace magneto {
+
+   /// <summary>Metropolis algorithm for a batch of small independent lattices in lockstep.
+   /// <para>The spins are stored as structure of arrays: all lattices' spins of one site are
+   /// contiguous. Every step visits the same site in all lattices, so the index stream and
+   /// neighbour computation is shared and the inner loop over the batch vectorizes. Each
+   /// lattice has its own temperature and its own acceptance random numbers.</para>
+   /// </summary>
+   class BatchedMetropolis {
+   public:
+      BatchedMetropolis(const int J, const std::vector<double>& temps, const LatticeType& initial_state, const int max_rng_threads = 2);
+
+      /// <summary>One Metropolis sweep over all lattices</summary>
+      void run();
+
+      /// <summary>Energy and absolute magnetization of every lattice in the batch</summary>
+      [[nodiscard]] std::vector<PhysicalMeasurement> get_measurements() const;
+
+      /// <summary>Extracts the spin state of a single lattice</summary>
+      [[nodiscard]] LatticeType get_lattice(const size_t lattice_index) const;
+
+   private:
+      size_t m_batch_size;
+      unsigned int m_Lx;
+      unsigned int m_Ly;
+      BufferStructure<IndexPairVector> m_lattice_index_buffer;
+      BufferStructure<std::vector<double>> m_random_buffer;
+      std::vector<char> m_spins;
+
+      // Acceptance probabilities for dE=4|J| and dE=8|J|, per lattice
+      std::vector<double> m_p4;
+      std::vector<double> m_p8;
+      int m_J_sign;
+   };
+
+}
@@ -0,0 +1,282 @@
+#include "BoundaryAlgorithms.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+   int get_wrapped(const int x, const int length) {
+      return (x % length + length) % length;
+   }
+
+
+   /// <summary>Neighbour at (i+di, j+dj) for one step along one axis. Inside the lattice that's
+   /// the plain neighbour, outside the boundary of the axis decides. ghost is set for fixed
+   /// boundaries.</summary>
+   magneto::EdgeNeighbour get_neighbour(
+      const int i, const int j, const int di, const int dj, const int Lx, const int Ly,
+      const magneto::Geometry& geometry, int& ghost
+   ) {
+      ghost = 0;
+      const int ni = i + di;
+      const int nj = j + dj;
+      if (ni >= 0 && ni < Ly && nj >= 0 && nj < Lx)
+         return { ni, nj, 1 };
+
+      // Crossing is +1 for the high edge and -1 for the low edge of the crossed axis
+      const bool crosses_x = nj < 0 || nj >= Lx;
+      const int crossing = crosses_x ? dj : di;
+      const magneto::Boundary boundary = crosses_x ? geometry.boundary_x : geometry.boundary_y;
+      if (boundary == magneto::Boundary::Periodic)
+         return { get_wrapped(ni, Ly), get_wrapped(nj, Lx), 1 };
+      if (boundary == magneto::Boundary::Antiperiodic)
+         return { get_wrapped(ni, Ly), get_wrapped(nj, Lx), -1 };
+      if (boundary == magneto::Boundary::Helical) {
+         if (crosses_x)
+            return { get_wrapped(ni + crossing, Ly), get_wrapped(nj, Lx), 1 };
+         return { get_wrapped(ni, Ly), get_wrapped(nj + crossing, Lx), 1 };
+      }
+      if (boundary == magneto::Boundary::Fixed)
+         ghost = 1;
+      else if (boundary == magneto::Boundary::FixedOpposite)
+         ghost = crossing < 0 ? 1 : -1;
+      return { i, j, 0 };
+   }
+
+
+   std::array<double, 9> get_boundary_acceptance(const int J, const double T) {
+      std::array<double, 9> acceptance;
+      for (int k = -4; k <= 4; ++k)
+         acceptance[k + 4] = std::min(1.0, std::exp(-2.0 * std::abs(J) * k / T));
+      return acceptance;
+   }
+
+
+   int get_edge_neighbour_sum(const magneto::LatticeType& lattice, const magneto::EdgeSite& site) {
+      int sum = site.ghost_sum;
+      for (const magneto::EdgeNeighbour& neighbour : site.neighbours)
+         sum += neighbour.factor * lattice[neighbour.i][neighbour.j];
+      return sum;
+   }
+
+} // namespace {}
+
+
+std::vector<magneto::EdgeSite> magneto::get_edge_sites(const int Lx, const int Ly, const Geometry& geometry) {
+   constexpr std::array<std::pair<int, int>, 4> directions{ { {0, 1}, {0, -1}, {1, 0}, {-1, 0} } };
+   std::vector<EdgeSite> sites;
+   for (int i = 0; i < Ly; ++i) {
+      for (int j = 0; j < Lx; ++j) {
+         if (i > 0 && i < Ly - 1 && j > 0 && j < Lx - 1)
+            continue;
+         EdgeSite site{ i, j, {}, 0, 0, 0 };
+         for (size_t d = 0; d < directions.size(); ++d) {
+            int ghost = 0;
+            site.neighbours[d] = get_neighbour(i, j, directions[d].first, directions[d].second, Lx, Ly, geometry, ghost);
+            site.ghost_sum += ghost;
+            site.plus_ghosts += ghost > 0;
+            site.minus_ghosts += ghost < 0;
+         }
+         sites.emplace_back(site);
+      }
+   }
+   return sites;
+}
+
+
+magneto::BoundaryMetropolis::BoundaryMetropolis(const int J, const double T, const Geometry& geometry, RandomStreams& streams)
+   : m_random_buffer(streams.get_uniforms())
+   , m_acceptance(get_boundary_acceptance(J, T))
+   , m_J_sign(J < 0 ? -1 : 1)
+   , m_J(J)
+{
+   for (const EdgeSite& site : get_edge_sites(streams.get_Lx(), streams.get_Ly(), geometry))
+      m_edge_sites[(site.i + site.j) & 1].emplace_back(site);
+}
+
+
+bool magneto::BoundaryMetropolis::set_temperature(const double T) {
+   m_acceptance = get_boundary_acceptance(m_J, T);
+   return true;
+}
+
+
+void magneto::BoundaryMetropolis::run(LatticeType& lattice) {
+   const auto [Lx_u, Ly_u] = get_dimensions_of_lattice(lattice);
+   const int Lx = static_cast<int>(Lx_u);
+   const int Ly = static_cast<int>(Ly_u);
+   const std::vector<double>& randoms = m_random_buffer->get_buffer();
+   for (int colour = 0; colour < 2; ++colour) {
+      for (int i = 1; i < Ly - 1; ++i) {
+         char* row = lattice[i].data();
+         const char* up = lattice[i - 1].data();
+         const char* down = lattice[i + 1].data();
+         const double* row_randoms = &randoms[i * Lx];
+         for (int j = 1 + ((i + 1 + colour) & 1); j < Lx - 1; j += 2) {
+            const int k = m_J_sign * row[j] * (row[j - 1] + row[j + 1] + up[j] + down[j]);
+            if (row_randoms[j] < m_acceptance[k + 4])
+               row[j] = -row[j];
+         }
+      }
+      for (const EdgeSite& site : m_edge_sites[colour]) {
+         char& spin = lattice[site.i][site.j];
+         const int k = m_J_sign * spin * get_edge_neighbour_sum(lattice, site);
+         if (randoms[site.i * Lx + site.j] < m_acceptance[k + 4])
+            spin = -spin;
+      }
+   }
+   m_random_buffer->refill();
+}
+
+
+magneto::BoundarySW::BoundarySW(const int J, const double T, const Geometry& geometry, RandomStreams& streams)
+   : m_random_buffer(streams.get_cluster_uniforms())
+   , m_edge_sites(get_edge_sites(streams.get_Lx(), streams.get_Ly(), geometry))
+   , m_edge_index(streams.get_Lx() * streams.get_Ly(), -1)
+   , m_freeze_probability(1.0 - std::exp(-2.0 * std::abs(J) / T))
+   , m_J(J)
+{
+   for (size_t e = 0; e < m_edge_sites.size(); ++e)
+      m_edge_index[m_edge_sites[e].i * streams.get_Lx() + m_edge_sites[e].j] = static_cast<int>(e);
+}
+
+
+bool magneto::BoundarySW::set_temperature(const double T) {
+   m_freeze_probability = 1.0 - std::exp(-2.0 * std::abs(m_J) / T);
+   return true;
+}
+
+
+void magneto::BoundarySW::run(LatticeType& lattice) {
+   const auto [Lx_u, Ly_u] = get_dimensions_of_lattice(lattice);
+   const int Lx = static_cast<int>(Lx_u);
+   const int Ly = static_cast<int>(Ly_u);
+   const auto is_frozen = [&](const int J_s_s, const double random) {
+      return J_s_s > 0 && random < m_freeze_probability;
+   };
+
+   // East bonds: plain up to the last column, which crosses the boundary
+   m_scratch.start_run(Lx * Ly);
+   const std::vector<double>& east_randoms = m_random_buffer->get_buffer();
+   for (int i = 0; i < Ly; ++i) {
+      const char* row = lattice[i].data();
+      for (int j = 0; j < Lx - 1; ++j)
+         m_scratch.set_frozen(i * Lx + j, is_frozen(m_J * row[j] * row[j + 1], east_randoms[i * Lx + j]));
+      const EdgeNeighbour& right = m_edge_sites[m_edge_index[i * Lx + Lx - 1]].neighbours[0];
+      m_scratch.set_frozen(i * Lx + Lx - 1, is_frozen(
+         m_J * right.factor * row[Lx - 1] * lattice[right.i][right.j], east_randoms[i * Lx + Lx - 1]
+      ));
+   }
+   m_random_buffer->refill();
+
+   // South bonds: plain up to the last row
+   const std::vector<double>& south_randoms = m_random_buffer->get_buffer();
+   for (int i = 0; i < Ly - 1; ++i) {
+      const char* row = lattice[i].data();
+      const char* row_down = lattice[i + 1].data();
+      for (int j = 0; j < Lx; ++j)
+         m_scratch.add_frozen(i * Lx + j, is_frozen(m_J * row[j] * row_down[j], south_randoms[i * Lx + j]) << 1);
+   }
+   for (int j = 0; j < Lx; ++j) {
+      const EdgeNeighbour& down = m_edge_sites[m_edge_index[(Ly - 1) * Lx + j]].neighbours[2];
+      m_scratch.add_frozen((Ly - 1) * Lx + j, is_frozen(
+         m_J * down.factor * lattice[Ly - 1][j] * lattice[down.i][down.j], south_randoms[(Ly - 1) * Lx + j]
+      ) << 1);
+   }
+   m_random_buffer->refill();
+
+   // A site is pinned if any of its satisfied ghost bonds freezes, every one of them draws on
+   // its own. Ghosts of the other sign don't cancel them.
+   const std::vector<double>* ghost_randoms = &m_random_buffer->get_buffer();
+   size_t ghost_position = 0;
+   for (const EdgeSite& site : m_edge_sites) {
+      const int J_s = m_J * lattice[site.i][site.j];
+      const int satisfied = J_s > 0 ? site.plus_ghosts : (J_s < 0 ? site.minus_ghosts : 0);
+      bool pinned = false;
+      for (int bond = 0; bond < satisfied; ++bond) {
+         if (ghost_position == ghost_randoms->size()) {
+            m_random_buffer->refill();
+            ghost_randoms = &m_random_buffer->get_buffer();
+            ghost_position = 0;
+         }
+         pinned = (*ghost_randoms)[ghost_position++] < m_freeze_probability || pinned;
+      }
+      m_scratch.add_frozen(site.i * Lx + site.j, pinned << 2);
+   }
+   m_random_buffer->refill();
+
+   // Grow the clusters, then flip the ones that aren't pinned
+   const std::vector<double>& flip_randoms = m_random_buffer->get_buffer();
+   for (int start = 0; start < Lx * Ly; ++start) {
+      if (m_scratch.is_discovered(start))
+         continue;
+      bool pinned = false;
+      m_scratch.discover(start);
+      m_cluster.clear();
+      while (m_scratch.has_next()) {
+         const int site = m_scratch.pop();
+         m_cluster.emplace_back(site);
+         pinned = pinned || m_scratch.is_frozen(site, 2);
+         const auto visit = [&](const int neighbour, const bool is_bond_frozen) {
+            if (is_bond_frozen && !m_scratch.is_discovered(neighbour))
+               m_scratch.discover(neighbour);
+         };
+         const int edge_index = m_edge_index[site];
+         if (edge_index < 0) {
+            visit(site + 1, m_scratch.is_frozen(site, 0));
+            visit(site - 1, m_scratch.is_frozen(site - 1, 0));
+            visit(site + Lx, m_scratch.is_frozen(site, 1));
+            visit(site - Lx, m_scratch.is_frozen(site - Lx, 1));
+            continue;
+         }
+         const std::array<EdgeNeighbour, 4>& neighbours = m_edge_sites[edge_index].neighbours;
+         const auto index_of = [&](const EdgeNeighbour& neighbour) {return neighbour.i * Lx + neighbour.j; };
+         if (neighbours[0].factor != 0)
+            visit(index_of(neighbours[0]), m_scratch.is_frozen(site, 0));
+         if (neighbours[1].factor != 0)
+            visit(index_of(neighbours[1]), m_scratch.is_frozen(index_of(neighbours[1]), 0));
+         if (neighbours[2].factor != 0)
+            visit(index_of(neighbours[2]), m_scratch.is_frozen(site, 1));
+         if (neighbours[3].factor != 0)
+            visit(index_of(neighbours[3]), m_scratch.is_frozen(index_of(neighbours[3]), 1));
+      }
+      if (!pinned && flip_randoms[start] < 0.5) {
+         for (const int site : m_cluster)
+            lattice[site / Lx][site % Lx] = -lattice[site / Lx][site % Lx];
+      }
+   }
+   m_random_buffer->refill();
+}
+
+
+long long magneto::get_boundary_energy_sum(const LatticeType& grid, const Geometry& geometry) {
+   const auto [Lx_u, Ly_u] = get_dimensions_of_lattice(grid);
+   const int Lx = static_cast<int>(Lx_u);
+   const int Ly = static_cast<int>(Ly_u);
+   long long sum = 0;
+   for (int i = 0; i < Ly - 1; ++i) {
+      for (int j = 0; j < Lx - 1; ++j)
+         sum += grid[i][j] * (grid[i][j + 1] + grid[i + 1][j]);
+   }
+
+   // Bonds of the last row and column go right and down, the ghost bonds of every edge site
+   // belong to it
+   for (const EdgeSite& site : get_edge_sites(Lx, Ly, geometry)) {
+      const int spin = grid[site.i][site.j];
+      sum += spin * site.ghost_sum;
+      if (site.i < Ly - 1 && site.j < Lx - 1)
+         continue;
+      const EdgeNeighbour& right = site.neighbours[0];
+      const EdgeNeighbour& down = site.neighbours[2];
+      if (site.j == Lx - 1)
+         sum += right.factor * spin * grid[right.i][right.j];
+      else
+         sum += spin * grid[site.i][site.j + 1];
+      if (site.i == Ly - 1)
+         sum += down.factor * spin * grid[down.i][down.j];
+      else
+         sum += spin * grid[site.i + 1][site.j];
+   }
+   return sum;
+}
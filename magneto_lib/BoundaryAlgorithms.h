@@ -0,0 +1,89 @@
+#pragma once
+
+#include "LatticeAlgorithms.h"
+
+
+namespace magneto {
+
+   /// <summary>Neighbour of an edge site across the boundary. The spin counts with factor, which
+   /// is 0 for open and fixed boundaries and -1 for antiperiodic ones.</summary>
+   struct EdgeNeighbour {
+      int i;
+      int j;
+      int factor;
+   };
+
+   /// <summary>Site on the edge of the lattice with its right, left, down and up neighbours and
+   /// the ghost spins of fixed boundaries next to it. Corners can have ghosts of both signs.</summary>
+   struct EdgeSite {
+      int i;
+      int j;
+      std::array<EdgeNeighbour, 4> neighbours;
+      int ghost_sum;
+      int plus_ghosts;
+      int minus_ghosts;
+   };
+
+   /// <summary>All sites in the first or last row or column, row-major</summary>
+   [[nodiscard]] std::vector<EdgeSite> get_edge_sites(const int Lx, const int Ly, const Geometry& geometry);
+
+
+   /// <summary>Metropolis on the square lattice with the boundary conditions of the geometry.
+   /// <para>Sweeps are checkerboard ordered. The interior of every sublattice runs without any
+   /// boundary handling, the edge sites follow with precomputed neighbours.</para>
+   /// </summary>
+   class CLASS_DECLSPEC BoundaryMetropolis : public LatticeAlgorithm {
+   public:
+      BoundaryMetropolis(const int J, const double T, const Geometry& geometry, RandomStreams& streams);
+      virtual void run(LatticeType& lattice);
+
+      /// <summary>Only rebuilds the acceptance table</summary>
+      virtual bool set_temperature(const double T);
+
+   private:
+      std::shared_ptr<UniformStream> m_random_buffer;
+
+      // Edge sites of both sublattices
+      std::array<std::vector<EdgeSite>, 2> m_edge_sites;
+
+      // min(1, exp(-2|J|k/T)) by k+4, with k = sign(J)*s*(neighbour sum)
+      std::array<double, 9> m_acceptance;
+      int m_J_sign;
+      int m_J;
+   };
+
+
+   /// <summary>Swendsen-Wang on the square lattice with the boundary conditions of the geometry.
+   /// Bonds to the ghost spins of fixed boundaries pin their cluster, pinned clusters never
+   /// flip.</summary>
+   class CLASS_DECLSPEC BoundarySW : public LatticeAlgorithm {
+   public:
+      // One run takes four buffers: east bonds, south bonds, ghost bonds and cluster flips. Tiny
+      // lattices with more ghost bonds than sites read on into further buffers.
+      BoundarySW(const int J, const double T, const Geometry& geometry, RandomStreams& streams);
+      virtual void run(LatticeType& lattice);
+
+      /// <summary>Only updates the freeze probability</summary>
+      virtual bool set_temperature(const double T);
+
+   private:
+      std::shared_ptr<UniformStream> m_random_buffer;
+      std::vector<EdgeSite> m_edge_sites;
+
+      // Index into m_edge_sites per site, -1 for interior sites
+      std::vector<int> m_edge_index;
+      double m_freeze_probability;
+      int m_J;
+
+      // Scratch space, kept between runs. Bit 0 freezes the east bond of a site, bit 1 the south
+      // bond, bit 2 pins the site to the ghost spins.
+      ClusterScratch m_scratch;
+      std::vector<int> m_cluster;
+   };
+
+
+   /// <summary>Sum over all bonds of s_i s_j with the boundary conditions of the geometry,
+   /// including the bonds to fixed ghost spins</summary>
+   [[nodiscard]] CLASS_DECLSPEC long long get_boundary_energy_sum(const LatticeType& grid, const Geometry& geometry);
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+
+namespace magneto {
+
+   /// <summary>Scratch space of a cluster step, owned by the algorithm and kept between runs.
+   /// <para>Every site has a byte of frozen bond bits, their meaning is up to the algorithm. A site
+   /// is discovered if its mark equals the epoch of the current run, so starting a run clears
+   /// nothing. The stack only grows until it fits the largest cluster.</para>
+   /// </summary>
+   class ClusterScratch {
+   public:
+      /// <summary>Sizes the scratch space if needed and starts a new epoch</summary>
+      void start_run(const size_t site_count) {
+         if (m_marks.size() != site_count) {
+            m_frozen.assign(site_count, 0);
+            m_marks.assign(site_count, 0);
+            m_epoch = 0;
+         }
+         if (++m_epoch == 0) {
+            std::fill(std::begin(m_marks), std::end(m_marks), 0);
+            m_epoch = 1;
+         }
+      }
+
+      void set_frozen(const size_t site, const unsigned char bonds) { m_frozen[site] = bonds; }
+      void add_frozen(const size_t site, const unsigned char bonds) { m_frozen[site] |= bonds; }
+      unsigned char get_frozen(const size_t site) const { return m_frozen[site]; }
+      bool is_frozen(const size_t site, const int bond) const { return (m_frozen[site] >> bond) & 1; }
+
+      bool is_discovered(const size_t site) const { return m_marks[site] == m_epoch; }
+
+      /// <summary>Marks the site as discovered and pushes it on the stack</summary>
+      void discover(const int site) {
+         m_marks[site] = m_epoch;
+         m_stack.emplace_back(site);
+      }
+
+      bool has_next() const { return !m_stack.empty(); }
+
+      int pop() {
+         const int site = m_stack.back();
+         m_stack.pop_back();
+         return site;
+      }
+
+   private:
+      std::vector<unsigned char> m_frozen;
+      std::vector<unsigned int> m_marks;
+      unsigned int m_epoch = 0;
+      std::vector<int> m_stack;
+   };
+
+}
@@ -0,0 +1,278 @@
+#include "FlatLattice.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <numeric>
+
+
+namespace {
+
+   template<int D>
+   int get_site_count(const std::array<int, D>& extents) {
+      return std::accumulate(std::cbegin(extents), std::cend(extents), 1, std::multiplies<int>());
+   }
+
+
+   template<int D>
+   std::array<int, D> get_strides(const std::array<int, D>& extents) {
+      std::array<int, D> strides;
+      int stride = 1;
+      for (int a = 0; a < D; ++a) {
+         strides[a] = stride;
+         stride *= extents[a];
+      }
+      return strides;
+   }
+
+
+   template<int D>
+   std::array<int, D> get_wraps(const std::array<int, D>& extents, const std::array<int, D>& strides) {
+      std::array<int, D> wraps;
+      for (int a = 0; a < D; ++a)
+         wraps[a] = (extents[a] - 1) * strides[a];
+      return wraps;
+   }
+
+
+   unsigned int get_time_seed() {
+      return static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count());
+   }
+
+
+   /// <summary>Generator number stream of the seed</summary>
+   std::mt19937 get_stream_rng(const unsigned int seed, const unsigned int stream) {
+      std::seed_seq sequence{ seed, stream };
+      return std::mt19937(sequence);
+   }
+
+
+   /// <summary>One generator per plane, seeded from the time and the plane</summary>
+   std::vector<std::mt19937> get_plane_rngs(const int plane_count) {
+      const unsigned int seed = get_time_seed();
+      std::vector<std::mt19937> rngs;
+      for (int plane = 0; plane < plane_count; ++plane)
+         rngs.emplace_back(get_stream_rng(seed, static_cast<unsigned int>(plane)));
+      return rngs;
+   }
+
+
+   std::vector<int> get_plane_indices(const int plane_count) {
+      std::vector<int> planes(plane_count);
+      std::iota(std::begin(planes), std::end(planes), 0);
+      return planes;
+   }
+
+
+   /// <summary>Advances the coordinates of a site to the next site, x fastest</summary>
+   template<int D>
+   void advance_coordinates(std::array<int, D>& coordinates, const std::array<int, D>& extents) {
+      for (int a = 0; a < D; ++a) {
+         if (++coordinates[a] < extents[a])
+            return;
+         coordinates[a] = 0;
+      }
+   }
+
+
+   /// <summary>Bit 2a for sites on the high edge of axis a, bit 2a+1 for the low edge</summary>
+   template<int D>
+   std::vector<unsigned char> get_edge_masks(const std::array<int, D>& extents) {
+      std::vector<unsigned char> masks(get_site_count<D>(extents));
+      std::array<int, D> coordinates{};
+      for (unsigned char& mask : masks) {
+         for (int a = 0; a < D; ++a)
+            mask |= (coordinates[a] + 1 == extents[a]) << (2 * a) | (coordinates[a] == 0) << (2 * a + 1);
+         advance_coordinates<D>(coordinates, extents);
+      }
+      return masks;
+   }
+
+} // namespace {}
+
+
+template<int D>
+magneto::FlatLattice<D> magneto::get_randomized_flat_lattice(const std::array<int, D>& extents) {
+   std::mt19937_64 rng(std::chrono::system_clock::now().time_since_epoch().count());
+   std::uniform_int_distribution<int> dist(0, 1);
+   FlatLattice<D> lattice{ extents, std::vector<char>(get_site_count<D>(extents)) };
+   for (char& spin : lattice.spins)
+      spin = static_cast<char>(dist(rng) * 2 - 1);
+   return lattice;
+}
+
+
+template<int D>
+magneto::PhysicalMeasurement magneto::get_flat_measurement(const FlatLattice<D>& lattice) {
+   const std::array<int, D> strides = get_strides<D>(lattice.extents);
+   const std::array<int, D> wraps = get_wraps<D>(lattice.extents, strides);
+   const int plane_count = lattice.extents[D - 1];
+   const int plane_size = strides[D - 1];
+   const std::vector<int> planes = get_plane_indices(plane_count);
+
+   // Bond sum and magnetization of every plane, the bonds go in + direction
+   using Sums = std::pair<long long, long long>;
+   const auto plane_sums = [&](const int plane) {
+      long long bond_sum = 0;
+      long long magnetization = 0;
+      std::array<int, D> coordinates{};
+      coordinates[D - 1] = plane;
+      for (int site = plane * plane_size; site < (plane + 1) * plane_size; ++site) {
+         int neighbour_sum = 0;
+         for (int a = 0; a < D; ++a)
+            neighbour_sum += lattice.spins[coordinates[a] + 1 == lattice.extents[a] ? site - wraps[a] : site + strides[a]];
+         bond_sum += lattice.spins[site] * neighbour_sum;
+         magnetization += lattice.spins[site];
+         advance_coordinates<D>(coordinates, lattice.extents);
+      }
+      return Sums{ bond_sum, magnetization };
+   };
+   const auto add = [](const Sums& a, const Sums& b) {return Sums{ a.first + b.first, a.second + b.second }; };
+   const Sums sums = std::transform_reduce(
+      std::execution::par, std::cbegin(planes), std::cend(planes), Sums{ 0, 0 }, add, plane_sums
+   );
+
+   const double N = 1.0 * lattice.spins.size();
+   PhysicalMeasurement measurement;
+   measurement.energy = -sums.first / N;
+   measurement.magnetization = std::abs(sums.second) / N;
+   return measurement;
+}
+
+
+magneto::LatticeType magneto::get_lattice_slice(const FlatLattice<3>& lattice, const int z) {
+   const int Lx = lattice.extents[0];
+   const int Ly = lattice.extents[1];
+   LatticeType slice(Ly, std::vector<char>(Lx));
+   for (int i = 0; i < Ly; ++i) {
+      const char* line = &lattice.spins[(z * Ly + i) * Lx];
+      std::copy(line, line + Lx, std::begin(slice[i]));
+   }
+   return slice;
+}
+
+
+template<int D>
+magneto::FlatMetropolis<D>::FlatMetropolis(const int J, const double T, const std::array<int, D>& extents)
+   : m_J_sign(J < 0 ? -1 : 1)
+   , m_parallel(std::all_of(std::cbegin(extents), std::cend(extents), [](const int extent) {return extent % 2 == 0; }))
+   , m_plane_rngs(get_plane_rngs(extents[D - 1]))
+{
+   for (int k = -2 * D; k <= 2 * D; ++k)
+      m_acceptance[k + 2 * D] = std::min(1.0, std::exp(-2.0 * std::abs(J) * k / T));
+}
+
+
+template<int D>
+void magneto::FlatMetropolis<D>::run(FlatLattice<D>& lattice) {
+   const std::vector<int> planes = get_plane_indices(lattice.extents[D - 1]);
+   for (int colour = 0; colour < 2; ++colour) {
+      const auto sweep = [&](const int plane) {sweep_plane(lattice, plane, colour); };
+      if (m_parallel)
+         std::for_each(std::execution::par, std::cbegin(planes), std::cend(planes), sweep);
+      else
+         std::for_each(std::cbegin(planes), std::cend(planes), sweep);
+   }
+}
+
+
+template<int D>
+void magneto::FlatMetropolis<D>::sweep_plane(FlatLattice<D>& lattice, const int plane, const int colour) {
+   const int Lx = lattice.extents[0];
+   const int lines_per_plane = get_site_count<D>(lattice.extents) / (Lx * lattice.extents[D - 1]);
+   std::uniform_real_distribution<double> uniform(0.0, 1.0);
+   std::mt19937& rng = m_plane_rngs[plane];
+   for (int line = plane * lines_per_plane; line < (plane + 1) * lines_per_plane; ++line) {
+      // The lines next to this one along all axes but x, and the parity of the line
+      std::array<const char*, 2 * (D - 1)> neighbour_lines;
+      int rest = line;
+      int line_stride = 1;
+      int parity = 0;
+      for (int a = 1; a < D; ++a) {
+         const int extent = lattice.extents[a];
+         const int coordinate = rest % extent;
+         rest /= extent;
+         parity += coordinate;
+         const int next = coordinate + 1 == extent ? line - (extent - 1) * line_stride : line + line_stride;
+         const int previous = coordinate == 0 ? line + (extent - 1) * line_stride : line - line_stride;
+         neighbour_lines[2 * (a - 1)] = &lattice.spins[next * Lx];
+         neighbour_lines[2 * (a - 1) + 1] = &lattice.spins[previous * Lx];
+         line_stride *= extent;
+      }
+
+      char* spins = &lattice.spins[line * Lx];
+      for (int x = (colour + parity) & 1; x < Lx; x += 2) {
+         int neighbour_sum = spins[x == 0 ? Lx - 1 : x - 1] + spins[x + 1 == Lx ? 0 : x + 1];
+         for (const char* neighbour_line : neighbour_lines)
+            neighbour_sum += neighbour_line[x];
+         const int k = m_J_sign * spins[x] * neighbour_sum;
+         if (uniform(rng) < m_acceptance[k + 2 * D])
+            spins[x] = -spins[x];
+      }
+   }
+}
+
+
+template<int D>
+magneto::FlatSW<D>::FlatSW(const int J, const double T, const std::array<int, D>& extents)
+   : m_freeze_probability(1.0 - std::exp(-2.0 * std::abs(J) / T))
+   , m_J(J)
+   , m_plane_rngs(get_plane_rngs(extents[D - 1]))
+   , m_flip_rng(get_stream_rng(get_time_seed(), static_cast<unsigned int>(extents[D - 1])))
+   , m_strides(get_strides<D>(extents))
+   , m_wraps(get_wraps<D>(extents, m_strides))
+   , m_edge_masks(get_edge_masks<D>(extents))
+{ }
+
+
+template<int D>
+void magneto::FlatSW<D>::run(FlatLattice<D>& lattice) {
+   const int plane_size = m_strides[D - 1];
+   const std::vector<int> planes = get_plane_indices(lattice.extents[D - 1]);
+
+   // Freeze satisfied bonds, every plane writes its own sites
+   m_scratch.start_run(lattice.spins.size());
+   std::for_each(std::execution::par, std::cbegin(planes), std::cend(planes), [&](const int plane) {
+      std::uniform_real_distribution<double> uniform(0.0, 1.0);
+      std::mt19937& rng = m_plane_rngs[plane];
+      for (int site = plane * plane_size; site < (plane + 1) * plane_size; ++site) {
+         unsigned char frozen = 0;
+         for (int a = 0; a < D; ++a) {
+            const int neighbour = m_edge_masks[site] & (1 << (2 * a)) ? site - m_wraps[a] : site + m_strides[a];
+            if (m_J * lattice.spins[site] * lattice.spins[neighbour] > 0 && uniform(rng) < m_freeze_probability)
+               frozen |= 1 << a;
+         }
+         m_scratch.set_frozen(site, frozen);
+      }
+   });
+
+   // Grow and flip the clusters. Bonds are fixed, so flipping during the search is fine.
+   std::uniform_real_distribution<double> uniform(0.0, 1.0);
+   const int N = static_cast<int>(lattice.spins.size());
+   for (int start = 0; start < N; ++start) {
+      if (m_scratch.is_discovered(start))
+         continue;
+      const bool flip_cluster = uniform(m_flip_rng) < 0.5;
+      m_scratch.discover(start);
+      while (m_scratch.has_next()) {
+         const int site = m_scratch.pop();
+         for (int a = 0; a < D; ++a) {
+            const int next = m_edge_masks[site] & (1 << (2 * a)) ? site - m_wraps[a] : site + m_strides[a];
+            const int previous = m_edge_masks[site] & (2 << (2 * a)) ? site + m_wraps[a] : site - m_strides[a];
+            if (m_scratch.is_frozen(site, a) && !m_scratch.is_discovered(next))
+               m_scratch.discover(next);
+            if (m_scratch.is_frozen(previous, a) && !m_scratch.is_discovered(previous))
+               m_scratch.discover(previous);
+         }
+         if (flip_cluster)
+            lattice.spins[site] = -lattice.spins[site];
+      }
+   }
+}
+
+
+template CLASS_DECLSPEC magneto::FlatLattice<3> magneto::get_randomized_flat_lattice<3>(const std::array<int, 3>& extents);
+template CLASS_DECLSPEC magneto::PhysicalMeasurement magneto::get_flat_measurement<3>(const FlatLattice<3>& lattice);
+template class CLASS_DECLSPEC magneto::FlatMetropolis<3>;
+template class CLASS_DECLSPEC magneto::FlatSW<3>;
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "IsingSystem.h"
+#include "ClusterScratch.h"
+
+#include <array>
+#include <random>
+#include <vector>
+
+
+namespace magneto {
+
+   /// <summary>Periodic hypercubic lattice of D dimensions, stored flat with x varying fastest.
+   /// The last axis is split into planes, which are the unit of threading.</summary>
+   template<int D>
+   struct FlatLattice {
+      std::array<int, D> extents;
+      std::vector<char> spins;
+   };
+
+   template<int D>
+   [[nodiscard]] CLASS_DECLSPEC FlatLattice<D> get_randomized_flat_lattice(const std::array<int, D>& extents);
+
+   /// <summary>Energy per site and absolute magnetization per site, planes are reduced in
+   /// parallel</summary>
+   template<int D>
+   [[nodiscard]] CLASS_DECLSPEC PhysicalMeasurement get_flat_measurement(const FlatLattice<D>& lattice);
+
+   /// <summary>The z slice of a three-dimensional lattice</summary>
+   [[nodiscard]] CLASS_DECLSPEC LatticeType get_lattice_slice(const FlatLattice<3>& lattice, const int z);
+
+
+   template<int D>
+   class FlatLatticeAlgorithm {
+   public:
+      virtual ~FlatLatticeAlgorithm() = default;
+      virtual void run(FlatLattice<D>& lattice) = 0;
+   };
+
+
+   /// <summary>Checkerboard Metropolis on a flat lattice. Both sublattices are updated plane by
+   /// plane in parallel, every plane draws from its own generator so the result doesn't depend on
+   /// the threads. With an odd extent the checkerboard isn't bipartite and the planes run
+   /// sequentially.</summary>
+   template<int D>
+   class FlatMetropolis : public FlatLatticeAlgorithm<D> {
+   public:
+      FlatMetropolis(const int J, const double T, const std::array<int, D>& extents);
+      virtual void run(FlatLattice<D>& lattice);
+
+   private:
+      void sweep_plane(FlatLattice<D>& lattice, const int plane, const int colour);
+
+      // min(1, exp(-2|J|k/T)) by k+2D, with k = sign(J)*s*(neighbour sum)
+      std::array<double, 4 * D + 1> m_acceptance;
+      int m_J_sign;
+      bool m_parallel;
+      std::vector<std::mt19937> m_plane_rngs;
+   };
+
+   extern template class CLASS_DECLSPEC FlatMetropolis<3>;
+
+
+   /// <summary>Swendsen-Wang on a flat lattice. Bonds are frozen plane by plane in parallel, the
+   /// clusters are grown sequentially. Neighbours come from strides and a per-site edge mask, so
+   /// the hot loops don't divide.</summary>
+   template<int D>
+   class FlatSW : public FlatLatticeAlgorithm<D> {
+   public:
+      FlatSW(const int J, const double T, const std::array<int, D>& extents);
+      virtual void run(FlatLattice<D>& lattice);
+
+   private:
+      double m_freeze_probability;
+      int m_J;
+      std::vector<std::mt19937> m_plane_rngs;
+      std::mt19937 m_flip_rng;
+
+      // Strides along every axis and the jump back across the periodic boundary. Bit 2a of the
+      // edge mask is set on the high edge of axis a, bit 2a+1 on the low edge.
+      std::array<int, D> m_strides;
+      std::array<int, D> m_wraps;
+      std::vector<unsigned char> m_edge_masks;
+
+      // Scratch space, kept between runs. Frozen bit a is the bond in +a direction.
+      ClusterScratch m_scratch;
+   };
+
+   extern template class CLASS_DECLSPEC FlatSW<3>;
+
+}
@@ -1,8 +1,63 @@
 #include "IsingSystem.h"
 #include "logging.h"
 #include "file_tools.h"
+#include "StencilAlgorithms.h"
+#include "BoundaryAlgorithms.h"
+
+#include <execution>
+#include <map>
+#include <numeric>
 
 namespace {
+   // Lattices from this size on are reduced in parallel
+   constexpr unsigned int parallel_observables_threshold = 1 << 20;
+
+
+   /// <summary>Observables of one row and its bonds to the right and to the next row. The
+   /// interior loop has no wraparound and int accumulators, which is safe for one row.</summary>
+   magneto::LatticeObservables get_row_observables(const magneto::LatticeType& grid, const unsigned int i) {
+      const auto [Lx, Ly] = magneto::get_dimensions_of_lattice(grid);
+      const char* row = grid[i].data();
+      const char* row_down = grid[(i + 1) % Ly].data();
+      int bond_x = 0;
+      int bond_y = 0;
+      int m = 0;
+      int staggered = 0;
+      for (unsigned int j = 0; j < Lx - 1; ++j) {
+         bond_x += row[j] * row[j + 1];
+         bond_y += row[j] * row_down[j];
+         m += row[j];
+         staggered += (1 - 2 * static_cast<int>(j & 1)) * row[j];
+      }
+      const unsigned int last = Lx - 1;
+      bond_x += row[last] * row[0];
+      bond_y += row[last] * row_down[last];
+      m += row[last];
+      staggered += (1 - 2 * static_cast<int>(last & 1)) * row[last];
+
+      const int row_sign = (i & 1) ? -1 : 1;
+      return { bond_x, bond_y, m, row_sign * staggered };
+   }
+
+
+   magneto::LatticeObservables add_observables(const magneto::LatticeObservables& a, const magneto::LatticeObservables& b) {
+      return {
+         a.bond_x_sum + b.bond_x_sum,
+         a.bond_y_sum + b.bond_y_sum,
+         a.magnetization + b.magnetization,
+         a.staggered_magnetization + b.staggered_magnetization
+      };
+   }
+
+
+   /// <summary>Energy per site and absolute (staggered) magnetization per site</summary>
+   magneto::PhysicalMeasurement get_normalized_measurement(const magneto::LatticeObservables& observables, const unsigned int N) {
+      magneto::PhysicalMeasurement measurement;
+      measurement.energy = -(observables.bond_x_sum + observables.bond_y_sum) * 1.0 / N;
+      measurement.magnetization = std::abs(observables.magnetization) * 1.0 / N;
+      measurement.staggered_magnetization = std::abs(observables.staggered_magnetization) * 1.0 / N;
+      return measurement;
+   }
 
 } // namespace {}
 
@@ -11,6 +66,10 @@ magneto::PhysicalMeasurement magneto::operator+(const PhysicalMeasurement& a, co
    PhysicalMeasurement sum_result(a);
    sum_result.energy += b.energy;
    sum_result.magnetization += b.magnetization;
+   sum_result.staggered_magnetization += b.staggered_magnetization;
+   sum_result.cluster_m2 += b.cluster_m2;
+   sum_result.cluster_fourier_m2_x += b.cluster_fourier_m2_x;
+   sum_result.cluster_fourier_m2_y += b.cluster_fourier_m2_y;
    return sum_result;
 }
 
@@ -19,13 +78,83 @@ magneto::PhysicalMeasurement magneto::operator/(const PhysicalMeasurement& a, co
    PhysicalMeasurement div_result(a);
    div_result.energy /= d;
    div_result.magnetization /= d;
+   div_result.staggered_magnetization /= d;
+   div_result.cluster_m2 /= d;
+   div_result.cluster_fourier_m2_x /= d;
+   div_result.cluster_fourier_m2_y /= d;
    return div_result;
 }
 
+namespace {
+
+   /// <summary>Sum s_i s_j over the bonds of the periodic square lattice, without the other observables</summary>
+   long long get_square_bond_sum(const magneto::LatticeType& grid) {
+      const auto [Lx, Ly] = magneto::get_dimensions_of_lattice(grid);
+      std::vector<unsigned int> rows(Ly);
+      std::iota(std::begin(rows), std::end(rows), 0);
+      const auto row_fun = [&, Lx = Lx, Ly = Ly](const unsigned int i) {
+         const char* row = grid[i].data();
+         const char* row_down = grid[i + 1 == Ly ? 0 : i + 1].data();
+         int sum = row[Lx - 1] * (row[0] + row_down[Lx - 1]);
+         for (unsigned int j = 0; j < Lx - 1; ++j)
+            sum += row[j] * (row[j + 1] + row_down[j]);
+         return static_cast<long long>(sum);
+      };
+      if (Lx * Ly >= parallel_observables_threshold)
+         return std::transform_reduce(std::execution::par, std::cbegin(rows), std::cend(rows), 0ll, std::plus<>(), row_fun);
+      return std::transform_reduce(std::cbegin(rows), std::cend(rows), 0ll, std::plus<>(), row_fun);
+   }
+
+
+   /// <summary>Energy per site in units of J, as the uniform square lattice always had it:
+   /// -Sum s_i s_j/N. Sums that contain the couplings or the field are divided by J, without a J
+   /// they stay as they are. The bond sum of the periodic square lattice is only computed if it is needed
+   /// and wasn't passed.</summary>
+   double get_energy(const magneto::IsingSystem& system, std::optional<long long> square_bond_sum) {
+      const magneto::LatticeType& grid = system.get_lattice();
+      const auto [Lx, Ly] = magneto::get_dimensions_of_lattice(grid);
+      const double N = 1.0 * Lx * Ly;
+      const double J = system.get_J() != 0 ? system.get_J() : 1.0;
+      double energy = 0.0;
+      if (system.get_geometry().lattice != magneto::LatticeGeometry::Square)
+         energy = -magneto::get_stencil_energy_sum(grid, system.get_J(), system.get_geometry()) / (J * N);
+      else if (!magneto::is_periodic_square(system.get_geometry()))
+         energy = -magneto::get_boundary_energy_sum(grid, system.get_geometry()) / N;
+      else if (system.get_couplings())
+         energy = -magneto::get_bond_energy_sum(grid, *system.get_couplings()) / (J * N);
+      else
+         energy = -(square_bond_sum.has_value() ? square_bond_sum.value() : get_square_bond_sum(grid)) / N;
+      if (system.get_field())
+         energy -= magneto::get_field_energy_sum(grid, *system.get_field()) / (J * N);
+      return energy;
+   }
+
+} // namespace {}
+
+
 magneto::PhysicalMeasurement magneto::get_properties(const IsingSystem& system){
-   const double energy = get_E(system.get_lattice());
-   const double m = get_m_abs(system.get_lattice());
-   return { energy, m };
+   const LatticeType& grid = system.get_lattice();
+   const auto [Lx, Ly] = get_dimensions_of_lattice(grid);
+   const LatticeObservables observables = get_lattice_observables(grid, Lx * Ly >= parallel_observables_threshold);
+   PhysicalMeasurement measurement = get_normalized_measurement(observables, Lx * Ly);
+   measurement.energy = get_energy(system, observables.bond_x_sum + observables.bond_y_sum);
+   return measurement;
+}
+
+
+magneto::PhysicalMeasurement magneto::get_properties(
+   const IsingSystem& system, const ClusterStatistics& cluster_statistics
+) {
+   // The cluster step already knows the magnetization, only the energy takes a lattice pass
+   const auto [Lx, Ly] = get_dimensions_of_lattice(system.get_lattice());
+   const double N = 1.0 * Lx * Ly;
+   PhysicalMeasurement measurement;
+   measurement.energy = get_energy(system, std::nullopt);
+   measurement.magnetization = std::abs(cluster_statistics.magnetization) / N;
+   measurement.cluster_m2 = cluster_statistics.squared_size_sum / (N * N);
+   measurement.cluster_fourier_m2_x = cluster_statistics.fourier_size_sum_x / (N * N);
+   measurement.cluster_fourier_m2_y = cluster_statistics.fourier_size_sum_y / (N * N);
+   return measurement;
 }
 
 
@@ -40,25 +169,26 @@ int magneto::get_dE(const LatticeType& grid, int i, int j){
 }
 
 
+magneto::LatticeObservables magneto::get_lattice_observables(const LatticeType& grid, const bool parallel) {
+   const auto [Lx, Ly] = get_dimensions_of_lattice(grid);
+   std::vector<unsigned int> rows(Ly);
+   std::iota(std::begin(rows), std::end(rows), 0);
+   const auto row_fun = [&](const unsigned int i) {return get_row_observables(grid, i); };
+   if (parallel)
+      return std::transform_reduce(std::execution::par, std::cbegin(rows), std::cend(rows), LatticeObservables(), add_observables, row_fun);
+   return std::transform_reduce(std::cbegin(rows), std::cend(rows), LatticeObservables(), add_observables, row_fun);
+}
+
+
 double magneto::get_E(const LatticeType& grid){
    const auto [Lx, Ly] = get_dimensions_of_lattice(grid);
-   int E = 0;
-   for (unsigned int i = 0; i < Ly; ++i) {
-      for (unsigned int j = 0; j < Lx; ++j)
-         E += -grid[i][j] * (grid[i][(j + 1) % Lx] + grid[(i + 1) % Ly][j]);
-   }
-   return E * 1.0 / (Lx * Ly);
+   return get_normalized_measurement(get_lattice_observables(grid), Lx * Ly).energy;
 }
 
 
 double magneto::get_m_abs(const LatticeType& grid){
    const auto [Lx, Ly] = get_dimensions_of_lattice(grid);
-   int m = 0;
-   for (unsigned int i = 0; i < Ly; ++i) {
-      for (unsigned int j = 0; j < Lx; ++j)
-         m += grid[i][j];
-   }
-   return std::abs(m) * 1.0 / (Lx * Ly);
+   return get_normalized_measurement(get_lattice_observables(grid), Lx * Ly).magnetization;
 }
 
 
@@ -81,9 +211,33 @@ int magneto::IsingSystem::get_J() const{
 }
 
 
-magneto::IsingSystem::IsingSystem(const int j, const magneto::LatticeType& initial_state)
-	: m_J(j)
-	, m_lattice(initial_state)
+const std::shared_ptr<const magneto::BondCouplings>& magneto::IsingSystem::get_couplings() const {
+   return m_couplings;
+}
+
+
+const std::shared_ptr<const magneto::ExternalField>& magneto::IsingSystem::get_field() const {
+   return m_field;
+}
+
+
+const magneto::Geometry& magneto::IsingSystem::get_geometry() const {
+   return m_geometry;
+}
+
+
+magneto::IsingSystem::IsingSystem(
+   const int j,
+   const magneto::LatticeType& initial_state,
+   const std::shared_ptr<const BondCouplings>& couplings /*= nullptr*/,
+   const std::shared_ptr<const ExternalField>& field /*= nullptr*/,
+   const Geometry& geometry /*= Geometry()*/
+)
+	: m_lattice(initial_state)
+	, m_J(j)
+   , m_couplings(couplings)
+   , m_field(field)
+   , m_geometry(geometry)
 {}
 
 
@@ -99,3 +253,81 @@ magneto::LatticeType magneto::get_randomized_system(const int Lx, const int Ly)
    }
    return grid;
 }
+
+
+magneto::BondCouplings magneto::get_random_couplings(
+   const unsigned int Lx, const unsigned int Ly, const int J, const double antiferro_fraction, const unsigned int seed
+) {
+   std::mt19937_64 rng(seed);
+   std::bernoulli_distribution is_antiferro(antiferro_fraction);
+   // The energy is divided by J, so the bonds keep its sign
+   const signed char coupling = static_cast<signed char>(J < 0 ? -std::min(127, -J) : std::min(127, J));
+   BondCouplings couplings{ Lx, Ly, {}, {} };
+   for (std::vector<signed char>* bonds : { &couplings.east, &couplings.south }) {
+      bonds->reserve(Lx * Ly);
+      for (unsigned int site = 0; site < Lx * Ly; ++site)
+         bonds->emplace_back(is_antiferro(rng) ? -coupling : coupling);
+   }
+   return couplings;
+}
+
+
+long long magneto::get_bond_energy_sum(const LatticeType& grid, const BondCouplings& couplings) {
+   const auto [Lx, Ly] = get_dimensions_of_lattice(grid);
+   long long sum = 0;
+   for (unsigned int i = 0; i < Ly; ++i) {
+      const std::vector<char>& row = grid[i];
+      const std::vector<char>& row_down = grid[i + 1 == Ly ? 0 : i + 1];
+      int row_sum = 0;
+      for (unsigned int j = 0; j < Lx; ++j) {
+         row_sum += couplings.east[i * Lx + j] * row[j] * row[j + 1 == Lx ? 0 : j + 1];
+         row_sum += couplings.south[i * Lx + j] * row[j] * row_down[j];
+      }
+      sum += row_sum;
+   }
+   return sum;
+}
+
+
+double magneto::get_field_energy_sum(const LatticeType& grid, const ExternalField& field) {
+   const auto [Lx, Ly] = get_dimensions_of_lattice(grid);
+   long long magnetization = 0;
+   double site_sum = 0.0;
+   for (unsigned int i = 0; i < Ly; ++i) {
+      for (unsigned int j = 0; j < Lx; ++j) {
+         magnetization += grid[i][j];
+         if (field.levels)
+            site_sum += field.level_values[(*field.levels)[i * Lx + j]] * grid[i][j];
+      }
+   }
+   return field.h * magnetization + site_sum;
+}
+
+
+std::optional<magneto::ExternalField> magneto::get_external_field(const double h, const LatticeDType& site_fields) {
+   const auto [Lx, Ly] = get_dimensions_of_lattice(site_fields);
+   std::map<double, unsigned char> level_of_value;
+   for (const std::vector<double>& row : site_fields) {
+      for (const double value : row)
+         level_of_value.emplace(value, 0);
+   }
+   if (level_of_value.size() > 256) {
+      magneto::get_logger()->error("The field has {} distinct values, at most 256 are supported", level_of_value.size());
+      return std::nullopt;
+   }
+
+   ExternalField field;
+   field.h = h;
+   for (auto& [value, level] : level_of_value) {
+      level = static_cast<unsigned char>(field.level_values.size());
+      field.level_values.emplace_back(value);
+   }
+   std::vector<unsigned char> levels;
+   levels.reserve(Lx * Ly);
+   for (const std::vector<double>& row : site_fields) {
+      for (const double value : row)
+         levels.emplace_back(level_of_value.at(value));
+   }
+   field.levels = std::make_shared<const std::vector<unsigned char>>(std::move(levels));
+   return field;
+}
@@ -1,30 +1,87 @@
 #pragma once
 
 #include <filesystem>
+#include <memory>
 #include <random>
 #include <variant>
 #include <optional>
 
 #include "types.h"
+#include "export_macro.h"
 
 namespace magneto {
-	class IsingSystem {
+	class CLASS_DECLSPEC IsingSystem {
 	public:
-      IsingSystem(const int j, const LatticeType& initial_state);
+      /// <summary>Without couplings, all bonds have the coupling j. The field and the geometry
+      /// only enter the measured energy.</summary>
+      IsingSystem(
+         const int j,
+         const LatticeType& initial_state,
+         const std::shared_ptr<const BondCouplings>& couplings = nullptr,
+         const std::shared_ptr<const ExternalField>& field = nullptr,
+         const Geometry& geometry = Geometry()
+      );
 		[[nodiscard]] const LatticeType& get_lattice() const;
 		[[nodiscard]] LatticeType& get_lattice_nc();
 		size_t get_L() const;
       int get_J() const;
+      const std::shared_ptr<const BondCouplings>& get_couplings() const;
+      const std::shared_ptr<const ExternalField>& get_field() const;
+      const Geometry& get_geometry() const;
 
 	private:
 		LatticeType m_lattice;
 		int m_J = 1;
+      std::shared_ptr<const BondCouplings> m_couplings;
+      std::shared_ptr<const ExternalField> m_field;
+      Geometry m_geometry;
    };
 
    /// <summary>Energy and Magnetization of the system at one point in time</summary>
    struct PhysicalMeasurement {
+      // Per site and in units of J, also with bond couplings
       double energy = 0.0;
       double magnetization = 0.0;
+      double staggered_magnetization = 0.0;
+
+      // Improved estimators from cluster algorithms, zero if there were none: Sum |C|^2/N^2 and
+      // the Fourier transformed counterparts along x and y, normalized the same way
+      double cluster_m2 = 0.0;
+      double cluster_fourier_m2_x = 0.0;
+      double cluster_fourier_m2_y = 0.0;
+   };
+
+   /// <summary>Cluster statistics of one cluster algorithm step. Used as a byproduct for
+   /// improved estimators, whose variance is much lower near Tc.</summary>
+   struct ClusterStatistics {
+      unsigned int cluster_count = 0;
+
+      // Sum over all clusters of their squared size: Sum |C|^2
+      double squared_size_sum = 0.0;
+
+      // Sum over all clusters of |Sum_{i in C} exp(i k r_i)|^2 with the smallest nonzero wave
+      // vector along x (2 pi/Lx) and along y (2 pi/Ly)
+      double fourier_size_sum_x = 0.0;
+      double fourier_size_sum_y = 0.0;
+
+      // Total magnetization after the step
+      long long magnetization = 0;
+   };
+
+   /// <summary>Raw lattice sums of all observables that are computed in one pass</summary>
+   struct LatticeObservables {
+      // Nearest neighbour correlations Sum s_i s_{i+x} and Sum s_i s_{i+y}
+      long long bond_x_sum = 0;
+      long long bond_y_sum = 0;
+      long long magnetization = 0;
+      long long staggered_magnetization = 0;
+   };
+
+   /// <summary>Sums of the moments of a block of consecutive measurements</summary>
+   struct MomentBin {
+      unsigned int count = 0;
+      double m2 = 0.0;
+      double m4 = 0.0;
    };
 
    /// <summary>Energies and Magnetizations of many system states at one temperature</summary>
@@ -33,21 +90,54 @@ namespace magneto {
       double T;
       unsigned int Lx;
       unsigned int Ly;
+      unsigned int Lz = 1;
+
+      // Binned moments of the magnetization, for error estimates
+      std::vector<MomentBin> moment_bins;
+
+      // Only filled if the correlation measurement is enabled
+      std::vector<double> correlation_function;
+      std::vector<double> structure_factor;
    };
 
    PhysicalMeasurement operator+(const PhysicalMeasurement& a, const PhysicalMeasurement& b);
    PhysicalMeasurement operator/(const PhysicalMeasurement& a, const unsigned int d);
 
-   PhysicalMeasurement get_properties(const IsingSystem& system);
+   CLASS_DECLSPEC PhysicalMeasurement get_properties(const IsingSystem& system);
+
+   /// <summary>Takes the magnetization from a cluster algorithm step and records its improved
+   /// estimators. Only the energy is measured on the lattice, the staggered magnetization stays 0.</summary>
+   PhysicalMeasurement get_properties(const IsingSystem& system, const ClusterStatistics& cluster_statistics);
 
 	int get_dE(const LatticeType& grid, int i, int j);
 
+   /// <summary>Fused reduction of energy, magnetization, staggered magnetization and the nearest
+   /// neighbour correlations in one lattice pass with 64 bit accumulators. Rows are processed in
+   /// parallel if requested.</summary>
+   LatticeObservables get_lattice_observables(const LatticeType& grid, const bool parallel = false);
+
    /// <summary>Returns normalized energy (per size)</summary>
    double get_E(const LatticeType& grid);
 
    /// <summary>Returns normalized absolute magnetization</summary>
    double get_m_abs(const LatticeType& grid);
 
-   LatticeType get_randomized_system(const int Lx, const int Ly);
+   CLASS_DECLSPEC LatticeType get_randomized_system(const int Lx, const int Ly);
+
+   /// <summary>Couplings of J, each one with the opposite sign with probability antiferro_fraction.
+   /// A fraction of 0.5 is the Edwards-Anderson spin glass.</summary>
+   [[nodiscard]] CLASS_DECLSPEC BondCouplings get_random_couplings(
+      const unsigned int Lx, const unsigned int Ly, const int J, const double antiferro_fraction, const unsigned int seed
+   );
+
+   /// <summary>Sum over all bonds of J_ij s_i s_j</summary>
+   [[nodiscard]] long long get_bond_energy_sum(const LatticeType& grid, const BondCouplings& couplings);
+
+   /// <summary>Sum over all sites of h_i s_i</summary>
+   [[nodiscard]] double get_field_energy_sum(const LatticeType& grid, const ExternalField& field);
+
+   /// <summary>Field with a level per distinct value of site_fields on top of h. Fails for more
+   /// than 256 distinct values, image data has at most that many.</summary>
+   [[nodiscard]] std::optional<ExternalField> get_external_field(const double h, const LatticeDType& site_fields);
 	
 }
@@ -4,6 +4,8 @@
 #include "IsingSystem.h"
 #include "nlohmann/json.hpp"
 #include <random>
+#include <algorithm>
+#include <cmath>
 
 
 namespace {
@@ -40,6 +42,10 @@ namespace {
    }
 
 
+   const std::vector<std::string> algorithm_names = { "metropolis", "SW", "multispin", "auto", "creutz", "kawasaki" };
+   const std::vector<std::string> boundary_names = { "periodic", "open", "fixed", "fixed_opposite", "antiperiodic", "helical" };
+
+
    template<class T>
    void write_value_from_json(const nlohmann::json& j, const char* key, T& target) {
       if (j.contains(key))
@@ -52,13 +58,73 @@ namespace {
          target = j.at(key).get<std::string>();
    }
 
+   template<>
+   void write_value_from_json(const nlohmann::json& j, const char* key, std::vector<std::filesystem::path>& target) {
+      if (!j.contains(key))
+         return;
+      target.clear();
+      for (const nlohmann::json& path_json : j.at(key))
+         target.emplace_back(path_json.get<std::string>());
+   }
+
+
+   void write_schedule_from_json(const nlohmann::json& j, const char* key, std::vector<magneto::ScheduleStep>& target) {
+      if (!j.contains(key))
+         return;
+      target.clear();
+      for (const nlohmann::json& step_json : j.at(key)) {
+         magneto::ScheduleStep step;
+         set_enum_from_key(step_json, step.m_algorithm, "alg", algorithm_names);
+         write_value_from_json(step_json, "n", step.m_n);
+         if (step.m_algorithm == magneto::Algorithm::Multispin || step.m_algorithm == magneto::Algorithm::Auto) {
+            magneto::get_logger()->warn("Only metropolis, SW, creutz and kawasaki can be part of the schedule {}, step ignored.", key);
+            continue;
+         }
+         target.emplace_back(step);
+      }
+   }
+
+
+   /// <summary>Inverse of the standard normal cumulative distribution function, by bisection</summary>
+   double get_inverse_normal_cdf(const double p) {
+      double low = -10.0;
+      double high = 10.0;
+      for (int i = 0; i < 100; ++i) {
+         const double mid = 0.5 * (low + high);
+         if (0.5 * std::erfc(-mid / std::sqrt(2.0)) < p)
+            low = mid;
+         else
+            high = mid;
+      }
+      return 0.5 * (low + high);
+   }
+
+
+   /// <summary>Returns n temperatures distributed with a normal distribution (sigma=1) around the
+   /// critical temperature, truncated to [tmin, tmax]. Both ends are included.</summary>
+   std::vector<double> get_normal_temps(const double tmin, const double tmax, const int n, const int J) {
+      const double tc = 2.0 / std::log(1.0 + std::sqrt(2.0)) * std::abs(J);
+      const double sigma = 1.0;
+      const auto cdf = [&](const double t) {return 0.5 * std::erfc(-(t - tc) / (sigma * std::sqrt(2.0))); };
+      const double p_min = cdf(tmin);
+      const double p_max = cdf(tmax);
+      std::vector<double> temps;
+      for (int i = 0; i < n; ++i) {
+         const double p = p_min + (p_max - p_min) * i / (n - 1);
+         temps.emplace_back(std::clamp(tc + sigma * get_inverse_normal_cdf(p), tmin, tmax));
+      }
+      return temps;
+   }
+
 
    /// <summary>Returns vector of n equidistant temperatures</summary>
    std::vector<double> get_temps(
-      const magneto::TempStartMode& mode, const double tmin, const double tmax, const int n
+      const magneto::TempStartMode& mode, const double tmin, const double tmax, const int n, const int J
    ) {
       if (mode == magneto::TempStartMode::Single)
          return { tmin };
+      if (mode == magneto::TempStartMode::Normal && n > 1)
+         return get_normal_temps(tmin, tmax, n, J);
       std::vector<double> temps;
       double temperature = tmin;
       const double temperature_step = (tmax - tmin) / (n - 1);
@@ -79,7 +145,7 @@ namespace {
       else if (job.temp_mode == magneto::TempStartMode::Single)
          return std::vector<double>{ job.t_min };
       else
-         return get_temps(job.temp_mode, job.t_min, job.t_max, job.temp_steps);
+         return get_temps(job.temp_mode, job.t_min, job.t_max, job.temp_steps, job.J);
 
    }
 
@@ -123,31 +189,320 @@ namespace {
    }
 
 
+   bool uses_algorithm(const magneto::JsonJob& json_job, const magneto::Algorithm algorithm) {
+      const auto in_schedule = [&](const std::vector<magneto::ScheduleStep>& schedule) {
+         return std::any_of(std::cbegin(schedule), std::cend(schedule), [&](const magneto::ScheduleStep& step) {return step.m_algorithm == algorithm; });
+      };
+      return json_job.algorithm == algorithm || in_schedule(json_job.schedule) || in_schedule(json_job.start_schedule);
+   }
+
+
+
+   std::shared_ptr<const magneto::BondCouplings> get_couplings(
+      const magneto::JsonJob& json_job,
+      const unsigned int Lx,
+      const unsigned int Ly
+   ) {
+      if (json_job.bond_mode == magneto::BondMode::Uniform)
+         return nullptr;
+      if (json_job.algorithm != magneto::Algorithm::Metropolis && json_job.algorithm != magneto::Algorithm::SW
+         && json_job.algorithm != magneto::Algorithm::Auto)
+      {
+         magneto::get_logger()->warn("Bond couplings are only supported by metropolis and SW, using metropolis.");
+      }
+
+      std::optional<magneto::BondCouplings> couplings = json_job.bond_mode == magneto::BondMode::Random ?
+         magneto::get_random_couplings(Lx, Ly, json_job.J, json_job.antiferro_fraction, json_job.bond_seed) :
+         magneto::get_bond_couplings_from_file(json_job.bond_path);
+      if (!couplings.has_value()) {
+         magneto::get_logger()->error("No bond couplings, using uniform couplings.");
+         return nullptr;
+      }
+      if (couplings->Lx != Lx || couplings->Ly != Ly) {
+         magneto::get_logger()->error(
+            "Bond couplings are {}X{}, but the system is {}X{}. Using uniform couplings.", couplings->Lx, couplings->Ly, Lx, Ly
+         );
+         return nullptr;
+      }
+      return std::make_shared<const magneto::BondCouplings>(std::move(couplings.value()));
+   }
+
+
+   std::shared_ptr<const magneto::ExternalField> get_field(
+      const magneto::JsonJob& json_job,
+      const unsigned int Lx,
+      const unsigned int Ly,
+      const std::variant<magneto::LatticeDType, std::vector<double>>& t_variant
+   ) {
+      if (json_job.field == 0.0 && json_job.field_image.empty() && json_job.hysteresis_steps == 0)
+         return nullptr;
+      if (std::holds_alternative<magneto::LatticeDType>(t_variant)) {
+         magneto::get_logger()->warn("External fields aren't supported for image temperatures, ignoring the field.");
+         return nullptr;
+      }
+      if (json_job.bond_mode != magneto::BondMode::Uniform) {
+         magneto::get_logger()->warn("External fields aren't supported with bond couplings, ignoring the field.");
+         return nullptr;
+      }
+      if (json_job.algorithm != magneto::Algorithm::Metropolis || !json_job.schedule.empty())
+         magneto::get_logger()->warn("External fields are only supported by metropolis, using metropolis.");
+
+      const auto uniform_field = std::make_shared<const magneto::ExternalField>(magneto::ExternalField{ json_job.field, nullptr, {} });
+      if (json_job.field_image.empty())
+         return uniform_field;
+
+      std::optional<magneto::LatticeDType> site_fields = magneto::get_lattice_temps_from_png_file(
+         json_job.field_image, json_job.field_min, json_job.field_max
+      );
+      if (!site_fields.has_value()) {
+         magneto::get_logger()->error("No field image, using a uniform field.");
+         return uniform_field;
+      }
+      if (magneto::get_dimensions_of_lattice(site_fields.value()) != std::make_pair(Lx, Ly)) {
+         site_fields = magneto::get_resized_data<std::optional<magneto::LatticeDType>>(
+            json_job.field_image, Lx, Ly,
+            [&](const std::filesystem::path& path) {return magneto::get_lattice_temps_from_png_file(path, json_job.field_min, json_job.field_max); }
+         );
+      }
+      std::optional<magneto::ExternalField> field = site_fields.has_value() ?
+         magneto::get_external_field(json_job.field, site_fields.value()) : std::nullopt;
+      if (!field.has_value()) {
+         magneto::get_logger()->error("Field image can't be used, using a uniform field.");
+         return uniform_field;
+      }
+      return std::make_shared<const magneto::ExternalField>(std::move(field.value()));
+   }
+
+
+   magneto::Geometry get_geometry(
+      const magneto::JsonJob& json_job,
+      const unsigned int Lx,
+      const unsigned int Ly,
+      const std::variant<magneto::LatticeDType, std::vector<double>>& t_variant
+   ) {
+      magneto::Geometry geometry{ json_job.lattice, json_job.J2, json_job.boundary_x, json_job.boundary_y };
+      if (magneto::is_periodic_square(geometry))
+         return {};
+      if (std::holds_alternative<magneto::LatticeDType>(t_variant)) {
+         magneto::get_logger()->warn(
+            "Lattice geometries and boundary conditions aren't supported for image temperatures, using the periodic square lattice."
+         );
+         return {};
+      }
+      if (geometry.lattice == magneto::LatticeGeometry::Honeycomb && (Lx % 2 != 0 || Ly % 2 != 0)) {
+         magneto::get_logger()->error("The honeycomb lattice needs an even size, not {}X{}. Using the square lattice.", Lx, Ly);
+         geometry.lattice = magneto::LatticeGeometry::Square;
+      }
+      if (geometry.lattice == magneto::LatticeGeometry::Anisotropic && geometry.J2 == 0)
+         magneto::get_logger()->warn("The anisotropic lattice has no vertical coupling J2, its rows are decoupled.");
+      if (geometry.lattice != magneto::LatticeGeometry::Square
+         && (geometry.boundary_x != magneto::Boundary::Periodic || geometry.boundary_y != magneto::Boundary::Periodic))
+      {
+         magneto::get_logger()->warn("Boundary conditions are only supported on the square lattice, using periodic boundaries.");
+         geometry.boundary_x = magneto::Boundary::Periodic;
+         geometry.boundary_y = magneto::Boundary::Periodic;
+      }
+      if (magneto::is_periodic_square(geometry))
+         return {};
+      if (json_job.bond_mode != magneto::BondMode::Uniform || json_job.field != 0.0 || !json_job.field_image.empty()
+         || json_job.hysteresis_steps > 0)
+      {
+         magneto::get_logger()->warn("Bond couplings and fields are only supported on the periodic square lattice, ignoring them.");
+      }
+      if (json_job.algorithm != magneto::Algorithm::Metropolis && json_job.algorithm != magneto::Algorithm::SW
+         && json_job.algorithm != magneto::Algorithm::Auto)
+      {
+         magneto::get_logger()->warn("Lattice geometries and boundary conditions are only supported by metropolis and SW, using metropolis.");
+      }
+      return geometry;
+   }
+
+
+   unsigned int get_Lz(const magneto::JsonJob& json_job, const std::variant<magneto::LatticeDType, std::vector<double>>& t_variant) {
+      if (json_job.Lz <= 1)
+         return 1;
+      if (std::holds_alternative<magneto::LatticeDType>(t_variant)) {
+         magneto::get_logger()->warn("Three-dimensional systems aren't supported for image temperatures, using a two-dimensional system.");
+         return 1;
+      }
+      const bool has_2d_options = !json_job.schedule.empty() || !json_job.start_schedule.empty()
+         || json_job.bond_mode != magneto::BondMode::Uniform || json_job.field != 0.0 || !json_job.field_image.empty()
+         || json_job.hysteresis_steps > 0 || json_job.lattice != magneto::LatticeGeometry::Square
+         || json_job.boundary_x != magneto::Boundary::Periodic || json_job.boundary_y != magneto::Boundary::Periodic
+         || json_job.spin_start_mode != magneto::SpinStartMode::Random || json_job.batch_size > 1 || json_job.common_random_numbers
+         || !json_job.physics_config.m_correlation_path.empty() || !json_job.physics_config.m_structure_factor_path.empty()
+         || json_job.spin_model != magneto::SpinModel::Ising;
+      const bool has_2d_algorithm = json_job.algorithm != magneto::Algorithm::Metropolis && json_job.algorithm != magneto::Algorithm::SW
+         && json_job.algorithm != magneto::Algorithm::Auto;
+      if (has_2d_options || has_2d_algorithm) {
+         magneto::get_logger()->warn(
+            "Three-dimensional systems run metropolis or SW on the periodic cubic lattice from random spins, other options are ignored."
+         );
+      }
+      return json_job.Lz;
+   }
+
+
+   magneto::SpinModel get_spin_model(const magneto::JsonJob& json_job, const std::variant<magneto::LatticeDType, std::vector<double>>& t_variant) {
+      if (json_job.spin_model == magneto::SpinModel::Ising)
+         return magneto::SpinModel::Ising;
+      if (json_job.q < 2 || json_job.q > 256) {
+         magneto::get_logger()->error("Potts and clock models need 2 <= q <= 256, q is {}. Using the Ising model.", json_job.q);
+         return magneto::SpinModel::Ising;
+      }
+      if (std::holds_alternative<magneto::LatticeDType>(t_variant)) {
+         magneto::get_logger()->warn("Potts and clock models aren't supported for image temperatures, using the Ising model.");
+         return magneto::SpinModel::Ising;
+      }
+      const bool has_ising_options = !json_job.schedule.empty() || !json_job.start_schedule.empty()
+         || json_job.bond_mode != magneto::BondMode::Uniform || json_job.field != 0.0 || !json_job.field_image.empty()
+         || json_job.hysteresis_steps > 0 || json_job.lattice != magneto::LatticeGeometry::Square
+         || json_job.boundary_x != magneto::Boundary::Periodic || json_job.boundary_y != magneto::Boundary::Periodic
+         || json_job.spin_start_mode != magneto::SpinStartMode::Random || json_job.batch_size > 1 || json_job.common_random_numbers
+         || !json_job.physics_config.m_correlation_path.empty() || !json_job.physics_config.m_structure_factor_path.empty();
+      const bool has_ising_algorithm = json_job.algorithm != magneto::Algorithm::Metropolis && json_job.algorithm != magneto::Algorithm::SW
+         && json_job.algorithm != magneto::Algorithm::Auto;
+      if (has_ising_options || has_ising_algorithm) {
+         magneto::get_logger()->warn(
+            "Potts and clock models run metropolis or cluster updates on the periodic square lattice from random spins, other options are ignored."
+         );
+      }
+      return json_job.spin_model;
+   }
+
+
+   magneto::TempProtocolMode get_protocol_mode(
+      const magneto::JsonJob& json_job,
+      const bool is_2d_ising,
+      const std::variant<magneto::LatticeDType, std::vector<double>>& t_variant
+   ) {
+      if (json_job.t_protocol == magneto::TempProtocolMode::None)
+         return magneto::TempProtocolMode::None;
+      if (!is_2d_ising) {
+         magneto::get_logger()->warn("Temperature protocols are only supported for two-dimensional Ising systems, ignoring the protocol.");
+         return magneto::TempProtocolMode::None;
+      }
+      if (json_job.hysteresis_steps > 0) {
+         magneto::get_logger()->warn("Temperature protocols can't be combined with hysteresis loops, ignoring the protocol.");
+         return magneto::TempProtocolMode::None;
+      }
+      const bool has_image_temps = std::holds_alternative<magneto::LatticeDType>(t_variant);
+      if (json_job.t_protocol == magneto::TempProtocolMode::Images && !has_image_temps) {
+         magneto::get_logger()->warn("Image protocols need a temperature image, ignoring the protocol.");
+         return magneto::TempProtocolMode::None;
+      }
+      if (json_job.t_protocol != magneto::TempProtocolMode::Images && has_image_temps) {
+         magneto::get_logger()->warn("Image temperatures only support image protocols, ignoring the protocol.");
+         return magneto::TempProtocolMode::None;
+      }
+      return json_job.t_protocol;
+   }
+
+
+   /// <summary>Batches run plain metropolis on the periodic square lattice at fixed temperatures,
+   /// other jobs run one temperature at a time</summary>
+   unsigned int get_batch_size(
+      const magneto::JsonJob& json_job,
+      const magneto::Job& job,
+      const std::variant<magneto::LatticeDType, std::vector<double>>& t_variant
+   ) {
+      if (json_job.batch_size <= 1)
+         return 1;
+      // Three-dimensional systems and spin models have warned already
+      if (job.m_Lz > 1 || job.m_spin_model != magneto::SpinModel::Ising)
+         return 1;
+      const bool is_batchable = job.m_algorithm == magneto::Algorithm::Metropolis && job.m_schedule.empty()
+         && !job.m_couplings && !job.m_field && magneto::is_periodic_square(job.m_geometry)
+         && job.m_protocol == magneto::TempProtocolMode::None && std::holds_alternative<std::vector<double>>(t_variant);
+      if (!is_batchable) {
+         magneto::get_logger()->warn(
+            "Batches are only supported by metropolis on the periodic square lattice at fixed temperatures, ignoring batch_size."
+         );
+         return 1;
+      }
+      return json_job.batch_size;
+   }
+
+
+   /// <summary>Protocol images, mapped to [t_min, t_max] and resized to the system</summary>
+   std::optional<std::vector<magneto::LatticeDType>> get_protocol_images(
+      const magneto::JsonJob& json_job, const unsigned int Lx, const unsigned int Ly
+   ) {
+      const auto fun = [&](const std::filesystem::path& path) {return magneto::get_lattice_temps_from_png_file(path, json_job.t_min, json_job.t_max); };
+      std::vector<magneto::LatticeDType> images;
+      for (const std::filesystem::path& path : json_job.t_protocol_images) {
+         std::optional<magneto::LatticeDType> image = fun(path);
+         if (image.has_value() && magneto::get_dimensions_of_lattice(image.value()) != std::make_pair(Lx, Ly))
+            image = magneto::get_resized_data<std::optional<magneto::LatticeDType>>(path, Lx, Ly, fun);
+         if (!image.has_value())
+            return std::nullopt;
+         images.emplace_back(std::move(image.value()));
+      }
+      return images;
+   }
+
 } // namespace {}
 
 
 void magneto::from_json(const nlohmann::json& j, magneto::JsonJob& job) {
    set_enum_from_key(j, job.spin_start_mode, "spin_start", {"random", "image"});
-   set_enum_from_key(j, job.temp_mode, "temp", { "single", "range", "image" });
-   set_enum_from_key(j, job.algorithm, "algorithm", { "metropolis", "SW" });
+   set_enum_from_key(j, job.temp_mode, "temp", { "single", "range", "image", "normal", "adaptive" });
+   set_enum_from_key(j, job.algorithm, "algorithm", algorithm_names);
+   write_schedule_from_json(j, "schedule", job.schedule);
+   write_schedule_from_json(j, "start_schedule", job.start_schedule);
+   set_enum_from_key(j, job.t_protocol, "t_protocol", { "none", "linear", "exponential", "quench", "images" });
+   set_enum_from_key(j, job.spin_model, "spin_model", { "ising", "potts", "clock" });
+   set_enum_from_key(j, job.bond_mode, "bonds", { "uniform", "random", "file" });
+   set_enum_from_key(j, job.lattice, "lattice", { "square", "triangular", "honeycomb", "nnn", "anisotropic" });
+   set_enum_from_key(j, job.boundary_x, "boundary_x", boundary_names);
+   set_enum_from_key(j, job.boundary_y, "boundary_y", boundary_names);
    set_enum_from_key(j, job.image_mode.m_mode, "image_output_mode", { "none", "endimage", "intervals", "movie" });
    write_value_from_json(j, "t_min", job.t_min);
    write_value_from_json(j, "t_max", job.t_max);
    write_value_from_json(j, "t", job.t_single);
    write_value_from_json(j, "t_steps", job.temp_steps);
+   write_value_from_json(j, "adaptive_budget", job.adaptive_budget);
+   write_value_from_json(j, "adaptive_batch", job.adaptive_batch);
+   write_value_from_json(j, "t_protocol_start", job.t_protocol_start);
+   write_value_from_json(j, "t_protocol_sweeps", job.t_protocol_sweeps);
+   write_value_from_json(j, "t_protocol_images", job.t_protocol_images);
    write_value_from_json(j, "t_image", job.temperature_image);
    write_value_from_json(j, "start_runs", job.start_runs);
    write_value_from_json(j, "L", job.L);
    write_value_from_json(j, "Lx", job.Lx);
    write_value_from_json(j, "Ly", job.Ly);
+   write_value_from_json(j, "Lz", job.Lz);
    write_value_from_json(j, "J", job.J);
+   write_value_from_json(j, "q", job.q);
+   write_value_from_json(j, "J2", job.J2);
+   write_value_from_json(j, "bond_path", job.bond_path);
+   write_value_from_json(j, "bond_seed", job.bond_seed);
+   write_value_from_json(j, "antiferro_fraction", job.antiferro_fraction);
+   write_value_from_json(j, "field", job.field);
+   write_value_from_json(j, "field_image", job.field_image);
+   write_value_from_json(j, "field_min", job.field_min);
+   write_value_from_json(j, "field_max", job.field_max);
+   write_value_from_json(j, "hysteresis_steps", job.hysteresis_steps);
+   write_value_from_json(j, "hysteresis_field", job.hysteresis_field);
+   write_value_from_json(j, "hysteresis_iterations", job.hysteresis_iterations);
    write_value_from_json(j, "iterations", job.n);
+   write_value_from_json(j, "batch_size", job.batch_size);
+   write_value_from_json(j, "common_random_numbers", job.common_random_numbers);
+   write_value_from_json(j, "auto_pilot_runs", job.auto_pilot_runs);
+   write_value_from_json(j, "pipeline_depth", job.pipeline_depth);
    write_value_from_json(j, "spin_start_image_path", job.spin_start_image_path);
    write_value_from_json(j, "image_intervals", job.image_mode.m_intervals);
    write_value_from_json(j, "image_path", job.image_mode.m_path);
    write_value_from_json(j, "fps", job.image_mode.m_fps);
+   write_value_from_json(j, "image_slice", job.image_mode.m_slice);
    write_value_from_json(j, "physics_path", job.physics_config.m_outputfile);
    write_value_from_json(j, "physics_format", job.physics_config.m_format);
+   write_value_from_json(j, "correlation_path", job.physics_config.m_correlation_path);
+   write_value_from_json(j, "structure_factor_path", job.physics_config.m_structure_factor_path);
+   write_value_from_json(j, "correlation_stride", job.physics_config.m_correlation_stride);
+   write_value_from_json(j, "jackknife_bins", job.physics_config.m_jackknife_bins);
+   write_value_from_json(j, "hysteresis_path", job.physics_config.m_hysteresis_path);
+   write_value_from_json(j, "protocol_path", job.physics_config.m_protocol_path);
 }
 
 
@@ -177,7 +532,7 @@ std::optional<T> get_resized_image_state(
 
 
 //magneto::Job
-std::tuple<magneto::Job, std::variant<magneto::LatticeDType, std::vector<double>>>
+std::optional<std::tuple<magneto::Job, std::variant<magneto::LatticeDType, std::vector<double>>>>
 magneto::get_job(const JsonJob& json_job){
    Job job;
 
@@ -187,7 +542,15 @@ magneto::get_job(const JsonJob& json_job){
    std::optional<LatticeType> image_spin_state = get_spin_state_from_job(json_job);
    auto t = get_temp_variant(json_job);
    if (!t.has_value()) {
-      return {};
+      return std::nullopt;
+   }
+   if (json_job.J == 0 && uses_algorithm(json_job, Algorithm::Creutz)) {
+      magneto::get_logger()->error("The creutz algorithm trades energy in quanta of 4|J| and needs J != 0.");
+      return std::nullopt;
+   }
+   if (json_job.bond_mode != BondMode::Uniform && std::holds_alternative<LatticeDType>(t.value())) {
+      magneto::get_logger()->error("Bond couplings aren't supported for image temperatures.");
+      return std::nullopt;
    }
 
    std::tie(job.m_Lx, job.m_Ly) = get_system_size(json_job, image_spin_state, t.value());
@@ -220,13 +583,53 @@ magneto::get_job(const JsonJob& json_job){
       job.initial_spins = image_spin_state.value();
 
    job.m_algorithm = json_job.algorithm;
+   job.m_schedule = json_job.schedule;
    job.m_n = json_job.n;
+   job.m_common_random_numbers = json_job.common_random_numbers;
+   job.m_auto_pilot_runs = json_job.auto_pilot_runs;
+   job.m_pipeline_depth = json_job.pipeline_depth;
+   if (json_job.temp_mode == TempStartMode::Adaptive) {
+      job.m_adaptive_budget = json_job.adaptive_budget;
+      job.m_adaptive_batch = std::max(1u, json_job.adaptive_batch);
+   }
    job.m_start_runs = json_job.start_runs;
+   job.m_start_schedule = json_job.start_schedule;
    job.m_J = json_job.J;
+   job.m_Lz = get_Lz(json_job, t.value());
+   if (job.m_Lz == 1)
+      job.m_spin_model = get_spin_model(json_job, t.value());
+   if (job.m_spin_model != SpinModel::Ising)
+      job.m_q = json_job.q;
+   const bool is_2d_ising = job.m_Lz == 1 && job.m_spin_model == SpinModel::Ising;
+   if (is_2d_ising)
+      job.m_geometry = get_geometry(json_job, job.m_Lx, job.m_Ly, t.value());
+   if (is_2d_ising && is_periodic_square(job.m_geometry)) {
+      job.m_couplings = get_couplings(json_job, job.m_Lx, job.m_Ly);
+      job.m_field = get_field(json_job, job.m_Lx, job.m_Ly, t.value());
+   }
+   job.m_protocol = get_protocol_mode(json_job, is_2d_ising, t.value());
+   if (job.m_protocol == TempProtocolMode::Images) {
+      std::optional<std::vector<LatticeDType>> images = get_protocol_images(json_job, job.m_Lx, job.m_Ly);
+      if (images.has_value()) {
+         job.m_protocol_images = std::move(images.value());
+      }
+      else {
+         magneto::get_logger()->error("Protocol images can't be read, ignoring the protocol.");
+         job.m_protocol = TempProtocolMode::None;
+      }
+   }
+   job.m_protocol_start = json_job.t_protocol_start;
+   job.m_batch_size = get_batch_size(json_job, job, t.value());
+   job.m_protocol_sweeps = std::max(1u, json_job.t_protocol_sweeps);
+   if (job.m_field) {
+      job.m_hysteresis_steps = json_job.hysteresis_steps;
+      job.m_hysteresis_field = json_job.hysteresis_field;
+      job.m_hysteresis_iterations = std::max(1u, json_job.hysteresis_iterations);
+   }
    job.m_image_mode = json_job.image_mode;
    job.m_physics_config = json_job.physics_config;
 
-   return { job, t.value() };
+   return std::make_tuple(job, t.value());
 }
 
 
@@ -237,24 +640,28 @@ std::optional<magneto::JsonJob> magneto::get_parsed_job(const std::filesystem::p
    return get_parsed_job(file_contents.value());
 }
 
+bool magneto::operator==(const ScheduleStep& a, const ScheduleStep& b) {
+   return std::tie(a.m_algorithm, a.m_n) == std::tie(b.m_algorithm, b.m_n);
+}
 bool magneto::operator==(const ImageMode& a, const ImageMode& b) {
-   return std::tie(a.m_fps, a.m_intervals, a.m_mode, a.m_path) ==
-      std::tie(b.m_fps, b.m_intervals, b.m_mode, b.m_path);
+   return std::tie(a.m_fps, a.m_intervals, a.m_mode, a.m_path, a.m_slice) ==
+      std::tie(b.m_fps, b.m_intervals, b.m_mode, b.m_path, b.m_slice);
 }
 bool magneto::operator==(const PhysicsConfig& a, const PhysicsConfig& b) {
-   return std::tie(a.m_outputfile, a.m_format) == std::tie(b.m_outputfile, b.m_format);
+   return std::tie(a.m_outputfile, a.m_format, a.m_correlation_path, a.m_structure_factor_path, a.m_correlation_stride, a.m_jackknife_bins, a.m_hysteresis_path, a.m_protocol_path) ==
+      std::tie(b.m_outputfile, b.m_format, b.m_correlation_path, b.m_structure_factor_path, b.m_correlation_stride, b.m_jackknife_bins, b.m_hysteresis_path, b.m_protocol_path);
 }
 
 
 bool magneto::operator==(const JsonJob& a, const JsonJob& b) {
    // use the std::tie trick for most
    if (std::tie(a.spin_start_mode, a.spin_start_image_path, a.temperature_image, a.temp_mode
-         , a.temp_steps, a.start_runs
-         , a.L, a.n, a.algorithm, a.image_mode, a.physics_config)
+         , a.temp_steps, a.adaptive_budget, a.adaptive_batch, a.start_runs, a.start_schedule
+         , a.L, a.Lx, a.Ly, a.Lz, a.J, a.spin_model, a.q, a.n, a.bond_mode, a.bond_path, a.bond_seed, a.lattice, a.J2, a.boundary_x, a.boundary_y, a.field_image, a.hysteresis_steps, a.hysteresis_iterations, a.t_protocol, a.t_protocol_sweeps, a.t_protocol_images, a.algorithm, a.schedule, a.auto_pilot_runs, a.pipeline_depth, a.batch_size, a.common_random_numbers, a.image_mode, a.physics_config)
       !=
-      std::tie(b.spin_start_mode, b.spin_start_image_path, a.temperature_image, b.temp_mode
-         , b.temp_steps, b.start_runs
-         , b.L, b.n, b.algorithm, b.image_mode, b.physics_config))
+      std::tie(b.spin_start_mode, b.spin_start_image_path, b.temperature_image, b.temp_mode
+         , b.temp_steps, b.adaptive_budget, b.adaptive_batch, b.start_runs, b.start_schedule
+         , b.L, b.Lx, b.Ly, b.Lz, b.J, b.spin_model, b.q, b.n, b.bond_mode, b.bond_path, b.bond_seed, b.lattice, b.J2, b.boundary_x, b.boundary_y, b.field_image, b.hysteresis_steps, b.hysteresis_iterations, b.t_protocol, b.t_protocol_sweeps, b.t_protocol_images, b.algorithm, b.schedule, b.auto_pilot_runs, b.pipeline_depth, b.batch_size, b.common_random_numbers, b.image_mode, b.physics_config))
    {
       return false;
    }
@@ -266,5 +673,13 @@ bool magneto::operator==(const JsonJob& a, const JsonJob& b) {
       return false;
    if (!(is_equal(a.t_max, b.t_max)))
       return false;
+   if (!(is_equal(a.antiferro_fraction, b.antiferro_fraction)))
+      return false;
+   if (!(is_equal(a.field, b.field)) || !(is_equal(a.field_min, b.field_min)) || !(is_equal(a.field_max, b.field_max)))
+      return false;
+   if (!(is_equal(a.t_protocol_start, b.t_protocol_start)))
+      return false;
+   if (!(is_equal(a.hysteresis_field, b.hysteresis_field)))
+      return false;
    return true;
 }
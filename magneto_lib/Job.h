@@ -7,13 +7,23 @@
 #include <filesystem>
 #include <variant>
 #include <optional>
+#include <memory>
 #include "types.h"
 
 
 namespace magneto {
-   enum class Algorithm { Metropolis, SW };
+   enum class Algorithm { Metropolis, SW, Multispin, Auto, Creutz, Kawasaki };
    enum class SpinStartMode { Random, Image };
-   enum class TempStartMode { Single, Many, Image };
+   enum class TempStartMode { Single, Many, Image, Normal, Adaptive };
+   enum class BondMode { Uniform, Random, File };
+   enum class SpinModel { Ising, Potts, Clock };
+   enum class TempProtocolMode { None, Linear, Exponential, Quench, Images };
+
+   /// <summary>One step of an update schedule: m_n runs of the algorithm</summary>
+   struct ScheduleStep {
+      Algorithm m_algorithm = Algorithm::Metropolis;
+      unsigned int m_n = 1;
+   };
 
    enum class ImageOrMovie { None, Endimage, Intervals, Movie };
    struct ImageMode {
@@ -21,11 +31,30 @@ namespace magneto {
       unsigned int m_intervals = 10;
       unsigned int m_fps = 30;
       std::filesystem::path m_path = "magneto_images";
+
+      // z index of the slice in images of three-dimensional systems, -1 for the middle one
+      int m_slice = -1;
    };
 
    struct PhysicsConfig {
       std::filesystem::path m_outputfile = "magneto_results.txt";
       std::string m_format = "T: {T:<5.3f},\tEnergy: {E:<5.3f},\tcv: {cv:<5.3f}, mag: {M:<5.3f}, chi: {chi:<5.3f}";
+
+      // The correlation function and structure factor are only measured if one of the paths is
+      // set. Measured every m_correlation_stride iterations.
+      std::filesystem::path m_correlation_path{};
+      std::filesystem::path m_structure_factor_path{};
+      unsigned int m_correlation_stride = 10;
+
+      // Number of bins for the jackknife error estimates
+      unsigned int m_jackknife_bins = 20;
+
+      // Hysteresis loops, one line per field step: temperature, field and mean magnetization
+      std::filesystem::path m_hysteresis_path = "magneto_hysteresis.txt";
+
+      // Temperature protocols, one line per sweep: final temperature (index of the image for
+      // image protocols), sweep, temperature (mean temperature), energy and magnetization
+      std::filesystem::path m_protocol_path = "magneto_protocol.txt";
    };
    
 
@@ -44,18 +73,100 @@ namespace magneto {
       // this only for many temps
       unsigned int temp_steps = 3;
 
+      // Adaptive temperatures: after the temp_steps coarse grid, adaptive_budget additional
+      // temperatures are placed around the peaks, adaptive_batch of them per refinement round
+      unsigned int adaptive_budget = 12;
+      unsigned int adaptive_batch = 4;
+
       // How many Swendsen-Wang runs before anything is being recorded/computed
       unsigned int start_runs = 0;
 
+      // Optional schedule for the start runs instead of Swendsen-Wang
+      std::vector<ScheduleStep> start_schedule;
+
       unsigned int L = 0;
       unsigned int Lx = 0;
       unsigned int Ly = 0;
+
+      // With Lz > 1 the system is three-dimensional. Those run on the flat layout with threaded
+      // metropolis or SW kernels on the periodic cubic lattice, and only support the options of
+      // plain temperature runs.
+      unsigned int Lz = 1;
       unsigned int n = 100;
       int J = 1;
 
+      // q-state Potts and clock models with 2 <= q <= 256. Those run metropolis or cluster updates
+      // (SW for the ferromagnetic Potts model, Wolff otherwise) on the periodic square lattice from
+      // random spins, without images and with the options of plain temperature runs.
+      SpinModel spin_model = SpinModel::Ising;
+      unsigned int q = 2;
+
+      // Couplings per bond. Uniform uses J for all bonds, Random gives bonds of J whose sign flips
+      // with probability antiferro_fraction (0.5 is a spin glass), File reads them from bond_path
+      // (see get_bond_couplings_from_file).
+      BondMode bond_mode = BondMode::Uniform;
+      std::filesystem::path bond_path;
+      unsigned int bond_seed = 0;
+      double antiferro_fraction = 0.5;
+
+      // Lattice geometry. J2 is the next-nearest neighbour coupling of "nnn" and the vertical
+      // coupling of "anisotropic". Other geometries than the square lattice only have metropolis
+      // and SW, and no bond couplings, fields or image temperatures.
+      LatticeGeometry lattice = LatticeGeometry::Square;
+      int J2 = 0;
+
+      // Boundary conditions per axis, see Boundary. Other than periodic boundaries are only
+      // available on the square lattice, with the same restrictions as other geometries.
+      Boundary boundary_x = Boundary::Periodic;
+      Boundary boundary_y = Boundary::Periodic;
+
+      // External field h. field_image adds a field per site, its gray values are mapped to
+      // [field_min, field_max] like the temperature image. Only supported by metropolis.
+      double field = 0.0;
+      std::filesystem::path field_image;
+      double field_min = -1.0;
+      double field_max = 1.0;
+
+      // Hysteresis loop: with hysteresis_steps > 0, a uniform field going from hysteresis_field
+      // down to -hysteresis_field and back up in hysteresis_steps steps per branch is added to the
+      // field. Every step runs hysteresis_iterations sweeps.
+      unsigned int hysteresis_steps = 0;
+      double hysteresis_field = 1.0;
+      unsigned int hysteresis_iterations = 10;
+
+      // Temperature protocol instead of the measurements: the start runs equilibrate at
+      // t_protocol_start, then the temperature goes to the temperature of the run in
+      // t_protocol_sweeps sweeps, linearly, exponentially or in one step as a quench. With image
+      // temperatures, "images" runs the t_protocol_images one after another and the temperature
+      // image last, all for the same share of the sweeps. They are mapped to [t_min, t_max].
+      TempProtocolMode t_protocol = TempProtocolMode::None;
+      double t_protocol_start = 5.0;
+      unsigned int t_protocol_sweeps = 100;
+      std::vector<std::filesystem::path> t_protocol_images;
+
       // Algorithm used for propagation (after the initial start runs)
       Algorithm algorithm = Algorithm::Metropolis;
 
+      // Optional update schedule, e.g. [{"alg":"SW","n":1},{"alg":"metropolis","n":5}]. One
+      // iteration runs all steps. Takes precedence over the algorithm.
+      std::vector<ScheduleStep> schedule;
+
+      // With the auto algorithm, every candidate is pilot-run for this many steps per temperature
+      unsigned int auto_pilot_runs = 200;
+
+      // All temperatures share one stream of Metropolis random numbers. Saves the generation and
+      // correlates the noise between temperatures, which smoothes derivatives in T.
+      bool common_random_numbers = false;
+
+      // Number of temperatures that are run as one batch of lattices in a single thread. Only for
+      // the Metropolis algorithm, meant for many small systems.
+      unsigned int batch_size = 1;
+
+      // Number of lattice snapshots that a separate thread measures and writes images of while the
+      // next sweeps run. 0 measures in between the sweeps. Worth it for expensive outputs such as
+      // correlations or images. Not used by batches and by Potts, clock or three-dimensional systems.
+      unsigned int pipeline_depth = 0;
+
       ImageMode image_mode;
 
       PhysicsConfig physics_config;
@@ -66,27 +177,64 @@ namespace magneto {
       // system start
       unsigned int m_Lx = 500;
       unsigned int m_Ly = 500;
+      unsigned int m_Lz = 1;
       int m_J = 1;
+
+      // Number of states for Potts and clock models
+      SpinModel m_spin_model = SpinModel::Ising;
+      unsigned int m_q = 2;
+
+      // Couplings per bond, nullptr if all bonds have m_J
+      std::shared_ptr<const BondCouplings> m_couplings;
+
+      // External field, nullptr if there is none
+      std::shared_ptr<const ExternalField> m_field;
+      Geometry m_geometry;
       //std::variant<LatticeDType, std::vector<double>> T;
       LatticeType initial_spins;
       unsigned int m_start_runs = 0;
+      std::vector<ScheduleStep> m_start_schedule;
 
       // system evolution
       Algorithm m_algorithm = Algorithm::Metropolis;
+      std::vector<ScheduleStep> m_schedule;
       unsigned int m_n = 100;
+      unsigned int m_batch_size = 1;
+      bool m_common_random_numbers = false;
+      unsigned int m_auto_pilot_runs = 200;
+      unsigned int m_pipeline_depth = 0;
+
+      // Additional temperatures of an adaptive temperature grid, 0 if not adaptive
+      unsigned int m_adaptive_budget = 0;
+      unsigned int m_adaptive_batch = 4;
+
+      // Temperature protocol, None without one. The images are only the protocol images, not
+      // the final temperatures.
+      TempProtocolMode m_protocol = TempProtocolMode::None;
+      double m_protocol_start = 5.0;
+      unsigned int m_protocol_sweeps = 100;
+      std::vector<LatticeDType> m_protocol_images;
+
+      // Field steps per branch of a hysteresis loop, 0 if there is no loop
+      unsigned int m_hysteresis_steps = 0;
+      double m_hysteresis_field = 1.0;
+      unsigned int m_hysteresis_iterations = 10;
 
       // output
       ImageMode m_image_mode;
       PhysicsConfig m_physics_config;
    };
 
+   CLASS_DECLSPEC bool operator==(const ScheduleStep& a, const ScheduleStep& b);
    CLASS_DECLSPEC bool operator==(const ImageMode& a, const ImageMode& b);
    CLASS_DECLSPEC bool operator==(const PhysicsConfig& a, const PhysicsConfig& b);
    CLASS_DECLSPEC bool operator==(const JsonJob& a, const JsonJob& b);
 
    void from_json(const nlohmann::json& j, magneto::JsonJob& job);
    CLASS_DECLSPEC JsonJob get_parsed_job(const std::string& file_contents);
-   CLASS_DECLSPEC std::tuple<Job, std::variant<LatticeDType, std::vector<double>>> get_job(const JsonJob& json_job);
+   /// <summary>Fails for jobs that can't run: without temperatures or with settings that
+   /// contradict each other</summary>
+   CLASS_DECLSPEC std::optional<std::tuple<Job, std::variant<LatticeDType, std::vector<double>>>> get_job(const JsonJob& json_job);
    CLASS_DECLSPEC std::optional<JsonJob> get_parsed_job(const std::filesystem::path& path);
 
 }
@@ -1,308 +1,849 @@
 #include "LatticeAlgorithms.h"
 #include "IsingSystem.h"
+#include "random_buffers.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <execution>
+#include <numeric>
+#include "logging.h"
 
-#include <sstream>
+template<int JSign, bool PowerOfTwo>
+magneto::Metropolis<JSign, PowerOfTwo>::Metropolis(
+   const int J, const double T, const int Lx, const int Ly, const int max_rng_threads /*= 2*/
+)
+   : m_lattice_index_buffer(std::make_shared<IndexStream>(LatticeIndexGetter(Lx*Ly, Lx, Ly), max_rng_threads))
+   , m_random_buffer(std::make_shared<UniformStream>(RandomBufferGetter(Lx*Ly), max_rng_threads))
+   , m_J(J)
+   , m_T(T)
+   , m_acceptance(get_field_acceptance_table(J, T, ExternalField()))
+{ }
 
-#include <deque>
-#include "logging.h"
 
-namespace {
+template<int JSign, bool PowerOfTwo>
+magneto::Metropolis<JSign, PowerOfTwo>::Metropolis(const int J, const double T, RandomStreams& streams)
+   : m_lattice_index_buffer(streams.get_lattice_indices())
+   , m_random_buffer(streams.get_uniforms())
+   , m_J(J)
+   , m_T(T)
+   , m_acceptance(get_field_acceptance_table(J, T, ExternalField()))
+{ }
+
+
+template<int JSign, bool PowerOfTwo>
+magneto::Metropolis<JSign, PowerOfTwo>::Metropolis(
+   const int J, const double T, const std::shared_ptr<CommonRandomSource>& common_randoms
+)
+   : m_common_randoms(common_randoms)
+   , m_J(J)
+   , m_T(T)
+   , m_acceptance(get_field_acceptance_table(J, T, ExternalField()))
+{ }
 
-   constexpr int get_exp_buffer_offset(int J) {
-      // std::abs is not constexpr :(
-      return J > 0 ? 8 * J : -8 * J;
+
+template<int JSign, bool PowerOfTwo>
+void magneto::Metropolis<JSign, PowerOfTwo>::run(LatticeType& lattice){
+   if (m_common_randoms) {
+      const std::shared_ptr<const SweepRandoms> randoms = m_common_randoms->get_sweep(m_sweep_count++);
+      sweep(lattice, randoms->indices, randoms->uniforms);
+      return;
    }
+   sweep(lattice, m_lattice_index_buffer->get_buffer(), m_random_buffer->get_buffer());
+   m_random_buffer->refill();
+   m_lattice_index_buffer->refill();
+}
+
+
+template<int JSign, bool PowerOfTwo>
+bool magneto::Metropolis<JSign, PowerOfTwo>::set_field(const ExternalField& field) {
+   m_field = field;
+   m_field_levels = field.levels;
+   m_acceptance = get_field_acceptance_table(m_J, m_T, m_field);
+   return true;
+}
+
 
-   std::string thread_id_to_string(const std::thread::id& id) {
-      std::stringstream ss;
-      ss << id;
-      return ss.str();
+template<int JSign, bool PowerOfTwo>
+bool magneto::Metropolis<JSign, PowerOfTwo>::set_temperature(const double T) {
+   if (T != m_T) {
+      m_T = T;
+      m_acceptance = get_field_acceptance_table(m_J, m_T, m_field);
    }
+   return true;
+}
+
+
+template<int JSign, bool PowerOfTwo>
+void magneto::Metropolis<JSign, PowerOfTwo>::sweep(
+   LatticeType& lattice, const IndexPairVector& indices, const std::vector<double>& randoms
+) const {
+   if (m_field_levels)
+      sweep_levels<true>(lattice, indices, randoms);
+   else
+      sweep_levels<false>(lattice, indices, randoms);
+}
+
+
+template<int JSign, bool PowerOfTwo>
+template<bool SiteField>
+void magneto::Metropolis<JSign, PowerOfTwo>::sweep_levels(
+   LatticeType& lattice, const IndexPairVector& indices, const std::vector<double>& randoms
+) const {
+   const auto [Lx, Ly] = get_dimensions_of_lattice(lattice);
+   const PeriodicWrap<PowerOfTwo> wrap_x(Lx);
+   const PeriodicWrap<PowerOfTwo> wrap_y(Ly);
+   const unsigned char* levels = SiteField ? m_field_levels->data() : nullptr;
+   for (size_t step = 0; step < randoms.size(); ++step) {
+      const auto [i, j] = indices[step];
+      std::vector<char>& row = lattice[i];
+      const int neighbour_sum = row[wrap_x.next(j)] + row[wrap_x.previous(j)]
+         + lattice[wrap_y.next(i)][j] + lattice[wrap_y.previous(i)][j];
+      // k is one of -4, -2, 0, 2, 4
+      const int k = JSign * row[j] * neighbour_sum;
+      const size_t level = SiteField ? levels[i * Lx + j] : 0;
+      if (randoms[step] < m_acceptance[get_field_acceptance_index(level, row[j], k)])
+         row[j] = -row[j];
+   }
+}
 
-   struct RandomBufferGetter {
-      RandomBufferGetter(const size_t buffer_size) : m_buffer_size(buffer_size) {};
-      std::vector<double> operator()(){
-         const std::string thread_id = thread_id_to_string(std::this_thread::get_id());
-         unsigned int seed = static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count());
-         std::mt19937_64 rng(seed);
-         std::uniform_real_distribution <double > dist_one(0.0, 1.0);
-         std::vector<double> normal_random_vector;
-         normal_random_vector.reserve(m_buffer_size);
-         for (int i = 0; i < m_buffer_size; ++i)
-            normal_random_vector.emplace_back(dist_one(rng));
-         magneto::get_logger()->debug("get_random_buffer() done from thread {}", thread_id);
-         return normal_random_vector;
-      }
-      size_t m_buffer_size;
-   };
 
+namespace {
 
-   struct LatticeIndexGetter {
-      LatticeIndexGetter(const size_t buffer_size, const int Lx, const int Ly) : m_buffer_size(buffer_size), m_Lx(Lx), m_Ly(Ly) {};
-      magneto::IndexPairVector operator()() {
-         const std::string thread_id = thread_id_to_string(std::this_thread::get_id());
-         unsigned int seed = static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count());
-         std::mt19937_64 rng(seed);
-         std::uniform_int_distribution<> dist_lattice_i(0, m_Ly - 1);
-         std::uniform_int_distribution<> dist_lattice_j(0, m_Lx - 1);
-         magneto::IndexPairVector indices;
-         indices.reserve(m_buffer_size);
-         for (int i = 0; i < m_buffer_size; ++i)
-            indices.emplace_back(dist_lattice_i(rng), dist_lattice_j(rng));
-         magneto::get_logger()->debug("get_lattice_indices() done from thread {}", thread_id);
-         return indices;
+   std::vector<double> get_site_acceptance_probabilities(const int J, const magneto::LatticeDType& T) {
+      std::vector<double> probabilities;
+      for (const std::vector<double>& row : T) {
+         for (const double site_T : row) {
+            const std::array<double, 2> site_probabilities = magneto::get_acceptance_probabilities(J, site_T);
+            probabilities.insert(std::end(probabilities), std::cbegin(site_probabilities), std::cend(site_probabilities));
+         }
       }
-      size_t m_buffer_size;
-      int m_Lx;
-      int m_Ly;
-   };
+      return probabilities;
+   }
 
 } // namespace {}
 
 
-magneto::Metropolis::Metropolis(const int J, const double T, const int Lx, const int Ly, const int max_rng_threads)
-   : m_cached_exp_values(get_cached_exp_values(J, T))
+template<int JSign, bool PowerOfTwo>
+magneto::VariableMetropolis<JSign, PowerOfTwo>::VariableMetropolis(
+   const int J, const LatticeDType& T, const int Lx, const int Ly, const int max_rng_threads /*= 2*/
+)
+   : m_lattice_index_buffer(std::make_shared<IndexStream>(LatticeIndexGetter(Lx*Ly, Lx, Ly), max_rng_threads))
+   , m_random_buffer(std::make_shared<UniformStream>(RandomBufferGetter(Lx*Ly), max_rng_threads))
    , m_J(J)
-   , m_lattice_index_buffer(LatticeIndexGetter(Lx*Ly, Lx, Ly), max_rng_threads)
-   , m_random_buffer(RandomBufferGetter(Lx*Ly), max_rng_threads)
+   , m_T(T)
+   , m_acceptance(get_site_acceptance_probabilities(J, T))
 { }
 
 
-magneto::VariableMetropolis::VariableMetropolis(
-   const int J, const LatticeDType& T, const int Lx, const int Ly, const int max_rng_threads /*= 2*/
-)
-   : m_J(J)
-   , m_lattice_index_buffer(LatticeIndexGetter(Lx*Ly, Lx, Ly), max_rng_threads)
-   , m_random_buffer(RandomBufferGetter(Lx*Ly), max_rng_threads)
+template<int JSign, bool PowerOfTwo>
+magneto::VariableMetropolis<JSign, PowerOfTwo>::VariableMetropolis(const int J, const LatticeDType& T, RandomStreams& streams)
+   : m_lattice_index_buffer(streams.get_lattice_indices())
+   , m_random_buffer(streams.get_uniforms())
+   , m_J(J)
    , m_T(T)
+   , m_acceptance(get_site_acceptance_probabilities(J, T))
 { }
 
 
-void magneto::VariableMetropolis::run(LatticeType& lattice){
-   int flip_i, flip_j;
-   int dE;
-   for (int i = 0; i < m_random_buffer.get_buffer().size(); ++i) {
-      flip_i = m_lattice_index_buffer.get_buffer()[i].first;
-      flip_j = m_lattice_index_buffer.get_buffer()[i].second;
-      dE = m_J * get_dE(lattice, flip_i, flip_j);
-      const double exp_value = exp(-dE / m_T[flip_i][flip_j]);
-      if (dE <= 0 || (m_random_buffer.get_buffer()[i] < exp_value))
-         lattice[flip_i][flip_j] *= -1;
+template<int JSign, bool PowerOfTwo>
+void magneto::VariableMetropolis<JSign, PowerOfTwo>::run(LatticeType& lattice){
+   const auto [Lx, Ly] = get_dimensions_of_lattice(lattice);
+   const PeriodicWrap<PowerOfTwo> wrap_x(Lx);
+   const PeriodicWrap<PowerOfTwo> wrap_y(Ly);
+   const IndexPairVector& indices = m_lattice_index_buffer->get_buffer();
+   const std::vector<double>& randoms = m_random_buffer->get_buffer();
+   for (size_t step = 0; step < randoms.size(); ++step) {
+      const auto [i, j] = indices[step];
+      std::vector<char>& row = lattice[i];
+      const int neighbour_sum = row[wrap_x.next(j)] + row[wrap_x.previous(j)]
+         + lattice[wrap_y.next(i)][j] + lattice[wrap_y.previous(i)][j];
+      const int k = JSign * row[j] * neighbour_sum;
+      if (k <= 0 || randoms[step] < m_acceptance[2 * (i * Lx + j) + (k >> 2)])
+         row[j] = -row[j];
    }
 
-   m_random_buffer.refill();
-   m_lattice_index_buffer.refill();
+   m_random_buffer->refill();
+   m_lattice_index_buffer->refill();
 }
 
-void magneto::Metropolis::run(LatticeType& lattice){
-   const int buffer_offset = get_exp_buffer_offset(m_J);
-   int flip_i, flip_j;
-   int dE;
-   for (int i = 0; i < m_random_buffer.get_buffer().size(); ++i) {
-      flip_i = m_lattice_index_buffer.get_buffer()[i].first;
-      flip_j = m_lattice_index_buffer.get_buffer()[i].second;
-      dE = m_J * get_dE(lattice, flip_i, flip_j);
-      if (dE <= 0 || (m_random_buffer.get_buffer()[i] < m_cached_exp_values[dE + buffer_offset]))
-         lattice[flip_i][flip_j] *= -1;
+
+template<int JSign, bool PowerOfTwo>
+bool magneto::VariableMetropolis<JSign, PowerOfTwo>::set_temperatures(const LatticeDType& T) {
+   const auto [Lx, Ly] = get_dimensions_of_lattice(m_T);
+   if (get_dimensions_of_lattice(T) != std::make_pair(Lx, Ly))
+      return false;
+   for (unsigned int i = 0; i < Ly; ++i) {
+      for (unsigned int j = 0; j < Lx; ++j) {
+         if (T[i][j] == m_T[i][j])
+            continue;
+         m_T[i][j] = T[i][j];
+         const std::array<double, 2> site_probabilities = get_acceptance_probabilities(m_J, T[i][j]);
+         std::copy(std::cbegin(site_probabilities), std::cend(site_probabilities), &m_acceptance[2 * (i * Lx + j)]);
+      }
    }
+   return true;
+}
+
 
-   m_random_buffer.refill();
-   m_lattice_index_buffer.refill();
+std::array<double, 2> magneto::get_acceptance_probabilities(const int J, const double T) {
+   return { exp(-4.0 * std::abs(J) / T), exp(-8.0 * std::abs(J) / T) };
 }
 
 
-std::vector<double> magneto::get_cached_exp_values(const int J, const double T) {
-   std::vector<double> exp_values;
-   const int min_value = -8 * J;
-   const int max_value = 8 * J;
-   const int value_count = max_value - min_value + 1;
-   const int buffer_offset = get_exp_buffer_offset(J);
-   for (int dE = 0; dE < value_count; ++dE)
-      exp_values.push_back(exp(-(dE - buffer_offset) / T));
-   return exp_values;
+std::vector<double> magneto::get_field_acceptance_table(const int J, const double T, const ExternalField& field) {
+   const size_t level_count = std::max<size_t>(1, field.level_values.size());
+   std::vector<double> table(10 * level_count);
+   for (size_t level = 0; level < level_count; ++level) {
+      const double h = field.h + (field.level_values.empty() ? 0.0 : field.level_values[level]);
+      for (const char spin : { -1, 1 }) {
+         for (int k = -4; k <= 4; k += 2) {
+            const double dE = 2.0 * std::abs(J) * k + 2.0 * h * spin;
+            table[get_field_acceptance_index(level, spin, k)] = dE <= 0.0 ? 1.0 : exp(-dE / T);
+         }
+      }
+   }
+   return table;
 }
 
 
+namespace {
+
+   // Freeze probabilities below this skip geometrically over the aligned bonds, above it every
+   // aligned bond draws its own number because most of them freeze anyway
+   constexpr double geometric_skip_limit = 0.5;
+
+
+   /// <summary>Reads the uniforms of a stream one by one across buffers. A buffer that was started
+   /// is dropped when the reader goes out of scope.</summary>
+   class UniformReader {
+   public:
+      UniformReader(magneto::UniformStream& stream)
+         : m_stream(stream)
+         , m_buffer(&stream.get_buffer())
+      { }
+
+      ~UniformReader() {
+         if (m_position > 0)
+            m_stream.refill();
+      }
+
+      double next() {
+         if (m_position == m_buffer->size()) {
+            m_stream.refill();
+            m_buffer = &m_stream.get_buffer();
+            m_position = 0;
+         }
+         return (*m_buffer)[m_position++];
+      }
+
+      /// <summary>Uniform integer in [0,2^32)</summary>
+      uint32_t next_uint32() {
+         return static_cast<uint32_t>(next() * 4294967296.0);
+      }
+
+      /// <summary>Fair coin, one uniform gives 32 of them</summary>
+      bool next_coin() {
+         if (m_coin_count == 0) {
+            m_coins = next_uint32();
+            m_coin_count = 32;
+         }
+         const bool coin = m_coins & 1;
+         m_coins >>= 1;
+         --m_coin_count;
+         return coin;
+      }
+
+   private:
+      magneto::UniformStream& m_stream;
+      const std::vector<double>* m_buffer;
+      size_t m_position = 0;
+      uint32_t m_coins = 0;
+      int m_coin_count = 0;
+   };
+
+
+   /// <summary>Freezes aligned bonds with the same probability p. Instead of one uniform per bond
+   /// it draws the geometrically distributed number of bonds that stay open until the next frozen
+   /// one.</summary>
+   class GeometricBondSampler {
+   public:
+      GeometricBondSampler(UniformReader& reader, const double p)
+         : m_reader(reader)
+         , m_log_open(std::log1p(-p))
+         , m_skip(draw_skip())
+      { }
+
+      bool operator()(const int /*site*/) {
+         if (m_skip > 0) {
+            --m_skip;
+            return false;
+         }
+         m_skip = draw_skip();
+         return true;
+      }
+
+   private:
+      long long draw_skip() {
+         const double skip = std::floor(std::log1p(-m_reader.next()) / m_log_open);
+         return static_cast<long long>(std::min(skip, 1e18));
+      }
+
+      UniformReader& m_reader;
+      double m_log_open;
+      long long m_skip;
+   };
+
+
+   /// <summary>One Swendsen-Wang step. is_frozen(site) decides on the bonds to the right and down
+   /// of a site and is only asked for aligned spins, where a bond can form. Every cluster flips
+   /// with a fair coin.</summary>
+   template<class TIsFrozen>
+   void run_sw_step(
+      magneto::LatticeType& lattice,
+      UniformReader& reader,
+      magneto::ClusterScratch& scratch,
+      magneto::ClusterStatisticsAccumulator& cluster_statistics,
+      TIsFrozen&& is_frozen
+   ) {
+      const auto [Lx_u, Ly_u] = magneto::get_dimensions_of_lattice(lattice);
+      const int Lx = static_cast<int>(Lx_u);
+      const int Ly = static_cast<int>(Ly_u);
+      const int N = Lx * Ly;
+      scratch.start_run(N);
+
+      // Bit 0 freezes the bond to the right, bit 1 the bond down
+      for (const int bond : { 0, 1 }) {
+         for (int i = 0; i < Ly; ++i) {
+            const std::vector<char>& row = lattice[i];
+            const std::vector<char>& neighbour_row = bond == 0 ? row : lattice[i + 1 == Ly ? 0 : i + 1];
+            for (int j = 0; j < Lx; ++j) {
+               const int site = i * Lx + j;
+               const char neighbour = neighbour_row[bond == 0 && j + 1 == Lx ? 0 : j + 1 - bond];
+               const unsigned char frozen = row[j] == neighbour && is_frozen(site);
+               if (bond == 0)
+                  scratch.set_frozen(site, frozen);
+               else
+                  scratch.add_frozen(site, frozen << 1);
+            }
+         }
+      }
+
+      // Grow and flip the clusters. Bonds are fixed, so flipping during the search is fine.
+      cluster_statistics.clear();
+      for (int start = 0; start < N; ++start) {
+         if (scratch.is_discovered(start))
+            continue;
+         const bool flip_cluster = reader.next_coin();
+         scratch.discover(start);
+         while (scratch.has_next()) {
+            const int site = scratch.pop();
+            const int i = site / Lx;
+            const int j = site - i * Lx;
+            const int right = j + 1 == Lx ? site + 1 - Lx : site + 1;
+            const int left = j == 0 ? site + Lx - 1 : site - 1;
+            const int down = i + 1 == Ly ? j : site + Lx;
+            const int up = i == 0 ? site + N - Lx : site - Lx;
+            if (scratch.is_frozen(site, 0) && !scratch.is_discovered(right))
+               scratch.discover(right);
+            if (scratch.is_frozen(left, 0) && !scratch.is_discovered(left))
+               scratch.discover(left);
+            if (scratch.is_frozen(site, 1) && !scratch.is_discovered(down))
+               scratch.discover(down);
+            if (scratch.is_frozen(up, 1) && !scratch.is_discovered(up))
+               scratch.discover(up);
+            if (flip_cluster)
+               lattice[i][j] = -lattice[i][j];
+            cluster_statistics.add_site(i, j);
+         }
+         cluster_statistics.end_cluster(lattice[start / Lx][start % Lx]);
+      }
+   }
+
+} // namespace {}
+
+
+template class CLASS_DECLSPEC magneto::Metropolis<1, true>;
+template class CLASS_DECLSPEC magneto::Metropolis<1, false>;
+template class CLASS_DECLSPEC magneto::Metropolis<-1, true>;
+template class CLASS_DECLSPEC magneto::Metropolis<-1, false>;
+template class CLASS_DECLSPEC magneto::VariableMetropolis<1, true>;
+template class CLASS_DECLSPEC magneto::VariableMetropolis<1, false>;
+template class CLASS_DECLSPEC magneto::VariableMetropolis<-1, true>;
+template class CLASS_DECLSPEC magneto::VariableMetropolis<-1, false>;
+
+
 magneto::SW::SW(const int J, const double T, const int Lx, const int Ly, const int max_rng_threads)
-   : m_J(J)
+   : m_random_buffer(std::make_shared<UniformStream>(RandomBufferGetter(Lx*Ly), max_rng_threads))
+   , m_cluster_statistics(Lx, Ly)
+   , m_J(J)
+   , m_T(T)
+{ }
+
+
+magneto::SW::SW(const int J, const double T, RandomStreams& streams)
+   : m_random_buffer(streams.get_cluster_uniforms())
+   , m_cluster_statistics(streams.get_Lx(), streams.get_Ly())
+   , m_J(J)
    , m_T(T)
-   , m_bond_north_buffer(RandomBufferGetter(Lx*Ly), max_rng_threads)
-   , m_bond_east_buffer(RandomBufferGetter(Lx*Ly), max_rng_threads)
-   , m_flip_buffer(RandomBufferGetter(Lx*Ly), max_rng_threads)
 { }
 
 
 void magneto::SW::run(LatticeType& lattice){
-   const double freezeProbability = 1.0 - exp(-2.0f * m_J / m_T);
+   const double freeze_probability = 1.0 - exp(-2.0f * m_J / m_T);
+   UniformReader reader(*m_random_buffer);
+   if (freeze_probability <= 0.0) {
+      run_sw_step(lattice, reader, m_scratch, m_cluster_statistics, [](const int /*site*/) {return false; });
+   }
+   else if (freeze_probability < geometric_skip_limit) {
+      run_sw_step(lattice, reader, m_scratch, m_cluster_statistics, GeometricBondSampler(reader, freeze_probability));
+   }
+   else {
+      run_sw_step(lattice, reader, m_scratch, m_cluster_statistics, [&](const int /*site*/) {
+         return reader.next() < freeze_probability;
+      });
+   }
+   m_has_run = true;
+}
 
-   LatticeType discovered;
-   LatticeType doesBondNorth;
-   LatticeType doesBondEast;
 
-   //const int L = static_cast<int>(lattice.size());
-   bool flipCluster;
-   int deq_i, deq_j, deq_i_adj, deq_j_adj;
-   const auto [Lx, Ly] = get_dimensions_of_lattice(lattice);
-   discovered.assign(Ly, std::vector<char>(Lx, 0));
-   doesBondNorth.assign(Ly, std::vector<char>(Lx, 0));
-   doesBondEast.assign(Ly, std::vector<char>(Lx, 0));
+std::optional<magneto::ClusterStatistics> magneto::SW::get_cluster_statistics() const {
+   if (!m_has_run)
+      return std::nullopt;
+   return m_cluster_statistics.get_statistics();
+}
 
-   int counter = 0;
-   for (unsigned int i = 0; i < Ly; ++i) {
-      for (unsigned int j = 0; j < Lx; ++j) {
-         doesBondNorth[i][j] = m_bond_north_buffer.get_buffer()[counter] < freezeProbability;
-         doesBondEast[i][j] = m_bond_east_buffer.get_buffer()[counter] < freezeProbability;
-         ++counter;
-      }
+
+bool magneto::SW::set_temperature(const double T) {
+   // The freeze probability is computed every run
+   m_T = T;
+   return true;
+}
+
+
+namespace {
+
+   // Temperature images have 8 bit pixels, so they never exceed the levels of a byte
+   constexpr size_t max_temperature_levels = 256;
+
+
+   /// <summary>Freeze probability as a threshold for uniform integers in [0,2^32)</summary>
+   uint32_t get_freeze_threshold(const int J, const double T) {
+      const double p = 1.0 - exp(-2.0f * J / T);
+      if (p <= 0.0)
+         return 0;
+      return static_cast<uint32_t>(std::min(p * 4294967296.0, 4294967295.0));
    }
 
-   counter = 0;
-   for (unsigned int i = 0; i < Ly; ++i) {
-      for (unsigned int j = 0; j < Lx; ++j) {
-         if (!discovered[i][j]) {
-            flipCluster = m_flip_buffer.get_buffer()[counter] < 0.5;
-            std::deque<std::tuple<int, int>> deq(1, std::make_tuple(i, j));
-            discovered[i][j] = 1;
-
-            while (!deq.empty()) {
-               deq_i = std::get<0>(deq.front());
-               deq_j = std::get<1>(deq.front());
-
-               deq_i_adj = deq_i;
-               deq_j_adj = (deq_j + 1) % Lx;
-               if (lattice[deq_i][deq_j] == lattice[deq_i_adj][deq_j_adj] && discovered[deq_i_adj][deq_j_adj] == 0 && doesBondNorth[deq_i][deq_j]) {
-                  deq.push_back(std::make_tuple(deq_i_adj, deq_j_adj));
-                  discovered[deq_i_adj][deq_j_adj] = 1;
-               }
-
-               deq_i_adj = (deq_i + 1) % Ly;
-               deq_j_adj = deq_j;
-               if (lattice[deq_i][deq_j] == lattice[deq_i_adj][deq_j_adj] && discovered[deq_i_adj][deq_j_adj] == 0 && doesBondEast[deq_i][deq_j]) {
-                  deq.push_back(std::make_tuple(deq_i_adj, deq_j_adj));
-                  discovered[deq_i_adj][deq_j_adj] = 1;
-               }
-
-               deq_i_adj = deq_i;
-               deq_j_adj = (deq_j - 1 + Lx) % Lx;
-               if (lattice[deq_i][deq_j] == lattice[deq_i_adj][deq_j_adj] && discovered[deq_i_adj][deq_j_adj] == 0 && doesBondNorth[deq_i][deq_j_adj]) {
-                  deq.push_back(std::make_tuple(deq_i_adj, deq_j_adj));
-                  discovered[deq_i_adj][deq_j_adj] = 1;
-               }
-
-               deq_i_adj = (deq_i - 1 + Ly) % Ly;
-               deq_j_adj = deq_j;
-               if (lattice[deq_i][deq_j] == lattice[deq_i_adj][deq_j_adj] && discovered[deq_i_adj][deq_j_adj] == 0 && doesBondEast[deq_i_adj][deq_j]) {
-                  deq.push_back(std::make_tuple(deq_i_adj, deq_j_adj));
-                  discovered[deq_i_adj][deq_j_adj] = 1;
-               }
-
-               if (flipCluster)
-                  lattice[deq_i][deq_j] *= -1;
-               deq.pop_front();
-            }
+
+   /// <summary>Temperature of each level. With more distinct temperatures than levels they are
+   /// rounded to levels evenly spaced between the lowest and highest one.</summary>
+   std::vector<double> get_temperature_levels(const magneto::LatticeDType& T) {
+      std::vector<double> temps;
+      for (const std::vector<double>& row : T)
+         temps.insert(std::end(temps), std::cbegin(row), std::cend(row));
+      std::sort(std::begin(temps), std::end(temps));
+      temps.erase(std::unique(std::begin(temps), std::end(temps)), std::end(temps));
+      if (temps.size() <= max_temperature_levels)
+         return temps;
+
+      magneto::get_logger()->warn(
+         "The temperatures have {} distinct values, rounding them to {} levels", temps.size(), max_temperature_levels
+      );
+      std::vector<double> levels(max_temperature_levels);
+      for (size_t level = 0; level < max_temperature_levels; ++level)
+         levels[level] = temps.front() + level * (temps.back() - temps.front()) / (max_temperature_levels - 1);
+      return levels;
+   }
+
+
+   /// <summary>Row-major level of every site, the nearest one of the sorted level temperatures</summary>
+   std::vector<unsigned char> get_site_levels(const magneto::LatticeDType& T, const std::vector<double>& level_temps) {
+      std::vector<unsigned char> levels;
+      for (const std::vector<double>& row : T) {
+         for (const double temp : row) {
+            const auto above = std::lower_bound(std::cbegin(level_temps), std::cend(level_temps), temp);
+            size_t level = above - std::cbegin(level_temps);
+            if (above == std::cend(level_temps) || (level > 0 && temp - level_temps[level - 1] < *above - temp))
+               --level;
+            levels.emplace_back(static_cast<unsigned char>(level));
          }
-         ++counter;
       }
+      return levels;
    }
 
-   m_bond_north_buffer.refill();
-   m_bond_east_buffer.refill();
-   m_flip_buffer.refill();
+} // namespace {}
+
+
+magneto::VariableSW::VariableSW(const int J, const LatticeDType& T, const int Lx, const int Ly, const int max_rng_threads)
+   : m_random_buffer(std::make_shared<UniformStream>(RandomBufferGetter(Lx*Ly), max_rng_threads))
+   , m_cluster_statistics(Lx, Ly)
+   , m_J(J)
+{
+   set_temperatures(T);
 }
 
 
-magneto::LatticeDType get_freeze_probability(const int Lx, const int Ly, const int J, const magneto::LatticeDType& temps) {
-   magneto::LatticeDType probabilities(Ly, std::vector<double>(Lx));
-   for (int i = 0; i < Ly; ++i) {
-      for (int j = 0; j < Lx; ++j) {
-         probabilities[i][j] = 1.0 - exp(-2.0f * J / temps[i][j]);
+magneto::VariableSW::VariableSW(const int J, const LatticeDType& T, RandomStreams& streams)
+   : m_random_buffer(streams.get_cluster_uniforms())
+   , m_cluster_statistics(streams.get_Lx(), streams.get_Ly())
+   , m_J(J)
+{
+   set_temperatures(T);
+}
+
+
+void magneto::VariableSW::run(LatticeType& lattice) {
+   UniformReader reader(*m_random_buffer);
+   run_sw_step(lattice, reader, m_scratch, m_cluster_statistics, [&](const int site) {
+      return reader.next_uint32() < m_thresholds[m_levels[site]];
+   });
+   m_has_run = true;
+}
+
+
+std::optional<magneto::ClusterStatistics> magneto::VariableSW::get_cluster_statistics() const {
+   if (!m_has_run)
+      return std::nullopt;
+   return m_cluster_statistics.get_statistics();
+}
+
+
+bool magneto::VariableSW::set_temperatures(const LatticeDType& T) {
+   const auto [Lx, Ly] = get_dimensions_of_lattice(T);
+   if (!m_T.empty() && get_dimensions_of_lattice(m_T) != std::make_pair(Lx, Ly))
+      return false;
+
+   bool has_new_temperature = m_T.empty();
+   for (unsigned int i = 0; i < Ly && !has_new_temperature; ++i) {
+      for (unsigned int j = 0; j < Lx; ++j) {
+         if (T[i][j] == m_T[i][j])
+            continue;
+         const auto level = std::lower_bound(std::cbegin(m_level_temps), std::cend(m_level_temps), T[i][j]);
+         if (level == std::cend(m_level_temps) || *level != T[i][j]) {
+            has_new_temperature = true;
+            break;
+         }
+         m_levels[i * Lx + j] = static_cast<unsigned char>(level - std::cbegin(m_level_temps));
+         m_T[i][j] = T[i][j];
       }
    }
-   return probabilities;
+   if (!has_new_temperature)
+      return true;
+
+   m_T = T;
+   m_level_temps = get_temperature_levels(T);
+   m_levels = get_site_levels(T, m_level_temps);
+   m_thresholds.clear();
+   for (const double level_temp : m_level_temps)
+      m_thresholds.emplace_back(get_freeze_threshold(m_J, level_temp));
+   return true;
 }
 
 
-magneto::VariableSW::VariableSW(const int J, const LatticeDType& T, const int Lx, const int Ly, const int max_rng_threads)
+namespace {
+
+   // Row-parallel algorithms only use threads from this lattice size on
+   constexpr unsigned int parallel_row_threshold = 1 << 16;
+
+
+   std::mt19937 get_time_seeded_rng() {
+      return std::mt19937(static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count()));
+   }
+
+
+   int get_initial_demon_quanta(const int J, const double T) {
+      // Mean of the geometric distribution with quantum 4|J|
+      const double quantum = 4.0 * std::abs(J);
+      if (quantum == 0.0)
+         return 0;
+      const double mean_quanta = 1.0 / std::expm1(quantum / T);
+      return std::min(magneto::CreutzDemon::max_demon_quanta, static_cast<int>(std::lround(mean_quanta)));
+   }
+
+
+   /// <summary>Rows that can be swept at the same time. With an odd number of rows, the first and
+   /// the last row are neighbours, so the last row gets a phase of its own.</summary>
+   std::vector<std::vector<int>> get_row_phases(const int Ly) {
+      std::vector<std::vector<int>> phases(Ly % 2 == 0 ? 2 : 3);
+      for (int i = 0; i < Ly; ++i) {
+         if (Ly % 2 == 1 && i == Ly - 1)
+            phases[2].emplace_back(i);
+         else
+            phases[i % 2].emplace_back(i);
+      }
+      return phases;
+   }
+
+} // namespace {}
+
+
+magneto::CreutzDemon::CreutzDemon(const int J, const double T, const int /*Lx*/, const int Ly)
    : m_J(J)
-   , m_bond_north_buffer(RandomBufferGetter(Lx*Ly), max_rng_threads)
-   , m_bond_east_buffer(RandomBufferGetter(Lx*Ly), max_rng_threads)
-   , m_flip_buffer(RandomBufferGetter(Lx*Ly), max_rng_threads)
-   , m_freeze_probability(get_freeze_probability(Lx, Ly, J, T))
+   , m_demons(Ly, get_initial_demon_quanta(J, T))
+   , m_start_columns(Ly, 0)
+   , m_row_phases(get_row_phases(Ly))
+   , m_histogram(max_demon_quanta + 1, 0)
+   , m_rng(get_time_seeded_rng())
 { }
 
 
-void magneto::VariableSW::run(LatticeType& lattice) {
-   LatticeType discovered;
-   LatticeType doesBondNorth;
-   LatticeType doesBondEast;
-
-   bool flipCluster;
+void magneto::CreutzDemon::run(LatticeType& lattice) {
    const auto [Lx, Ly] = get_dimensions_of_lattice(lattice);
-   int deq_i, deq_j, deq_i_adj, deq_j_adj;
-   discovered.assign(Ly, std::vector<char>(Lx, 0));
-   doesBondNorth.assign(Ly, std::vector<char>(Lx, 0));
-   doesBondEast.assign(Ly, std::vector<char>(Lx, 0));
+   std::uniform_int_distribution<int> dist_column(0, Lx - 1);
+   for (int& start_column : m_start_columns)
+      start_column = dist_column(m_rng);
+
+   const auto row_fun = [&](const int i) {sweep_row(lattice, i); };
+   for (const std::vector<int>& rows : m_row_phases) {
+      if (Lx * Ly >= parallel_row_threshold)
+         std::for_each(std::execution::par, std::cbegin(rows), std::cend(rows), row_fun);
+      else
+         std::for_each(std::cbegin(rows), std::cend(rows), row_fun);
+   }
 
-   int counter = 0;
-   for (unsigned int i = 0; i < Ly; ++i) {
-      for (unsigned int j = 0; j < Lx; ++j) {
-         doesBondNorth[i][j] = m_bond_north_buffer.get_buffer()[counter] < m_freeze_probability[i][j];
-         doesBondEast[i][j] = m_bond_east_buffer.get_buffer()[counter] < m_freeze_probability[i][j];
-         ++counter;
+   for (const int demon : m_demons)
+      ++m_histogram[demon];
+}
+
+
+void magneto::CreutzDemon::sweep_row(LatticeType& lattice, const int i) {
+   const int Lx = static_cast<int>(lattice[i].size());
+   const int Ly = static_cast<int>(lattice.size());
+   std::vector<char>& row = lattice[i];
+   const std::vector<char>& up = lattice[i == 0 ? Ly - 1 : i - 1];
+   const std::vector<char>& down = lattice[i + 1 == Ly ? 0 : i + 1];
+   const int J_sign = m_J < 0 ? -1 : 1;
+
+   // Rows and their demons are only touched by one thread
+   int& demon = m_demons[i];
+   int j = m_start_columns[i];
+   for (int step = 0; step < Lx; ++step) {
+      const int left = j == 0 ? Lx - 1 : j - 1;
+      const int right = j + 1 == Lx ? 0 : j + 1;
+      // dE = 2J*s*(neighbour sum) in quanta of 4|J|
+      const int quanta = J_sign * row[j] * (row[left] + row[right] + up[j] + down[j]) / 2;
+      const int new_demon = demon - quanta;
+      if (new_demon >= 0 && new_demon <= max_demon_quanta) {
+         row[j] = -row[j];
+         demon = new_demon;
       }
+      j = right;
    }
+}
 
-   counter = 0;
-   for (unsigned int i = 0; i < Ly; ++i) {
-      for (unsigned int j = 0; j < Lx; ++j) {
-         if (!discovered[i][j]) {
-            flipCluster = m_flip_buffer.get_buffer()[counter] < 0.5;
-            std::deque<std::tuple<int, int>> deq(1, std::make_tuple(i, j));
-            discovered[i][j] = 1;
-
-            while (!deq.empty()) {
-               deq_i = std::get<0>(deq.front());
-               deq_j = std::get<1>(deq.front());
-
-               deq_i_adj = deq_i;
-               deq_j_adj = (deq_j + 1) % Lx;
-               if (lattice[deq_i][deq_j] == lattice[deq_i_adj][deq_j_adj] && discovered[deq_i_adj][deq_j_adj] == 0 && doesBondNorth[deq_i][deq_j]) {
-                  deq.push_back(std::make_tuple(deq_i_adj, deq_j_adj));
-                  discovered[deq_i_adj][deq_j_adj] = 1;
-               }
-
-               deq_i_adj = (deq_i + 1) % Ly;
-               deq_j_adj = deq_j;
-               if (lattice[deq_i][deq_j] == lattice[deq_i_adj][deq_j_adj] && discovered[deq_i_adj][deq_j_adj] == 0 && doesBondEast[deq_i][deq_j]) {
-                  deq.push_back(std::make_tuple(deq_i_adj, deq_j_adj));
-                  discovered[deq_i_adj][deq_j_adj] = 1;
-               }
-
-               deq_i_adj = deq_i;
-               deq_j_adj = (deq_j - 1 + Lx) % Lx;
-               if (lattice[deq_i][deq_j] == lattice[deq_i_adj][deq_j_adj] && discovered[deq_i_adj][deq_j_adj] == 0 && doesBondNorth[deq_i][deq_j_adj]) {
-                  deq.push_back(std::make_tuple(deq_i_adj, deq_j_adj));
-                  discovered[deq_i_adj][deq_j_adj] = 1;
-               }
-
-               deq_i_adj = (deq_i - 1 + Ly) % Ly;
-               deq_j_adj = deq_j;
-               if (lattice[deq_i][deq_j] == lattice[deq_i_adj][deq_j_adj] && discovered[deq_i_adj][deq_j_adj] == 0 && doesBondEast[deq_i_adj][deq_j]) {
-                  deq.push_back(std::make_tuple(deq_i_adj, deq_j_adj));
-                  discovered[deq_i_adj][deq_j_adj] = 1;
-               }
-
-               if (flipCluster)
-                  lattice[deq_i][deq_j] *= -1;
-               deq.pop_front();
-            }
+
+std::optional<double> magneto::CreutzDemon::get_measured_temperature() const {
+   if (m_J == 0 || m_histogram[0] == 0 || m_histogram[1] == 0)
+      return std::nullopt;
+   return 4.0 * std::abs(m_J) / std::log(1.0 * m_histogram[0] / m_histogram[1]);
+}
+
+
+int magneto::CreutzDemon::get_demon_energy() const {
+   return 4 * std::abs(m_J) * std::accumulate(std::cbegin(m_demons), std::cend(m_demons), 0);
+}
+
+
+namespace {
+
+   std::array<double, 7> get_kawasaki_acceptance(const int J, const double T) {
+      std::array<double, 7> acceptance;
+      for (int x = -8; x <= 4; x += 2)
+         acceptance[(x + 8) / 2] = std::min(1.0, exp(-(2.0 * J * x + 4.0 * J) / T));
+      return acceptance;
+   }
+} // namespace {}
+
+
+magneto::Kawasaki::Kawasaki(const int J, const double T, const int Lx, const int Ly, const int max_rng_threads /*= 2*/)
+   : m_random_buffer(std::make_shared<UniformStream>(RandomBufferGetter(Lx*Ly), max_rng_threads))
+   , m_J(J)
+   , m_acceptance(get_kawasaki_acceptance(J, T))
+   // Classes of a row stride of 4 only stay conflict-free across the periodic boundary if it divides Ly
+   , m_east_classes(get_pair_classes(0, 1))
+   , m_south_classes(get_pair_classes(1, 0))
+   , m_parallel(Ly % 4 == 0 && static_cast<unsigned int>(Lx * Ly) >= parallel_row_threshold)
+   , m_rng(get_time_seeded_rng())
+{ }
+
+
+magneto::Kawasaki::Kawasaki(const int J, const double T, RandomStreams& streams)
+   : m_random_buffer(streams.get_uniforms())
+   , m_J(J)
+   , m_acceptance(get_kawasaki_acceptance(J, T))
+   , m_east_classes(get_pair_classes(0, 1))
+   , m_south_classes(get_pair_classes(1, 0))
+   , m_parallel(streams.get_Ly() % 4 == 0 && static_cast<unsigned int>(streams.get_Lx() * streams.get_Ly()) >= parallel_row_threshold)
+   , m_rng(get_time_seeded_rng())
+{ }
+
+
+bool magneto::Kawasaki::set_temperature(const double T) {
+   m_acceptance = get_kawasaki_acceptance(m_J, T);
+   return true;
+}
+
+
+std::vector<magneto::Kawasaki::PairClass> magneto::Kawasaki::get_pair_classes(const int di, const int dj) {
+   // The axis along the pair gets a stride of 4, the other one a stride of 2
+   const int row_stride = 2 + 2 * di;
+   const int column_stride = 2 + 2 * dj;
+   std::vector<PairClass> classes;
+   for (int row = 0; row < row_stride; ++row) {
+      for (int column = 0; column < column_stride; ++column)
+         classes.push_back({ di, dj, row, row_stride, column, column_stride });
+   }
+   return classes;
+}
+
+
+void magneto::Kawasaki::run(LatticeType& lattice) {
+   std::shuffle(std::begin(m_east_classes), std::end(m_east_classes), m_rng);
+   std::shuffle(std::begin(m_south_classes), std::end(m_south_classes), m_rng);
+   const bool east_first = std::uniform_int_distribution<int>(0, 1)(m_rng) == 0;
+   for (const std::vector<PairClass>* classes : { east_first ? &m_east_classes : &m_south_classes, east_first ? &m_south_classes : &m_east_classes }) {
+      for (const PairClass& pair_class : *classes)
+         update_class(lattice, pair_class, m_random_buffer->get_buffer());
+      m_random_buffer->refill();
+   }
+}
+
+
+void magneto::Kawasaki::update_class(LatticeType& lattice, const PairClass& pair_class, const std::vector<double>& randoms) const {
+   const int Lx = static_cast<int>(lattice.front().size());
+   const int Ly = static_cast<int>(lattice.size());
+   const auto neighbour_sum = [&](const int i, const int j) {
+      const std::vector<char>& row = lattice[i];
+      return row[j == 0 ? Lx - 1 : j - 1] + row[j + 1 == Lx ? 0 : j + 1]
+         + lattice[i == 0 ? Ly - 1 : i - 1][j] + lattice[i + 1 == Ly ? 0 : i + 1][j];
+   };
+   const auto row_fun = [&](const int i) {
+      const int i_b = i + pair_class.di == Ly ? 0 : i + pair_class.di;
+      for (int j = pair_class.column_offset; j < Lx; j += pair_class.column_stride) {
+         const int j_b = j + pair_class.dj == Lx ? 0 : j + pair_class.dj;
+         char& a = lattice[i][j];
+         char& b = lattice[i_b][j_b];
+         if (a == b)
+            continue;
+         const int x = a * (neighbour_sum(i, j) - neighbour_sum(i_b, j_b));
+         if (randoms[i * Lx + j] < m_acceptance[(x + 8) / 2]) {
+            a = -a;
+            b = -b;
          }
-         ++counter;
       }
+   };
+
+   std::vector<int> rows;
+   for (int i = pair_class.row_offset; i < Ly; i += pair_class.row_stride)
+      rows.emplace_back(i);
+   if (m_parallel)
+      std::for_each(std::execution::par, std::cbegin(rows), std::cend(rows), row_fun);
+   else
+      std::for_each(std::cbegin(rows), std::cend(rows), row_fun);
+}
+
+
+magneto::ScheduledAlgorithm::ScheduledAlgorithm(std::vector<Component>&& components)
+   : m_components(std::move(components))
+{ }
+
+
+void magneto::ScheduledAlgorithm::run(LatticeType& lattice) {
+   for (auto& [algorithm, n] : m_components) {
+      for (unsigned int i = 0; i < n; ++i)
+         algorithm->run(lattice);
    }
+}
+
 
-   m_bond_north_buffer.refill();
-   m_bond_east_buffer.refill();
-   m_flip_buffer.refill();
+std::optional<magneto::ClusterStatistics> magneto::ScheduledAlgorithm::get_cluster_statistics() const {
+   // The last component that actually runs decides
+   for (auto it = m_components.crbegin(); it != m_components.crend(); ++it) {
+      if (it->second > 0)
+         return it->first->get_cluster_statistics();
+   }
+   return std::nullopt;
 }
 
+
+bool magneto::ScheduledAlgorithm::set_field(const ExternalField& field) {
+   bool supported = true;
+   for (auto& [algorithm, n] : m_components)
+      supported = algorithm->set_field(field) && supported;
+   return supported;
+}
+
+
+bool magneto::ScheduledAlgorithm::set_temperature(const double T) {
+   bool supported = true;
+   for (auto& [algorithm, n] : m_components)
+      supported = algorithm->set_temperature(T) && supported;
+   return supported;
+}
+
+
+bool magneto::ScheduledAlgorithm::set_temperatures(const LatticeDType& T) {
+   bool supported = true;
+   for (auto& [algorithm, n] : m_components)
+      supported = algorithm->set_temperatures(T) && supported;
+   return supported;
+}
+
+
+std::optional<double> magneto::ScheduledAlgorithm::get_measured_temperature() const {
+   for (const auto& [algorithm, n] : m_components) {
+      const std::optional<double> temperature = algorithm->get_measured_temperature();
+      if (temperature.has_value())
+         return temperature;
+   }
+   return std::nullopt;
+}
+
+
+magneto::ClusterStatisticsAccumulator::ClusterStatisticsAccumulator(const int Lx, const int Ly) {
+   constexpr double two_pi = 6.283185307179586;
+   for (int j = 0; j < Lx; ++j) {
+      m_cos_x.emplace_back(cos(two_pi * j / Lx));
+      m_sin_x.emplace_back(sin(two_pi * j / Lx));
+   }
+   for (int i = 0; i < Ly; ++i) {
+      m_cos_y.emplace_back(cos(two_pi * i / Ly));
+      m_sin_y.emplace_back(sin(two_pi * i / Ly));
+   }
+   clear();
+}
+
+
+void magneto::ClusterStatisticsAccumulator::clear() {
+   m_statistics = ClusterStatistics();
+   m_cluster_size = 0;
+   m_cx = m_sx = m_cy = m_sy = 0.0;
+}
+
+
+void magneto::ClusterStatisticsAccumulator::add_site(const int i, const int j) {
+   ++m_cluster_size;
+   m_cx += m_cos_x[j];
+   m_sx += m_sin_x[j];
+   m_cy += m_cos_y[i];
+   m_sy += m_sin_y[i];
+}
+
+
+void magneto::ClusterStatisticsAccumulator::end_cluster(const char spin) {
+   const double size = m_cluster_size;
+   ++m_statistics.cluster_count;
+   m_statistics.squared_size_sum += size * size;
+   m_statistics.fourier_size_sum_x += m_cx * m_cx + m_sx * m_sx;
+   m_statistics.fourier_size_sum_y += m_cy * m_cy + m_sy * m_sy;
+   m_statistics.magnetization += spin * static_cast<long long>(m_cluster_size);
+   m_cluster_size = 0;
+   m_cx = m_sx = m_cy = m_sy = 0.0;
+}
+
+
+const magneto::ClusterStatistics& magneto::ClusterStatisticsAccumulator::get_statistics() const {
+   return m_statistics;
+}
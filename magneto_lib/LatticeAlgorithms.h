@@ -1,78 +1,345 @@
 #pragma once
 
 #include "types.h"
+#include "IsingSystem.h"
 #include "BufferStructure.h"
+#include "ClusterScratch.h"
+#include "random_buffers.h"
+#include "export_macro.h"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <random>
 
 
 namespace magneto {
 
    class LatticeAlgorithm {
    public:
+      virtual ~LatticeAlgorithm() = default;
       virtual void run(LatticeType& lattice) = 0;
+
+      /// <summary>Cluster statistics of the last run, if the algorithm is a cluster algorithm</summary>
+      virtual std::optional<ClusterStatistics> get_cluster_statistics() const { return std::nullopt; }
+
+      /// <summary>Temperature measured by the dynamics itself, only for microcanonical algorithms</summary>
+      virtual std::optional<double> get_measured_temperature() const { return std::nullopt; }
+
+      /// <summary>Changes the external field between runs. Returns false if the algorithm
+      /// doesn't support fields.</summary>
+      virtual bool set_field(const ExternalField& /*field*/) { return false; }
+
+      /// <summary>Changes the temperature between runs, e.g. for annealing. Returns false if the
+      /// algorithm can't, then it has to be constructed again.</summary>
+      virtual bool set_temperature(const double /*T*/) { return false; }
+
+      /// <summary>Changes the temperature of every site between runs, for algorithms with a
+      /// temperature per site</summary>
+      virtual bool set_temperatures(const LatticeDType& /*T*/) { return false; }
+   };
+
+
+   /// <summary>Collects the statistics of the clusters discovered during one cluster step</summary>
+   class ClusterStatisticsAccumulator {
+   public:
+      ClusterStatisticsAccumulator(const int Lx, const int Ly);
+      void clear();
+      void add_site(const int i, const int j);
+
+      /// <summary>Closes the current cluster, whose spin value after the step is spin</summary>
+      void end_cluster(const char spin);
+      const ClusterStatistics& get_statistics() const;
+
+   private:
+      std::vector<double> m_cos_x, m_sin_x, m_cos_y, m_sin_y;
+      ClusterStatistics m_statistics;
+      unsigned int m_cluster_size;
+      double m_cx, m_sx, m_cy, m_sy;
+   };
+
+   /// <summary>Periodic neighbour index along one axis. For power of two lengths the wrap is a
+   /// mask instead of a compare.</summary>
+   template<bool PowerOfTwo>
+   struct PeriodicWrap {
+      PeriodicWrap(const int length) : m_length(length), m_mask(length - 1) {}
+
+      int next(const int x) const {
+         if constexpr (PowerOfTwo)
+            return (x + 1) & m_mask;
+         else
+            return x + 1 == m_length ? 0 : x + 1;
+      }
+
+      int previous(const int x) const {
+         if constexpr (PowerOfTwo)
+            return (x - 1) & m_mask;
+         else
+            return x == 0 ? m_length - 1 : x - 1;
+      }
+
+      int m_length;
+      int m_mask;
    };
 
+
+   /// <summary>Metropolis with the sign of J and the kind of periodic wrap fixed at compile time.
+   /// <para>Flipping spin s costs dE = 2|J|k + 2 h_i s with k = sign(J)*s*(neighbour sum). The
+   /// acceptance probability of every combination of field level, s and k is tabulated, so a
+   /// step is a single lookup. set_field() and set_temperature() only rebuild that table. Use
+   /// get_specialized_algorithm() to get the right instantiation.</para>
+   /// </summary>
+   template<int JSign, bool PowerOfTwo>
    class Metropolis : public LatticeAlgorithm {
    public:
       Metropolis(const int J, const double T, const int Lx, const int Ly, const int max_rng_threads = 2);
+      Metropolis(const int J, const double T, RandomStreams& streams);
+
+      /// <summary>Takes its sweeps from a source shared with other lattices</summary>
+      Metropolis(const int J, const double T, const std::shared_ptr<CommonRandomSource>& common_randoms);
       virtual void run(LatticeType& lattice);
+      virtual bool set_field(const ExternalField& field);
+      virtual bool set_temperature(const double T);
 
    private:
-      BufferStructure<IndexPairVector> m_lattice_index_buffer;
-      BufferStructure<std::vector<double>> m_random_buffer;
-      std::vector<double> m_cached_exp_values;
+      void sweep(LatticeType& lattice, const IndexPairVector& indices, const std::vector<double>& randoms) const;
+
+      template<bool SiteField>
+      void sweep_levels(LatticeType& lattice, const IndexPairVector& indices, const std::vector<double>& randoms) const;
+
+      std::shared_ptr<IndexStream> m_lattice_index_buffer;
+      std::shared_ptr<UniformStream> m_random_buffer;
+      std::shared_ptr<CommonRandomSource> m_common_randoms;
+      size_t m_sweep_count = 0;
       int m_J;
+      double m_T;
+      ExternalField m_field;
+
+      // Field level per site, nullptr for a uniform field
+      std::shared_ptr<const std::vector<unsigned char>> m_field_levels;
+
+      // Ten probabilities per field level, see get_field_acceptance_index()
+      std::vector<double> m_acceptance;
    };
 
+   extern template class CLASS_DECLSPEC Metropolis<1, true>;
+   extern template class CLASS_DECLSPEC Metropolis<1, false>;
+   extern template class CLASS_DECLSPEC Metropolis<-1, true>;
+   extern template class CLASS_DECLSPEC Metropolis<-1, false>;
+
 
+   /// <summary>Metropolis for a temperature per site, specialized like Metropolis. The two
+   /// acceptance probabilities of every site are tabulated on construction, set_temperatures()
+   /// only updates the sites whose temperature changed.</summary>
+   template<int JSign, bool PowerOfTwo>
    class VariableMetropolis : public LatticeAlgorithm {
    public:
       VariableMetropolis(const int J, const LatticeDType& T, const int Lx, const int Ly, const int max_rng_threads = 2);
+      VariableMetropolis(const int J, const LatticeDType& T, RandomStreams& streams);
       virtual void run(LatticeType& lattice);
+      virtual bool set_temperatures(const LatticeDType& T);
 
    private:
-      BufferStructure<IndexPairVector> m_lattice_index_buffer;
-      BufferStructure<std::vector<double>> m_random_buffer;
-      const LatticeDType m_T;
+      std::shared_ptr<IndexStream> m_lattice_index_buffer;
+      std::shared_ptr<UniformStream> m_random_buffer;
       int m_J;
+      LatticeDType m_T;
+
+      // Two probabilities per site, row-major
+      std::vector<double> m_acceptance;
    };
 
+   extern template class CLASS_DECLSPEC VariableMetropolis<1, true>;
+   extern template class CLASS_DECLSPEC VariableMetropolis<1, false>;
+   extern template class CLASS_DECLSPEC VariableMetropolis<-1, true>;
+   extern template class CLASS_DECLSPEC VariableMetropolis<-1, false>;
+
+
+   [[nodiscard]] constexpr bool is_power_of_two(const int n) {
+      return n > 0 && (n & (n - 1)) == 0;
+   }
+
 
-   class SW : public LatticeAlgorithm {
+   /// <summary>Instantiates TAlgorithm for the sign of J and the lattice size. J and args are
+   /// passed on to the constructor.</summary>
+   template<template<int, bool> class TAlgorithm, class... TArgs>
+   std::unique_ptr<LatticeAlgorithm> get_specialized_algorithm(const int J, const int Lx, const int Ly, TArgs&&... args) {
+      const bool power_of_two = is_power_of_two(Lx) && is_power_of_two(Ly);
+      if (J >= 0 && power_of_two)
+         return std::make_unique<TAlgorithm<1, true>>(J, std::forward<TArgs>(args)...);
+      if (J >= 0)
+         return std::make_unique<TAlgorithm<1, false>>(J, std::forward<TArgs>(args)...);
+      if (power_of_two)
+         return std::make_unique<TAlgorithm<-1, true>>(J, std::forward<TArgs>(args)...);
+      return std::make_unique<TAlgorithm<-1, false>>(J, std::forward<TArgs>(args)...);
+   }
+
+
+   class CLASS_DECLSPEC SW : public LatticeAlgorithm {
    public:
-      SW(const int J, const double T, const int Lx, const int Ly, const int max_rng_threads = 1);
+      // Only aligned bonds and one coin per cluster take random numbers, a run needs less than three buffers
+      SW(const int J, const double T, const int Lx, const int Ly, const int max_rng_threads = 3);
+      SW(const int J, const double T, RandomStreams& streams);
       virtual void run(LatticeType& lattice);
+      virtual std::optional<ClusterStatistics> get_cluster_statistics() const;
+      virtual bool set_temperature(const double T);
 
    private:
-      BufferStructure<std::vector<double>> m_bond_north_buffer;
-      BufferStructure<std::vector<double>> m_bond_east_buffer;
-      BufferStructure<std::vector<double>> m_flip_buffer;
+      std::shared_ptr<UniformStream> m_random_buffer;
+      ClusterStatisticsAccumulator m_cluster_statistics;
+      ClusterScratch m_scratch;
+      bool m_has_run = false;
 
       int m_J;
       double m_T;
    };
 
 
-   class VariableSW : public LatticeAlgorithm {
+   class CLASS_DECLSPEC VariableSW : public LatticeAlgorithm {
+   public:
+      // Only aligned bonds and one coin per cluster take random numbers, a run needs less than three buffers
+      VariableSW(const int J, const LatticeDType& T, const int Lx, const int Ly, const int max_rng_threads = 3);
+      VariableSW(const int J, const LatticeDType& T, RandomStreams& streams);
+      virtual void run(LatticeType& lattice);
+      virtual std::optional<ClusterStatistics> get_cluster_statistics() const;
+
+      /// <summary>Sorts the temperatures into at most 256 levels, each with one freeze threshold.
+      /// Sites that change to a temperature which already has a level only change their level,
+      /// the levels are only sorted again for new temperatures.</summary>
+      virtual bool set_temperatures(const LatticeDType& T);
+
+   private:
+      std::shared_ptr<UniformStream> m_random_buffer;
+      ClusterStatisticsAccumulator m_cluster_statistics;
+      ClusterScratch m_scratch;
+      bool m_has_run = false;
+
+      // Row-major temperature level of each site and the freeze threshold of each level. A bond
+      // freezes if a uniform integer in [0,2^32) is below the threshold.
+      std::vector<unsigned char> m_levels;
+      std::vector<uint32_t> m_thresholds;
+
+      // Current temperatures and the sorted temperature of each level
+      LatticeDType m_T;
+      std::vector<double> m_level_temps;
+
+      int m_J;
+   };
+
+   /// <summary>Microcanonical Creutz demon algorithm.
+   /// <para>Every row has a demon with an energy in quanta of 4|J|, bounded to
+   /// [0, max_demon_quanta]. The demon sweeps its row and flips a spin if it can pay for the
+   /// energy difference or absorb it. Everything is integer, and the only random numbers are
+   /// the start column of each row per sweep. Rows only interact through their vertical
+   /// neighbours, so all even rows and then all odd rows run in parallel.</para>
+   /// <para>The demon energies follow P(E) ~ exp(-E/T), so the temperature follows from their
+   /// histogram: T = 4|J| / ln(P(0)/P(1)).</para>
+   /// </summary>
+   class CLASS_DECLSPEC CreutzDemon : public LatticeAlgorithm {
    public:
-      VariableSW(const int J, const LatticeDType& T, const int Lx, const int Ly, const int max_rng_threads = 1);
+      /// <summary>Demons start with their mean energy at T, the lattice should already be
+      /// equilibrated at T. J must not be 0, there are no energy quanta to trade then.</summary>
+      CreutzDemon(const int J, const double T, const int Lx, const int Ly);
       virtual void run(LatticeType& lattice);
+      virtual std::optional<double> get_measured_temperature() const;
+
+      /// <summary>Summed energy of all demons. Together with the lattice energy, it stays
+      /// constant.</summary>
+      int get_demon_energy() const;
+
+      static constexpr int max_demon_quanta = 16;
 
    private:
-      BufferStructure<std::vector<double>> m_bond_north_buffer;
-      BufferStructure<std::vector<double>> m_bond_east_buffer;
-      BufferStructure<std::vector<double>> m_flip_buffer;
-      LatticeDType m_freeze_probability;
+      void sweep_row(LatticeType& lattice, const int i);
 
       int m_J;
+      std::vector<int> m_demons;
+      std::vector<int> m_start_columns;
+      std::vector<std::vector<int>> m_row_phases;
+      std::vector<unsigned long long> m_histogram;
+      std::mt19937 m_rng;
    };
 
-   /// <summary>calculates all possible values of the exp-function
-   /// <para>The exponential function exp(-beta*(H2-H1)) is used extensively during the core loop 
-   /// of the metropolis algorithm. Luckily, because of the nature of the Ising model, there is 
-   /// only a finite amount of possible values for the parameter. In a 2D Ising model, there can 
-   /// only be the values [-8J,8J] for dH. Since the values will be stored in a vector, 
-   /// the parameter will be shifted to start at 0.</para>
+
+   /// <summary>Kawasaki dynamics, conserves the magnetization.
+   /// <para>A sweep proposes to swap every nearest neighbour pair once. Only anti-aligned pairs
+   /// change; swapping them costs dE = 2J*s_a*(h_a - h_b) + 4J with the neighbour sums h, so the
+   /// acceptance is tabulated over x = s_a*(h_a - h_b) in [-8, 4].</para>
+   /// <para>The pairs are split into 8 east classes (i mod 2, j mod 4) and 8 south classes
+   /// (i mod 4, j mod 2). No two pairs of a class share a site or read a site the other one
+   /// writes, so the rows of a class run in parallel if the number of rows allows it. The class
+   /// order is shuffled every sweep.</para>
    /// </summary>
-   std::vector<double> get_cached_exp_values(const int J, const double T);
+   class CLASS_DECLSPEC Kawasaki : public LatticeAlgorithm {
+   public:
+      // One run takes two buffers: east pairs and south pairs
+      Kawasaki(const int J, const double T, const int Lx, const int Ly, const int max_rng_threads = 2);
+      Kawasaki(const int J, const double T, RandomStreams& streams);
+      virtual void run(LatticeType& lattice);
+      virtual bool set_temperature(const double T);
+
+   private:
+      /// <summary>Pairs (i, j)-(i+di, j+dj) with i = row_offset (mod row_stride) and
+      /// j = column_offset (mod column_stride)</summary>
+      struct PairClass {
+         int di, dj;
+         int row_offset, row_stride;
+         int column_offset, column_stride;
+      };
+
+      /// <summary>The 8 classes of east (di=0, dj=1) or south (di=1, dj=0) pairs</summary>
+      static std::vector<PairClass> get_pair_classes(const int di, const int dj);
+      void update_class(LatticeType& lattice, const PairClass& pair_class, const std::vector<double>& randoms) const;
+
+      std::shared_ptr<UniformStream> m_random_buffer;
+      int m_J;
+      std::array<double, 7> m_acceptance;
+      std::vector<PairClass> m_east_classes;
+      std::vector<PairClass> m_south_classes;
+      bool m_parallel;
+      std::mt19937 m_rng;
+   };
+
+
+   /// <summary>Runs its components in order, each a number of times, as one step. The components
+   /// work on the same lattice and usually share their random streams, e.g. one SW step followed by
+   /// five Metropolis sweeps.</summary>
+   class CLASS_DECLSPEC ScheduledAlgorithm : public LatticeAlgorithm {
+   public:
+      using Component = std::pair<std::unique_ptr<LatticeAlgorithm>, unsigned int>;
+      ScheduledAlgorithm(std::vector<Component>&& components);
+      virtual void run(LatticeType& lattice);
+
+      /// <summary>Only available if the last component of the schedule is a cluster algorithm,
+      /// otherwise the clusters don't describe the current state anymore</summary>
+      virtual std::optional<ClusterStatistics> get_cluster_statistics() const;
+
+      /// <summary>Temperature of the first component that measures one</summary>
+      virtual std::optional<double> get_measured_temperature() const;
+
+      /// <summary>Sets the field of all components, true if all of them support it</summary>
+      virtual bool set_field(const ExternalField& field);
+
+      /// <summary>Sets the temperature of all components, true if all of them support it</summary>
+      virtual bool set_temperature(const double T);
+      virtual bool set_temperatures(const LatticeDType& T);
+
+   private:
+      std::vector<Component> m_components;
+   };
+
+   /// <summary>Metropolis acceptance probabilities exp(-dE/T) for the only two positive energy
+   /// differences of the 2D Ising model, dE=4|J| and dE=8|J|</summary>
+   std::array<double, 2> get_acceptance_probabilities(const int J, const double T);
+
+   /// <summary>Index into a field acceptance table: ten entries per field level, by spin and by
+   /// k = sign(J)*s*(neighbour sum) in [-4, 4]</summary>
+   [[nodiscard]] constexpr size_t get_field_acceptance_index(const size_t level, const char spin, const int k) {
+      return (2 * level + (spin > 0)) * 5 + ((k + 4) >> 1);
+   }
+
+   /// <summary>Acceptance probabilities min(1, exp(-dE/T)) with dE = 2|J|k + 2 h_i s for every
+   /// field level, laid out as get_field_acceptance_index()</summary>
+   [[nodiscard]] std::vector<double> get_field_acceptance_table(const int J, const double T, const ExternalField& field);
 
 }
@@ -0,0 +1,179 @@
+#include "MultispinMetropolis.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+
+namespace {
+   using WordType = magneto::MultispinMetropolis::WordType;
+
+   // Resolution of the acceptance probabilities
+   constexpr int probability_bits = 32;
+
+
+   /// <summary>Counts set bits per lane over many added words. The count of lane k is stored
+   /// vertically: bit k of plane b is bit b of that lane's count.</summary>
+   class BitSlicedCounter {
+   public:
+      BitSlicedCounter(const size_t max_count) {
+         size_t plane_count = 1;
+         while ((size_t(1) << plane_count) <= max_count)
+            ++plane_count;
+         m_planes.assign(plane_count, 0);
+      }
+
+      void add(WordType word) {
+         // ripple carry adder, usually terminates after one or two planes
+         for (WordType& plane : m_planes) {
+            const WordType carry = plane & word;
+            plane ^= word;
+            word = carry;
+            if (word == 0)
+               return;
+         }
+      }
+
+      std::array<unsigned int, magneto::MultispinMetropolis::replica_count> get_counts() const {
+         std::array<unsigned int, magneto::MultispinMetropolis::replica_count> counts{};
+         for (unsigned int lane = 0; lane < counts.size(); ++lane) {
+            for (size_t b = 0; b < m_planes.size(); ++b)
+               counts[lane] += static_cast<unsigned int>((m_planes[b] >> lane) & 1) << b;
+         }
+         return counts;
+      }
+
+   private:
+      std::vector<WordType> m_planes;
+   };
+
+
+   /// <summary>Bit planes of the fixed point acceptance probabilities, most significant first.</summary>
+   std::vector<WordType> get_probability_planes(
+      const int J, const std::array<double, magneto::MultispinMetropolis::replica_count>& temps
+   ) {
+      std::vector<WordType> planes(probability_bits, 0);
+      for (unsigned int lane = 0; lane < temps.size(); ++lane) {
+         // Flip probability for a spin with exactly one unsatisfied bond: dE = 4|J|
+         const double p = std::exp(-4.0 * std::abs(J) / temps[lane]);
+         // p is 1 for J=0, which has to stay below 2^probability_bits
+         const std::uint64_t fixed_p = std::min(
+            static_cast<std::uint64_t>(std::ldexp(p, probability_bits)), (std::uint64_t(1) << probability_bits) - 1
+         );
+         for (int b = 0; b < probability_bits; ++b) {
+            if ((fixed_p >> (probability_bits - 1 - b)) & 1)
+               planes[b] |= WordType(1) << lane;
+         }
+      }
+      return planes;
+   }
+
+} // namespace {}
+
+
+magneto::MultispinMetropolis::MultispinMetropolis(
+   const int J, const std::array<double, replica_count>& temps, const LatticeType& initial_state
+)
+   : m_probability_planes(get_probability_planes(J, temps))
+   , m_rng(static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count()))
+   , m_antiferromagnetic(J < 0)
+{
+   std::tie(m_Lx, m_Ly) = get_dimensions_of_lattice(initial_state);
+   m_lattice.reserve(m_Lx * m_Ly);
+   for (unsigned int i = 0; i < m_Ly; ++i) {
+      for (unsigned int j = 0; j < m_Lx; ++j)
+         m_lattice.emplace_back(initial_state[i][j] > 0 ? ~WordType(0) : WordType(0));
+   }
+}
+
+
+magneto::MultispinMetropolis::WordType magneto::MultispinMetropolis::get_acceptance_mask() {
+   // Lane-wise comparison of a random fixed point number with the probability. Every drawn word
+   // supplies one random bit to each lane, and most lanes are decided after a few words.
+   WordType less = 0;
+   WordType undecided = ~WordType(0);
+   for (const WordType plane : m_probability_planes) {
+      const WordType r = m_rng();
+      less |= undecided & ~r & plane;
+      undecided &= ~(r ^ plane);
+      if (undecided == 0)
+         break;
+   }
+   return less;
+}
+
+
+void magneto::MultispinMetropolis::run() {
+   // For J<0 the unsatisfied bonds are the aligned ones
+   const WordType unsatisfied_flip = m_antiferromagnetic ? ~WordType(0) : WordType(0);
+   for (unsigned int i = 0; i < m_Ly; ++i) {
+      const WordType* row_up = &m_lattice[((i + m_Ly - 1) % m_Ly) * m_Lx];
+      const WordType* row_down = &m_lattice[((i + 1) % m_Ly) * m_Lx];
+      WordType* row = &m_lattice[i * m_Lx];
+      for (unsigned int j = 0; j < m_Lx; ++j) {
+         const WordType s = row[j];
+         const WordType a1 = (s ^ row[j == 0 ? m_Lx - 1 : j - 1]) ^ unsatisfied_flip;
+         const WordType a2 = (s ^ row[j == m_Lx - 1 ? 0 : j + 1]) ^ unsatisfied_flip;
+         const WordType a3 = (s ^ row_up[j]) ^ unsatisfied_flip;
+         const WordType a4 = (s ^ row_down[j]) ^ unsatisfied_flip;
+
+         // Bitwise adder for the number of unsatisfied bonds u: dE = (8-4u)|J|
+         const WordType s12 = a1 ^ a2;
+         const WordType c12 = a1 & a2;
+         const WordType s34 = a3 ^ a4;
+         const WordType c34 = a3 & a4;
+         const WordType u_ge_2 = c12 | c34 | (s12 & s34);
+         const WordType u_eq_1 = (s12 ^ s34) & ~(c12 | c34);
+         const WordType u_eq_0 = ~(a1 | a2 | a3 | a4);
+
+         WordType flip = u_ge_2;
+         if (u_eq_1 | u_eq_0) {
+            // Acceptance of dE=8|J| is the square of that of dE=4|J|
+            const WordType r1 = get_acceptance_mask();
+            flip |= u_eq_1 & r1;
+            if (u_eq_0 & r1)
+               flip |= u_eq_0 & r1 & get_acceptance_mask();
+         }
+         row[j] = s ^ flip;
+      }
+   }
+}
+
+
+std::array<magneto::PhysicalMeasurement, magneto::MultispinMetropolis::replica_count>
+magneto::MultispinMetropolis::get_measurements() const {
+   const size_t N = m_lattice.size();
+   BitSlicedCounter up_spins(N);
+   BitSlicedCounter antialigned_bonds(2 * N);
+   for (unsigned int i = 0; i < m_Ly; ++i) {
+      const WordType* row = &m_lattice[i * m_Lx];
+      const WordType* row_down = &m_lattice[((i + 1) % m_Ly) * m_Lx];
+      for (unsigned int j = 0; j < m_Lx; ++j) {
+         up_spins.add(row[j]);
+         antialigned_bonds.add(row[j] ^ row[j == m_Lx - 1 ? 0 : j + 1]);
+         antialigned_bonds.add(row[j] ^ row_down[j]);
+      }
+   }
+
+   const auto up_counts = up_spins.get_counts();
+   const auto antialigned_counts = antialigned_bonds.get_counts();
+   std::array<PhysicalMeasurement, replica_count> measurements;
+   for (unsigned int lane = 0; lane < replica_count; ++lane) {
+      // Same normalization as get_E() and get_m_abs()
+      const long long m = 2 * static_cast<long long>(up_counts[lane]) - static_cast<long long>(N);
+      const long long E = 2 * static_cast<long long>(antialigned_counts[lane]) - 2 * static_cast<long long>(N);
+      measurements[lane].energy = E * 1.0 / N;
+      measurements[lane].magnetization = std::abs(m) * 1.0 / N;
+   }
+   return measurements;
+}
+
+
+magneto::LatticeType magneto::MultispinMetropolis::get_replica_lattice(const unsigned int replica) const {
+   LatticeType lattice(m_Ly, std::vector<char>(m_Lx));
+   for (unsigned int i = 0; i < m_Ly; ++i) {
+      for (unsigned int j = 0; j < m_Lx; ++j)
+         lattice[i][j] = ((m_lattice[i * m_Lx + j] >> replica) & 1) ? 1 : -1;
+   }
+   return lattice;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <random>
+
+#include "types.h"
+#include "IsingSystem.h"
+#include "export_macro.h"
+
+
+namespace magneto {
+
+   /// <summary>Metropolis algorithm for 64 independent replicas at once, using multi-spin coding.
+   /// <para>Bit k of every lattice word belongs to replica k, a set bit being spin +1. One sweep
+   /// computes the number of unsatisfied bonds of all 64 replicas with a handful of bitwise
+   /// operations and accepts flips with per-replica probability masks. Every replica can have
+   /// its own temperature.</para>
+   /// </summary>
+   class CLASS_DECLSPEC MultispinMetropolis {
+   public:
+      static constexpr unsigned int replica_count = 64;
+      using WordType = std::uint64_t;
+
+      MultispinMetropolis(const int J, const std::array<double, replica_count>& temps, const LatticeType& initial_state);
+
+      /// <summary>One Metropolis sweep over all sites of all replicas</summary>
+      void run();
+
+      /// <summary>Energy and absolute magnetization of every replica, computed bit-sliced</summary>
+      [[nodiscard]] std::array<PhysicalMeasurement, replica_count> get_measurements() const;
+
+      /// <summary>Unpacks the spin state of a single replica</summary>
+      [[nodiscard]] LatticeType get_replica_lattice(const unsigned int replica) const;
+
+   private:
+      /// <summary>Random word where bit k is set with the acceptance probability of replica k</summary>
+      WordType get_acceptance_mask();
+
+      std::vector<WordType> m_lattice;
+      std::vector<WordType> m_probability_planes;
+      std::mt19937_64 m_rng;
+      unsigned int m_Lx;
+      unsigned int m_Ly;
+      bool m_antiferromagnetic;
+   };
+
+}
@@ -0,0 +1,157 @@
+#include "RandomBondAlgorithms.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+   std::vector<double> get_field_acceptance(const int max_coupling, const double T) {
+      std::vector<double> acceptance;
+      for (int x = -4 * max_coupling; x <= 4 * max_coupling; ++x)
+         acceptance.emplace_back(std::min(1.0, std::exp(-2.0 * x / T)));
+      return acceptance;
+   }
+
+
+   /// <summary>Freeze probability of a satisfied bond by |J_ij|</summary>
+   std::array<double, 128> get_freeze_probabilities(const double T) {
+      std::array<double, 128> probabilities;
+      for (int coupling = 0; coupling < static_cast<int>(probabilities.size()); ++coupling)
+         probabilities[coupling] = 1.0 - std::exp(-2.0 * coupling / T);
+      return probabilities;
+   }
+
+} // namespace {}
+
+
+template<bool PowerOfTwo>
+magneto::BondMetropolis<PowerOfTwo>::BondMetropolis(
+   const std::shared_ptr<const BondCouplings>& couplings, const double T, RandomStreams& streams
+)
+   : m_couplings(couplings)
+   , m_lattice_index_buffer(streams.get_lattice_indices())
+   , m_random_buffer(streams.get_uniforms())
+   , m_acceptance(get_field_acceptance(get_max_coupling(*couplings), T))
+   , m_field_offset(4 * get_max_coupling(*couplings))
+{ }
+
+
+template<bool PowerOfTwo>
+void magneto::BondMetropolis<PowerOfTwo>::run(LatticeType& lattice) {
+   const auto [Lx, Ly] = get_dimensions_of_lattice(lattice);
+   const PeriodicWrap<PowerOfTwo> wrap_x(Lx);
+   const PeriodicWrap<PowerOfTwo> wrap_y(Ly);
+   const signed char* east = m_couplings->east.data();
+   const signed char* south = m_couplings->south.data();
+   const IndexPairVector& indices = m_lattice_index_buffer->get_buffer();
+   const std::vector<double>& randoms = m_random_buffer->get_buffer();
+   for (size_t step = 0; step < randoms.size(); ++step) {
+      const auto [i, j] = indices[step];
+      const int left = wrap_x.previous(j);
+      const int right = wrap_x.next(j);
+      const int up = wrap_y.previous(i);
+      const int down = wrap_y.next(i);
+      std::vector<char>& row = lattice[i];
+      const int field = east[i * Lx + j] * row[right] + east[i * Lx + left] * row[left]
+         + south[i * Lx + j] * lattice[down][j] + south[up * Lx + j] * lattice[up][j];
+      if (randoms[step] < m_acceptance[row[j] * field + m_field_offset])
+         row[j] = -row[j];
+   }
+
+   m_random_buffer->refill();
+   m_lattice_index_buffer->refill();
+}
+
+
+template<bool PowerOfTwo>
+bool magneto::BondMetropolis<PowerOfTwo>::set_temperature(const double T) {
+   m_acceptance = get_field_acceptance(m_field_offset / 4, T);
+   return true;
+}
+
+
+magneto::BondSW::BondSW(const std::shared_ptr<const BondCouplings>& couplings, const double T, RandomStreams& streams)
+   : m_couplings(couplings)
+   , m_random_buffer(streams.get_cluster_uniforms())
+   , m_freeze_probability(get_freeze_probabilities(T))
+{ }
+
+
+bool magneto::BondSW::set_temperature(const double T) {
+   m_freeze_probability = get_freeze_probabilities(T);
+   return true;
+}
+
+
+void magneto::BondSW::run(LatticeType& lattice) {
+   const int Lx = static_cast<int>(m_couplings->Lx);
+   const int Ly = static_cast<int>(m_couplings->Ly);
+   const auto spin = [&](const int site) -> char& {return lattice[site / Lx][site % Lx]; };
+   const auto right_of = [&](const int site) {return site % Lx + 1 == Lx ? site + 1 - Lx : site + 1; };
+   const auto left_of = [&](const int site) {return site % Lx == 0 ? site + Lx - 1 : site - 1; };
+   const auto down_of = [&](const int site) {return site + Lx >= Lx * Ly ? site + Lx - Lx * Ly : site + Lx; };
+   const auto up_of = [&](const int site) {return site < Lx ? site - Lx + Lx * Ly : site - Lx; };
+
+   // Freeze satisfied bonds, one buffer per direction
+   m_scratch.start_run(Lx * Ly);
+   for (const bool is_east : { true, false }) {
+      const std::vector<signed char>& couplings = is_east ? m_couplings->east : m_couplings->south;
+      const std::vector<double>& randoms = m_random_buffer->get_buffer();
+      for (int i = 0; i < Ly; ++i) {
+         const std::vector<char>& row = lattice[i];
+         const std::vector<char>& row_down = lattice[i + 1 == Ly ? 0 : i + 1];
+         for (int j = 0; j < Lx; ++j) {
+            const int site = i * Lx + j;
+            const int neighbour_spin = is_east ? row[j + 1 == Lx ? 0 : j + 1] : row_down[j];
+            const int coupling = couplings[site];
+            const unsigned char frozen = coupling * row[j] * neighbour_spin > 0
+               && randoms[site] < m_freeze_probability[std::abs(coupling)];
+            if (is_east)
+               m_scratch.set_frozen(site, frozen);
+            else
+               m_scratch.add_frozen(site, frozen << 1);
+         }
+      }
+      m_random_buffer->refill();
+   }
+
+   // Grow and flip the clusters. Bonds are fixed, so flipping during the search is fine.
+   const std::vector<double>& randoms = m_random_buffer->get_buffer();
+   for (int start = 0; start < Lx * Ly; ++start) {
+      if (m_scratch.is_discovered(start))
+         continue;
+      const bool flip_cluster = randoms[start] < 0.5;
+      m_scratch.discover(start);
+      while (m_scratch.has_next()) {
+         const int site = m_scratch.pop();
+         const auto visit = [&](const int neighbour, const bool is_frozen) {
+            if (is_frozen && !m_scratch.is_discovered(neighbour))
+               m_scratch.discover(neighbour);
+         };
+         const int left = left_of(site);
+         const int up = up_of(site);
+         visit(right_of(site), m_scratch.is_frozen(site, 0));
+         visit(left, m_scratch.is_frozen(left, 0));
+         visit(down_of(site), m_scratch.is_frozen(site, 1));
+         visit(up, m_scratch.is_frozen(up, 1));
+         if (flip_cluster)
+            spin(site) = -spin(site);
+      }
+   }
+   m_random_buffer->refill();
+}
+
+
+int magneto::get_max_coupling(const BondCouplings& couplings) {
+   int max_coupling = 0;
+   for (const std::vector<signed char>* bonds : { &couplings.east, &couplings.south }) {
+      for (const signed char coupling : *bonds)
+         max_coupling = std::max(max_coupling, std::abs(static_cast<int>(coupling)));
+   }
+   return max_coupling;
+}
+
+
+template class CLASS_DECLSPEC magneto::BondMetropolis<true>;
+template class CLASS_DECLSPEC magneto::BondMetropolis<false>;
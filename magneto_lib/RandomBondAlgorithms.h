@@ -0,0 +1,63 @@
+#pragma once
+
+#include "LatticeAlgorithms.h"
+
+
+namespace magneto {
+
+   /// <summary>Metropolis with a coupling per bond.
+   /// <para>Flipping s costs dE = 2*s*h with the local field h = Sum J_ij s_j. s*h lies in
+   /// [-4 max|J_ij|, 4 max|J_ij|], so the acceptance is one table lookup, just like the uniform
+   /// algorithm.</para>
+   /// </summary>
+   template<bool PowerOfTwo>
+   class BondMetropolis : public LatticeAlgorithm {
+   public:
+      BondMetropolis(const std::shared_ptr<const BondCouplings>& couplings, const double T, RandomStreams& streams);
+      virtual void run(LatticeType& lattice);
+
+      /// <summary>Only rebuilds the acceptance table</summary>
+      virtual bool set_temperature(const double T);
+
+   private:
+      std::shared_ptr<const BondCouplings> m_couplings;
+      std::shared_ptr<IndexStream> m_lattice_index_buffer;
+      std::shared_ptr<UniformStream> m_random_buffer;
+
+      // min(1, exp(-2x/T)) for x = s*h + m_field_offset
+      std::vector<double> m_acceptance;
+      int m_field_offset;
+   };
+
+   extern template class CLASS_DECLSPEC BondMetropolis<true>;
+   extern template class CLASS_DECLSPEC BondMetropolis<false>;
+
+
+   /// <summary>Swendsen-Wang with a coupling per bond. A bond can only freeze if it is
+   /// satisfied (J_ij*s_i*s_j > 0), with probability 1-exp(-2|J_ij|/T). For spin glasses the
+   /// clusters say nothing about the magnetization, so there are no cluster statistics.</summary>
+   class CLASS_DECLSPEC BondSW : public LatticeAlgorithm {
+   public:
+      // One run takes three buffers: east bonds, south bonds and cluster flips
+      BondSW(const std::shared_ptr<const BondCouplings>& couplings, const double T, RandomStreams& streams);
+      virtual void run(LatticeType& lattice);
+
+      /// <summary>Only rebuilds the freeze probabilities</summary>
+      virtual bool set_temperature(const double T);
+
+   private:
+      std::shared_ptr<const BondCouplings> m_couplings;
+      std::shared_ptr<UniformStream> m_random_buffer;
+
+      // Freeze probability by |J_ij|
+      std::array<double, 128> m_freeze_probability;
+
+      // Bit 0 freezes the east bond of a site, bit 1 the south bond
+      ClusterScratch m_scratch;
+   };
+
+
+   /// <summary>Largest |J_ij| of all bonds</summary>
+   [[nodiscard]] int get_max_coupling(const BondCouplings& couplings);
+
+}
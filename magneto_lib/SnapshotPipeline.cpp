@@ -0,0 +1,109 @@
+#include "SnapshotPipeline.h"
+
+#include <algorithm>
+#include <chrono>
+
+
+namespace {
+
+   // Filled queue entry that ends the consumer without a snapshot
+   constexpr int stop_index = -1;
+
+
+   /// <summary>Spins briefly, then sleeps in short steps. A measurement is much longer than a
+   /// wakeup, so the consumer doesn't need to burn a core while the producer sweeps.</summary>
+   template<class TFun>
+   void wait_until(const TFun& is_done) {
+      for (int spin = 0; !is_done(); ++spin) {
+         if (spin < 64)
+            std::this_thread::yield();
+         else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+   }
+
+} // namespace {}
+
+
+magneto::SnapshotPipeline::SnapshotPipeline(
+   const IsingSystem& system, const size_t depth, const std::function<void(const Snapshot&)>& consume
+)
+   : m_snapshots(std::max<size_t>(1, depth), Snapshot{ system, std::nullopt, 0, false })
+   , m_free(m_snapshots.size())
+   // One more for the stop entry
+   , m_filled(m_snapshots.size() + 1)
+   , m_consume(consume)
+{
+   for (int index = 0; index < static_cast<int>(m_snapshots.size()); ++index)
+      m_free.try_push(index);
+   m_consumer = std::thread([this]() {consume_snapshots(); });
+}
+
+
+magneto::SnapshotPipeline::~SnapshotPipeline() {
+   if (!m_consumer.joinable())
+      return;
+   m_filled.try_push(stop_index);
+   m_consumer.join();
+}
+
+
+void magneto::SnapshotPipeline::push(
+   const IsingSystem& system, const std::optional<ClusterStatistics>& cluster_statistics, const unsigned int iteration
+) {
+   Snapshot& snapshot = get_free_snapshot();
+   // Same dimensions every time, so this copies without allocating
+   snapshot.system.get_lattice_nc() = system.get_lattice();
+   snapshot.cluster_statistics = cluster_statistics;
+   snapshot.iteration = iteration;
+   snapshot.is_final = false;
+   m_filled.try_push(m_current);
+}
+
+
+void magneto::SnapshotPipeline::finish(const IsingSystem& system) {
+   Snapshot& snapshot = get_free_snapshot();
+   snapshot.system.get_lattice_nc() = system.get_lattice();
+   snapshot.cluster_statistics = std::nullopt;
+   snapshot.is_final = true;
+   m_filled.try_push(m_current);
+   m_consumer.join();
+   rethrow_consume_error();
+}
+
+
+magneto::Snapshot& magneto::SnapshotPipeline::get_free_snapshot() {
+   // A failed consumer returns no more snapshots
+   wait_until([&]() {return m_has_failed.load(std::memory_order_acquire) || m_free.try_pop(m_current); });
+   rethrow_consume_error();
+   return m_snapshots[m_current];
+}
+
+
+void magneto::SnapshotPipeline::rethrow_consume_error() const {
+   if (m_has_failed.load(std::memory_order_acquire))
+      std::rethrow_exception(m_consume_error);
+}
+
+
+void magneto::SnapshotPipeline::consume_snapshots() {
+   while (true) {
+      int index = stop_index;
+      wait_until([&]() {return m_filled.try_pop(index); });
+      if (index == stop_index)
+         return;
+      const Snapshot& snapshot = m_snapshots[index];
+      try {
+         m_consume(snapshot);
+      }
+      catch (...) {
+         // Escaping the thread would terminate the program
+         m_consume_error = std::current_exception();
+         m_has_failed.store(true, std::memory_order_release);
+         return;
+      }
+      if (snapshot.is_final)
+         return;
+      m_free.try_push(index);
+   }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "IsingSystem.h"
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <vector>
+
+
+namespace magneto {
+
+   /// <summary>Lock-free queue of fixed capacity between exactly one producer and one consumer thread</summary>
+   template<class T>
+   class SpscQueue {
+   public:
+      SpscQueue(const size_t capacity) : m_items(capacity + 1) { }
+
+      /// <summary>Fails if the queue is full</summary>
+      bool try_push(const T& item) {
+         const size_t tail = m_tail.load(std::memory_order_relaxed);
+         const size_t next = tail + 1 == m_items.size() ? 0 : tail + 1;
+         if (next == m_head.load(std::memory_order_acquire))
+            return false;
+         m_items[tail] = item;
+         m_tail.store(next, std::memory_order_release);
+         return true;
+      }
+
+      /// <summary>Fails if the queue is empty</summary>
+      bool try_pop(T& item) {
+         const size_t head = m_head.load(std::memory_order_relaxed);
+         if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+         item = m_items[head];
+         m_head.store(head + 1 == m_items.size() ? 0 : head + 1, std::memory_order_release);
+         return true;
+      }
+
+   private:
+      std::vector<T> m_items;
+
+      // On separate cache lines, so producer and consumer don't invalidate each other's index
+      alignas(64) std::atomic<size_t> m_head{ 0 };
+      alignas(64) std::atomic<size_t> m_tail{ 0 };
+   };
+
+
+   /// <summary>State of the system after one iteration, together with what the algorithm knew about it</summary>
+   struct Snapshot {
+      IsingSystem system;
+      std::optional<ClusterStatistics> cluster_statistics;
+      unsigned int iteration = 0;
+
+      // The state after the last iteration, which is not measured
+      bool is_final = false;
+   };
+
+
+   /// <summary>Measures on a separate thread while the simulation goes on.
+   /// <para>push() copies the lattice into a free snapshot of a ring and hands it to the consumer
+   /// thread, which calls consume on it and returns it to the ring. Both directions are lock-free
+   /// queues. The producer only waits if all snapshots are in use, i.e. the consumer is depth
+   /// iterations behind.</para>
+   /// <para>If consume throws, the consumer stops and push() or finish() rethrow the exception.</para>
+   /// </summary>
+   class CLASS_DECLSPEC SnapshotPipeline {
+   public:
+      SnapshotPipeline(const IsingSystem& system, const size_t depth, const std::function<void(const Snapshot&)>& consume);
+
+      /// <summary>If finish() wasn't called, the consumer still handles the snapshots pushed so far and then stops</summary>
+      ~SnapshotPipeline();
+
+      void push(const IsingSystem& system, const std::optional<ClusterStatistics>& cluster_statistics, const unsigned int iteration);
+
+      /// <summary>Pushes the final state and waits until the consumer is done with everything</summary>
+      void finish(const IsingSystem& system);
+
+   private:
+      Snapshot& get_free_snapshot();
+      void consume_snapshots();
+      void rethrow_consume_error() const;
+
+      std::vector<Snapshot> m_snapshots;
+      SpscQueue<int> m_free;
+      SpscQueue<int> m_filled;
+      std::function<void(const Snapshot&)> m_consume;
+      int m_current = 0;
+
+      // Set by the consumer thread before it stops on an exception from consume
+      std::exception_ptr m_consume_error;
+      std::atomic<bool> m_has_failed{ false };
+
+      std::thread m_consumer;
+   };
+
+}
@@ -0,0 +1,280 @@
+#include "SpinModelAlgorithms.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+
+
+namespace {
+
+   /// <summary>Periodic neighbours right, left, down, up of a row-major site</summary>
+   std::array<int, 4> get_neighbours(const int site, const int Lx, const int Ly) {
+      const int i = site / Lx;
+      const int j = site % Lx;
+      return {
+         j + 1 == Lx ? site - (Lx - 1) : site + 1,
+         j == 0 ? site + (Lx - 1) : site - 1,
+         i + 1 == Ly ? j : site + Lx,
+         i == 0 ? (Ly - 1) * Lx + j : site - Lx
+      };
+   }
+
+
+   /// <summary>(a - b) mod q for states in [0, q)</summary>
+   int get_difference(const int a, const int b, const int q) {
+      const int difference = a - b;
+      return difference < 0 ? difference + q : difference;
+   }
+
+
+   template<class TModel>
+   std::vector<double> get_bond_energies(const int q) {
+      std::vector<double> energies(q);
+      for (int d = 0; d < q; ++d)
+         energies[d] = TModel::get_bond_energy(d, q);
+      return energies;
+   }
+
+
+   // The first Wolff run grows clusters for this many sweeps and counts the clusters of the
+   // second half, once the state forgot the random start
+   constexpr int wolff_calibration_sweeps = 20;
+
+
+   std::mt19937 get_seeded_rng() {
+      return std::mt19937(static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count()));
+   }
+
+} // namespace {}
+
+
+template<int Bits>
+magneto::ModelLattice<Bits> magneto::get_randomized_model_lattice(const int Lx, const int Ly, const int q) {
+   std::mt19937_64 rng(std::chrono::system_clock::now().time_since_epoch().count());
+   std::uniform_int_distribution<int> dist(0, q - 1);
+   ModelLattice<Bits> lattice{ Lx, Ly, q, PackedSpins<Bits>(static_cast<size_t>(Lx) * Ly) };
+   for (size_t site = 0; site < lattice.spins.size(); ++site)
+      lattice.spins.set(site, dist(rng));
+   return lattice;
+}
+
+
+template<class TModel>
+magneto::PhysicalMeasurement magneto::get_model_measurement(const ModelLattice<TModel::bits>& lattice) {
+   const std::vector<double> energies = get_bond_energies<TModel>(lattice.q);
+   std::vector<long long> state_counts(lattice.q, 0);
+   double energy = 0.0;
+   const int N = lattice.Lx * lattice.Ly;
+   for (int site = 0; site < N; ++site) {
+      const std::array<int, 4> neighbours = get_neighbours(site, lattice.Lx, lattice.Ly);
+      const int s = lattice.spins.get(site);
+      energy += energies[get_difference(s, lattice.spins.get(neighbours[0]), lattice.q)];
+      energy += energies[get_difference(s, lattice.spins.get(neighbours[2]), lattice.q)];
+      ++state_counts[s];
+   }
+
+   PhysicalMeasurement measurement;
+   measurement.energy = energy / N;
+   measurement.magnetization = TModel::get_order_parameter(state_counts, N);
+   return measurement;
+}
+
+
+template<class TModel>
+magneto::ModelMetropolis<TModel>::ModelMetropolis(const int J, const double T, const int q)
+   : m_q(q)
+   , m_factors(q * q)
+   , m_rng(get_seeded_rng())
+{
+   const std::vector<double> energies = get_bond_energies<TModel>(q);
+   for (int d = 0; d < q; ++d) {
+      for (int d_proposed = 0; d_proposed < q; ++d_proposed)
+         m_factors[d * q + d_proposed] = std::exp(-J * (energies[d_proposed] - energies[d]) / T);
+   }
+}
+
+
+template<class TModel>
+void magneto::ModelMetropolis<TModel>::run(ModelLattice<TModel::bits>& lattice) {
+   const int N = lattice.Lx * lattice.Ly;
+   const int q = m_q;
+   std::uniform_int_distribution<int> site_dist(0, N - 1);
+   std::uniform_real_distribution<double> uniform(0.0, 1.0);
+   for (int step = 0; step < N; ++step) {
+      const int site = site_dist(m_rng);
+      const int s = lattice.spins.get(site);
+
+      // The integer part of r picks the proposal, the fraction decides
+      const double r = uniform(m_rng) * (q - 1);
+      const int shift = static_cast<int>(r);
+      int proposal = s + 1 + shift;
+      proposal = proposal >= q ? proposal - q : proposal;
+
+      double weight = 1.0;
+      for (const int neighbour : get_neighbours(site, lattice.Lx, lattice.Ly)) {
+         const int n = lattice.spins.get(neighbour);
+         weight *= m_factors[get_difference(s, n, q) * q + get_difference(proposal, n, q)];
+      }
+      if (r - shift < weight)
+         lattice.spins.set(site, proposal);
+   }
+}
+
+
+template<class TModel>
+magneto::PottsSW<TModel>::PottsSW(const int J, const double T, const int q)
+   : m_q(q)
+   , m_freeze_probability(1.0 - std::exp(-J / T))
+   , m_rng(get_seeded_rng())
+{ }
+
+
+template<class TModel>
+void magneto::PottsSW<TModel>::run(ModelLattice<TModel::bits>& lattice) {
+   const int N = lattice.Lx * lattice.Ly;
+   std::uniform_real_distribution<double> uniform(0.0, 1.0);
+   std::uniform_int_distribution<int> state_dist(0, m_q - 1);
+
+   m_scratch.start_run(N);
+   for (int site = 0; site < N; ++site) {
+      const std::array<int, 4> neighbours = get_neighbours(site, lattice.Lx, lattice.Ly);
+      const int s = lattice.spins.get(site);
+      unsigned char frozen = 0;
+      if (s == lattice.spins.get(neighbours[0]) && uniform(m_rng) < m_freeze_probability)
+         frozen |= 1;
+      if (s == lattice.spins.get(neighbours[2]) && uniform(m_rng) < m_freeze_probability)
+         frozen |= 2;
+      m_scratch.set_frozen(site, frozen);
+   }
+
+   // Bonds are fixed, so setting the new state during the search is fine
+   for (int start = 0; start < N; ++start) {
+      if (m_scratch.is_discovered(start))
+         continue;
+      const int state = state_dist(m_rng);
+      m_scratch.discover(start);
+      while (m_scratch.has_next()) {
+         const int site = m_scratch.pop();
+         const std::array<int, 4> neighbours = get_neighbours(site, lattice.Lx, lattice.Ly);
+         const bool bonds[4] = {
+            m_scratch.is_frozen(site, 0), m_scratch.is_frozen(neighbours[1], 0),
+            m_scratch.is_frozen(site, 1), m_scratch.is_frozen(neighbours[3], 1)
+         };
+         for (int n = 0; n < 4; ++n) {
+            if (bonds[n] && !m_scratch.is_discovered(neighbours[n]))
+               m_scratch.discover(neighbours[n]);
+         }
+         lattice.spins.set(site, state);
+      }
+   }
+}
+
+
+template<class TModel>
+magneto::ModelWolff<TModel>::ModelWolff(const int J, const double T, const int q)
+   : m_q(q)
+   , m_freeze_probabilities(q * q)
+   , m_rng(get_seeded_rng())
+{
+   const std::vector<double> energies = get_bond_energies<TModel>(q);
+   for (int d_mapped = 0; d_mapped < q; ++d_mapped) {
+      for (int d = 0; d < q; ++d) {
+         const double dE = J * (energies[d_mapped] - energies[d]);
+         m_freeze_probabilities[d_mapped * q + d] = 1.0 - std::exp(-std::max(0.0, dE) / T);
+      }
+   }
+}
+
+
+template<class TModel>
+void magneto::ModelWolff<TModel>::run(ModelLattice<TModel::bits>& lattice) {
+   const int N = lattice.Lx * lattice.Ly;
+   m_cluster_numbers.resize(N, 0);
+   if (m_clusters_per_run == 0) {
+      const int half = wolff_calibration_sweeps / 2;
+      int counted_clusters = 0;
+      for (int mapped = 0; mapped < wolff_calibration_sweeps * N; ) {
+         mapped += grow_cluster(lattice);
+         counted_clusters += mapped > half * N ? 1 : 0;
+      }
+      m_clusters_per_run = static_cast<unsigned int>(std::max(1, (counted_clusters + half / 2) / half));
+   }
+
+   for (unsigned int cluster = 0; cluster < m_clusters_per_run; ++cluster)
+      grow_cluster(lattice);
+}
+
+
+template<class TModel>
+int magneto::ModelWolff<TModel>::grow_cluster(ModelLattice<TModel::bits>& lattice) {
+   const int N = lattice.Lx * lattice.Ly;
+   const int q = m_q;
+   std::uniform_int_distribution<int> site_dist(0, N - 1);
+   std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+   const int seed = site_dist(m_rng);
+   const std::vector<int> involution = TModel::get_involution(lattice.spins.get(seed), q, m_rng);
+   if (++m_cluster_number == 0) {
+      std::fill(std::begin(m_cluster_numbers), std::end(m_cluster_numbers), 0);
+      m_cluster_number = 1;
+   }
+
+   // Sites are mapped when they leave the stack, the ones waiting still have their old state
+   int size = 0;
+   m_cluster_numbers[seed] = m_cluster_number;
+   m_stack.assign(1, seed);
+   while (!m_stack.empty()) {
+      const int site = m_stack.back();
+      m_stack.pop_back();
+      const int s = lattice.spins.get(site);
+      const int s_mapped = involution[s];
+      for (const int neighbour : get_neighbours(site, lattice.Lx, lattice.Ly)) {
+         if (m_cluster_numbers[neighbour] == m_cluster_number)
+            continue;
+         const int n = lattice.spins.get(neighbour);
+         const double p = m_freeze_probabilities[get_difference(s_mapped, n, q) * q + get_difference(s, n, q)];
+         if (p > 0.0 && uniform(m_rng) < p) {
+            m_cluster_numbers[neighbour] = m_cluster_number;
+            m_stack.emplace_back(neighbour);
+         }
+      }
+      lattice.spins.set(site, s_mapped);
+      ++size;
+   }
+   return size;
+}
+
+
+template magneto::ModelLattice<1> magneto::get_randomized_model_lattice<1>(const int Lx, const int Ly, const int q);
+template magneto::ModelLattice<2> magneto::get_randomized_model_lattice<2>(const int Lx, const int Ly, const int q);
+template magneto::ModelLattice<4> magneto::get_randomized_model_lattice<4>(const int Lx, const int Ly, const int q);
+template magneto::ModelLattice<8> magneto::get_randomized_model_lattice<8>(const int Lx, const int Ly, const int q);
+template magneto::PhysicalMeasurement magneto::get_model_measurement<magneto::PottsModel<1>>(const ModelLattice<1>& lattice);
+template magneto::PhysicalMeasurement magneto::get_model_measurement<magneto::PottsModel<2>>(const ModelLattice<2>& lattice);
+template magneto::PhysicalMeasurement magneto::get_model_measurement<magneto::PottsModel<4>>(const ModelLattice<4>& lattice);
+template magneto::PhysicalMeasurement magneto::get_model_measurement<magneto::PottsModel<8>>(const ModelLattice<8>& lattice);
+template magneto::PhysicalMeasurement magneto::get_model_measurement<magneto::ClockModel<1>>(const ModelLattice<1>& lattice);
+template magneto::PhysicalMeasurement magneto::get_model_measurement<magneto::ClockModel<2>>(const ModelLattice<2>& lattice);
+template magneto::PhysicalMeasurement magneto::get_model_measurement<magneto::ClockModel<4>>(const ModelLattice<4>& lattice);
+template magneto::PhysicalMeasurement magneto::get_model_measurement<magneto::ClockModel<8>>(const ModelLattice<8>& lattice);
+template class CLASS_DECLSPEC magneto::ModelMetropolis<magneto::PottsModel<1>>;
+template class CLASS_DECLSPEC magneto::ModelMetropolis<magneto::PottsModel<2>>;
+template class CLASS_DECLSPEC magneto::ModelMetropolis<magneto::PottsModel<4>>;
+template class CLASS_DECLSPEC magneto::ModelMetropolis<magneto::PottsModel<8>>;
+template class CLASS_DECLSPEC magneto::ModelMetropolis<magneto::ClockModel<1>>;
+template class CLASS_DECLSPEC magneto::ModelMetropolis<magneto::ClockModel<2>>;
+template class CLASS_DECLSPEC magneto::ModelMetropolis<magneto::ClockModel<4>>;
+template class CLASS_DECLSPEC magneto::ModelMetropolis<magneto::ClockModel<8>>;
+template class CLASS_DECLSPEC magneto::PottsSW<magneto::PottsModel<1>>;
+template class CLASS_DECLSPEC magneto::PottsSW<magneto::PottsModel<2>>;
+template class CLASS_DECLSPEC magneto::PottsSW<magneto::PottsModel<4>>;
+template class CLASS_DECLSPEC magneto::PottsSW<magneto::PottsModel<8>>;
+template class CLASS_DECLSPEC magneto::ModelWolff<magneto::PottsModel<1>>;
+template class CLASS_DECLSPEC magneto::ModelWolff<magneto::PottsModel<2>>;
+template class CLASS_DECLSPEC magneto::ModelWolff<magneto::PottsModel<4>>;
+template class CLASS_DECLSPEC magneto::ModelWolff<magneto::PottsModel<8>>;
+template class CLASS_DECLSPEC magneto::ModelWolff<magneto::ClockModel<1>>;
+template class CLASS_DECLSPEC magneto::ModelWolff<magneto::ClockModel<2>>;
+template class CLASS_DECLSPEC magneto::ModelWolff<magneto::ClockModel<4>>;
+template class CLASS_DECLSPEC magneto::ModelWolff<magneto::ClockModel<8>>;
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "IsingSystem.h"
+#include "ClusterScratch.h"
+#include "SpinModels.h"
+#include "export_macro.h"
+
+#include <random>
+#include <vector>
+
+
+namespace magneto {
+
+   template<int Bits>
+   [[nodiscard]] ModelLattice<Bits> get_randomized_model_lattice(const int Lx, const int Ly, const int q);
+
+   /// <summary>Energy per site in units of J and the order parameter: for Potts
+   /// (q max_s n_s / N - 1) / (q - 1), for clock |Sum exp(2 pi i s / q)| / N</summary>
+   template<class TModel>
+   [[nodiscard]] PhysicalMeasurement get_model_measurement(const ModelLattice<TModel::bits>& lattice);
+
+
+   template<class TModel>
+   class ModelAlgorithm {
+   public:
+      virtual ~ModelAlgorithm() = default;
+      virtual void run(ModelLattice<TModel::bits>& lattice) = 0;
+   };
+
+
+   /// <summary>Metropolis for a spin model. A site proposes one of its q-1 other states. The
+   /// acceptance is the product of one table factor per neighbour, indexed by the bond's
+   /// difference before and after.</summary>
+   template<class TModel>
+   class ModelMetropolis : public ModelAlgorithm<TModel> {
+   public:
+      ModelMetropolis(const int J, const double T, const int q);
+      virtual void run(ModelLattice<TModel::bits>& lattice);
+
+   private:
+      int m_q;
+      // exp(-J (e(d') - e(d)) / T) at d*q+d'
+      std::vector<double> m_factors;
+      std::mt19937 m_rng;
+   };
+
+
+   /// <summary>Swendsen-Wang for the ferromagnetic Potts model. Bonds between equal states freeze
+   /// with 1-exp(-J/T), every cluster gets a new random state.</summary>
+   template<class TModel>
+   class PottsSW : public ModelAlgorithm<TModel> {
+   public:
+      PottsSW(const int J, const double T, const int q);
+      virtual void run(ModelLattice<TModel::bits>& lattice);
+
+   private:
+      int m_q;
+      double m_freeze_probability;
+      std::mt19937 m_rng;
+
+      // Scratch space, kept between runs. Frozen bit 0 is the bond to the right, bit 1 down.
+      ClusterScratch m_scratch;
+   };
+
+
+   /// <summary>Wolff single-cluster updates with the involution of the model. A bond to a
+   /// neighbour outside freezes with 1-exp(-max(0, dE)/T), where dE is the bond energy change if
+   /// only the cluster site was mapped.
+   /// <para>Every run grows the same number of clusters. Stopping once N sites were mapped would
+   /// make the count depend on the state and bias the measurements. The first run calibrates the
+   /// count to about one sweep by growing clusters for several sweeps.</para>
+   /// </summary>
+   template<class TModel>
+   class ModelWolff : public ModelAlgorithm<TModel> {
+   public:
+      ModelWolff(const int J, const double T, const int q);
+      virtual void run(ModelLattice<TModel::bits>& lattice);
+
+   private:
+      /// <summary>Grows and maps one cluster from a random seed, returns its size</summary>
+      int grow_cluster(ModelLattice<TModel::bits>& lattice);
+
+      int m_q;
+      unsigned int m_clusters_per_run = 0;
+      // Freeze probability at d_mapped*q+d
+      std::vector<double> m_freeze_probabilities;
+      std::mt19937 m_rng;
+      // Site is in the current cluster if its entry equals the cluster number
+      std::vector<unsigned int> m_cluster_numbers;
+      unsigned int m_cluster_number = 0;
+      std::vector<int> m_stack;
+   };
+
+
+   extern template class CLASS_DECLSPEC ModelMetropolis<PottsModel<1>>;
+   extern template class CLASS_DECLSPEC ModelMetropolis<PottsModel<2>>;
+   extern template class CLASS_DECLSPEC ModelMetropolis<PottsModel<4>>;
+   extern template class CLASS_DECLSPEC ModelMetropolis<PottsModel<8>>;
+   extern template class CLASS_DECLSPEC ModelMetropolis<ClockModel<1>>;
+   extern template class CLASS_DECLSPEC ModelMetropolis<ClockModel<2>>;
+   extern template class CLASS_DECLSPEC ModelMetropolis<ClockModel<4>>;
+   extern template class CLASS_DECLSPEC ModelMetropolis<ClockModel<8>>;
+   extern template class CLASS_DECLSPEC PottsSW<PottsModel<1>>;
+   extern template class CLASS_DECLSPEC PottsSW<PottsModel<2>>;
+   extern template class CLASS_DECLSPEC PottsSW<PottsModel<4>>;
+   extern template class CLASS_DECLSPEC PottsSW<PottsModel<8>>;
+   extern template class CLASS_DECLSPEC ModelWolff<PottsModel<1>>;
+   extern template class CLASS_DECLSPEC ModelWolff<PottsModel<2>>;
+   extern template class CLASS_DECLSPEC ModelWolff<PottsModel<4>>;
+   extern template class CLASS_DECLSPEC ModelWolff<PottsModel<8>>;
+   extern template class CLASS_DECLSPEC ModelWolff<ClockModel<1>>;
+   extern template class CLASS_DECLSPEC ModelWolff<ClockModel<2>>;
+   extern template class CLASS_DECLSPEC ModelWolff<ClockModel<4>>;
+   extern template class CLASS_DECLSPEC ModelWolff<ClockModel<8>>;
+
+}
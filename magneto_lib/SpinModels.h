@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+namespace magneto {
+
+   /// <summary>Spins of Bits bits each, packed into 64 bit words. Bits is a power of two, so no
+   /// spin straddles two words.</summary>
+   template<int Bits>
+   class PackedSpins {
+   public:
+      static_assert(Bits == 1 || Bits == 2 || Bits == 4 || Bits == 8, "Spins are packed with 1, 2, 4 or 8 bits");
+      static constexpr int per_word = 64 / Bits;
+      static constexpr std::uint64_t mask = (std::uint64_t(1) << Bits) - 1;
+
+      PackedSpins(const size_t count) : m_words((count + per_word - 1) / per_word, 0), m_count(count) {}
+
+      int get(const size_t i) const {
+         return static_cast<int>((m_words[i / per_word] >> (i % per_word * Bits)) & mask);
+      }
+
+      void set(const size_t i, const int value) {
+         const int shift = static_cast<int>(i % per_word * Bits);
+         std::uint64_t& word = m_words[i / per_word];
+         word = (word & ~(mask << shift)) | (static_cast<std::uint64_t>(value) << shift);
+      }
+
+      size_t size() const { return m_count; }
+
+   private:
+      std::vector<std::uint64_t> m_words;
+      size_t m_count;
+   };
+
+
+   /// <summary>Periodic square lattice of q-state spins in [0, q), row-major</summary>
+   template<int Bits>
+   struct ModelLattice {
+      int Lx;
+      int Ly;
+      int q;
+      PackedSpins<Bits> spins;
+   };
+
+
+   /// <summary>Number of bits to store q states</summary>
+   [[nodiscard]] constexpr int get_spin_bits(const int q) {
+      return q <= 2 ? 1 : (q <= 4 ? 2 : (q <= 16 ? 4 : 8));
+   }
+
+
+   // A spin model defines the energy of a bond by the difference d = (s_i - s_j) mod q of its two
+   // states, in units of J, the order parameter from the number of sites in every state, and the
+   // involutions for embedded cluster moves: a map R of the states with R(R(s)) = s that leaves
+   // the energy of bonds inside a cluster unchanged.
+
+   /// <summary>q-state Potts model, E = -J Sum delta(s_i, s_j). The involution swaps the state
+   /// of the seed with a random other state.</summary>
+   template<int Bits>
+   struct PottsModel {
+      static constexpr int bits = Bits;
+
+      static double get_bond_energy(const int difference, const int /*q*/) {
+         return difference == 0 ? -1.0 : 0.0;
+      }
+
+      static double get_order_parameter(const std::vector<long long>& state_counts, const long long N) {
+         const int q = static_cast<int>(state_counts.size());
+         const long long majority = *std::max_element(std::cbegin(state_counts), std::cend(state_counts));
+         return (1.0 * q * majority / N - 1.0) / (q - 1);
+      }
+
+      static std::vector<int> get_involution(const int seed_state, const int q, std::mt19937& rng) {
+         std::vector<int> involution(q);
+         for (int s = 0; s < q; ++s)
+            involution[s] = s;
+         const int other = (seed_state + 1 + std::uniform_int_distribution<int>(0, q - 2)(rng)) % q;
+         std::swap(involution[seed_state], involution[other]);
+         return involution;
+      }
+   };
+
+
+   /// <summary>q-state clock model, E = -J Sum cos(2 pi (s_i - s_j) / q). For q=2 this is the
+   /// Ising model. The involution is the reflection s -> (m - s) mod q at a random axis m.</summary>
+   template<int Bits>
+   struct ClockModel {
+      static constexpr int bits = Bits;
+
+      static double get_bond_energy(const int difference, const int q) {
+         constexpr double two_pi = 6.283185307179586;
+         return -std::cos(two_pi * difference / q);
+      }
+
+      static double get_order_parameter(const std::vector<long long>& state_counts, const long long N) {
+         constexpr double two_pi = 6.283185307179586;
+         const int q = static_cast<int>(state_counts.size());
+         double x = 0.0;
+         double y = 0.0;
+         for (int s = 0; s < q; ++s) {
+            x += state_counts[s] * std::cos(two_pi * s / q);
+            y += state_counts[s] * std::sin(two_pi * s / q);
+         }
+         return std::sqrt(x * x + y * y) / N;
+      }
+
+      static std::vector<int> get_involution(const int /*seed_state*/, const int q, std::mt19937& rng) {
+         const int m = std::uniform_int_distribution<int>(0, q - 1)(rng);
+         std::vector<int> involution(q);
+         for (int s = 0; s < q; ++s)
+            involution[s] = (m - s + q) % q;
+         return involution;
+      }
+   };
+
+}
@@ -0,0 +1,268 @@
+#include "StencilAlgorithms.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+   template<class TStencil, size_t N>
+   constexpr magneto::StencilBond get_stencil_neighbour() {
+      return magneto::get_stencil_neighbours<TStencil>()[N];
+   }
+
+
+   /// <summary>Table strides of the groups, the lowest group varies fastest</summary>
+   template<class TStencil>
+   constexpr std::array<int, TStencil::group_count> get_group_strides() {
+      constexpr std::array<int, TStencil::group_count> counts = magneto::get_group_neighbour_counts<TStencil>();
+      std::array<int, TStencil::group_count> strides{};
+      int stride = 1;
+      for (int g = 0; g < TStencil::group_count; ++g) {
+         strides[g] = stride;
+         stride *= counts[g] + 1;
+      }
+      return strides;
+   }
+
+
+   template<class TStencil>
+   std::array<int, TStencil::group_count> get_group_couplings(const int J, const int J2) {
+      std::array<int, TStencil::group_count> couplings{};
+      couplings[0] = J;
+      if constexpr (TStencil::group_count > 1)
+         couplings[1] = J2;
+      return couplings;
+   }
+
+
+   /// <summary>min(1, exp(-dE/T)) for every combination of k_g = s*(neighbour sum of group g),
+   /// with dE = 2 Sum_g J_g k_g</summary>
+   template<class TStencil>
+   std::vector<double> get_stencil_acceptance(const std::array<int, TStencil::group_count>& couplings, const double T) {
+      constexpr std::array<int, TStencil::group_count> counts = magneto::get_group_neighbour_counts<TStencil>();
+      int table_size = 1;
+      for (const int count : counts)
+         table_size *= count + 1;
+      std::vector<double> acceptance;
+      for (int index = 0; index < table_size; ++index) {
+         int rest = index;
+         double dE = 0.0;
+         for (int g = 0; g < TStencil::group_count; ++g) {
+            const int k = 2 * (rest % (counts[g] + 1)) - counts[g];
+            rest /= counts[g] + 1;
+            dE += 2.0 * couplings[g] * k;
+         }
+         acceptance.emplace_back(dE <= 0.0 ? 1.0 : std::exp(-dE / T));
+      }
+      return acceptance;
+   }
+
+
+   /// <summary>1-exp(-2|J_g|/T) for every group</summary>
+   template<int GroupCount>
+   std::array<double, GroupCount> get_group_freeze_probabilities(const std::array<int, GroupCount>& couplings, const double T) {
+      std::array<double, GroupCount> probabilities;
+      for (int g = 0; g < GroupCount; ++g)
+         probabilities[g] = 1.0 - std::exp(-2.0 * std::abs(couplings[g]) / T);
+      return probabilities;
+   }
+
+
+   int get_wrapped(const int x, const int length) {
+      return x < 0 ? x + length : (x >= length ? x - length : x);
+   }
+
+
+   /// <summary>Rows and columns at the offsets -1, 0, +1 of a site, and its parity</summary>
+   struct StencilSite {
+      std::array<int, 3> rows;
+      std::array<int, 3> columns;
+      int parity;
+   };
+
+
+   StencilSite get_stencil_site(const int i, const int j, const int Lx, const int Ly) {
+      return {
+         { get_wrapped(i - 1, Ly), i, get_wrapped(i + 1, Ly) },
+         { get_wrapped(j - 1, Lx), j, get_wrapped(j + 1, Lx) },
+         (i + j) & 1
+      };
+   }
+
+
+   /// <summary>Neighbour sum of every group, unrolled over the neighbours of the stencil</summary>
+   template<class TStencil>
+   std::array<int, TStencil::group_count> get_group_sums(const magneto::LatticeType& lattice, const StencilSite& site) {
+      constexpr size_t neighbour_count = 2 * TStencil::forward_bonds.size();
+      std::array<int, TStencil::group_count> sums{};
+      magneto::for_each_stencil_index<neighbour_count>([&](auto n) {
+         constexpr magneto::StencilBond bond = get_stencil_neighbour<TStencil, decltype(n)::value>();
+         const char spin = lattice[site.rows[bond.di + 1]][site.columns[bond.dj + 1]];
+         if constexpr (bond.parity < 0)
+            sums[bond.group] += spin;
+         else
+            sums[bond.group] += site.parity == bond.parity ? spin : 0;
+      });
+      return sums;
+   }
+
+
+   template<class TStencil>
+   long long get_stencil_energy_sum(const magneto::LatticeType& grid, const std::array<int, TStencil::group_count>& couplings) {
+      const auto [Lx, Ly] = magneto::get_dimensions_of_lattice(grid);
+      long long sum = 0;
+      for (int i = 0; i < static_cast<int>(Ly); ++i) {
+         for (int j = 0; j < static_cast<int>(Lx); ++j) {
+            const StencilSite site = get_stencil_site(i, j, Lx, Ly);
+            const char spin = grid[i][j];
+            magneto::for_each_stencil_index<TStencil::forward_bonds.size()>([&](auto f) {
+               constexpr magneto::StencilBond bond = TStencil::forward_bonds[decltype(f)::value];
+               if (bond.parity < 0 || site.parity == bond.parity)
+                  sum += couplings[bond.group] * spin * grid[site.rows[bond.di + 1]][site.columns[bond.dj + 1]];
+            });
+         }
+      }
+      return sum;
+   }
+
+} // namespace {}
+
+
+template<class TStencil>
+magneto::StencilMetropolis<TStencil>::StencilMetropolis(const int J, const int J2, const double T, RandomStreams& streams)
+   : m_lattice_index_buffer(streams.get_lattice_indices())
+   , m_random_buffer(streams.get_uniforms())
+   , m_couplings(get_group_couplings<TStencil>(J, J2))
+   , m_acceptance(get_stencil_acceptance<TStencil>(m_couplings, T))
+{ }
+
+
+template<class TStencil>
+void magneto::StencilMetropolis<TStencil>::run(LatticeType& lattice) {
+   constexpr std::array<int, TStencil::group_count> counts = get_group_neighbour_counts<TStencil>();
+   constexpr std::array<int, TStencil::group_count> strides = get_group_strides<TStencil>();
+   const auto [Lx, Ly] = get_dimensions_of_lattice(lattice);
+   const IndexPairVector& indices = m_lattice_index_buffer->get_buffer();
+   const std::vector<double>& randoms = m_random_buffer->get_buffer();
+   for (size_t step = 0; step < randoms.size(); ++step) {
+      const auto [i, j] = indices[step];
+      const std::array<int, TStencil::group_count> sums = get_group_sums<TStencil>(lattice, get_stencil_site(i, j, Lx, Ly));
+      char& spin = lattice[i][j];
+      int index = 0;
+      for (int g = 0; g < TStencil::group_count; ++g)
+         index += ((spin * sums[g] + counts[g]) >> 1) * strides[g];
+      if (randoms[step] < m_acceptance[index])
+         spin = -spin;
+   }
+
+   m_random_buffer->refill();
+   m_lattice_index_buffer->refill();
+}
+
+
+template<class TStencil>
+bool magneto::StencilMetropolis<TStencil>::set_temperature(const double T) {
+   m_acceptance = get_stencil_acceptance<TStencil>(m_couplings, T);
+   return true;
+}
+
+
+template<class TStencil>
+magneto::StencilSW<TStencil>::StencilSW(const int J, const int J2, const double T, RandomStreams& streams)
+   : m_random_buffer(streams.get_cluster_uniforms())
+   , m_couplings(get_group_couplings<TStencil>(J, J2))
+   , m_freeze_probability(get_group_freeze_probabilities<TStencil::group_count>(m_couplings, T))
+{ }
+
+
+template<class TStencil>
+bool magneto::StencilSW<TStencil>::set_temperature(const double T) {
+   m_freeze_probability = get_group_freeze_probabilities<TStencil::group_count>(m_couplings, T);
+   return true;
+}
+
+
+template<class TStencil>
+void magneto::StencilSW<TStencil>::run(LatticeType& lattice) {
+   constexpr size_t forward_count = TStencil::forward_bonds.size();
+   const auto [Lx_u, Ly_u] = get_dimensions_of_lattice(lattice);
+   const int Lx = static_cast<int>(Lx_u);
+   const int Ly = static_cast<int>(Ly_u);
+
+   // Freeze satisfied bonds, one buffer per forward bond. The first one overwrites all sites.
+   m_scratch.start_run(Lx * Ly);
+   for_each_stencil_index<forward_count>([&](auto f) {
+      constexpr StencilBond bond = TStencil::forward_bonds[decltype(f)::value];
+      const std::vector<double>& randoms = m_random_buffer->get_buffer();
+      for (int i = 0; i < Ly; ++i) {
+         const std::vector<char>& row = lattice[i];
+         const std::vector<char>& neighbour_row = lattice[get_wrapped(i + bond.di, Ly)];
+         for (int j = 0; j < Lx; ++j) {
+            const int site = i * Lx + j;
+            const int coupling = m_couplings[bond.group];
+            const bool is_frozen = (bond.parity < 0 || ((i + j) & 1) == bond.parity)
+               && coupling * row[j] * neighbour_row[get_wrapped(j + bond.dj, Lx)] > 0
+               && randoms[site] < m_freeze_probability[bond.group];
+            if constexpr (decltype(f)::value == 0)
+               m_scratch.set_frozen(site, is_frozen);
+            else
+               m_scratch.add_frozen(site, static_cast<unsigned char>(is_frozen << decltype(f)::value));
+         }
+      }
+      m_random_buffer->refill();
+   });
+
+   // Grow and flip the clusters. Bonds are fixed, so flipping during the search is fine.
+   const std::vector<double>& randoms = m_random_buffer->get_buffer();
+   for (int start = 0; start < Lx * Ly; ++start) {
+      if (m_scratch.is_discovered(start))
+         continue;
+      const bool flip_cluster = randoms[start] < 0.5;
+      m_scratch.discover(start);
+      while (m_scratch.has_next()) {
+         const int site = m_scratch.pop();
+         const int i = site / Lx;
+         const int j = site % Lx;
+         const auto visit = [&](const int neighbour, const bool is_frozen) {
+            if (is_frozen && !m_scratch.is_discovered(neighbour))
+               m_scratch.discover(neighbour);
+         };
+         for_each_stencil_index<forward_count>([&](auto f) {
+            constexpr StencilBond bond = TStencil::forward_bonds[decltype(f)::value];
+            const int forward = get_wrapped(i + bond.di, Ly) * Lx + get_wrapped(j + bond.dj, Lx);
+            const int backward = get_wrapped(i - bond.di, Ly) * Lx + get_wrapped(j - bond.dj, Lx);
+            visit(forward, m_scratch.is_frozen(site, decltype(f)::value));
+            visit(backward, m_scratch.is_frozen(backward, decltype(f)::value));
+         });
+         if (flip_cluster)
+            lattice[i][j] = -lattice[i][j];
+      }
+   }
+   m_random_buffer->refill();
+}
+
+
+long long magneto::get_stencil_energy_sum(const LatticeType& grid, const int J, const Geometry& geometry) {
+   if (geometry.lattice == LatticeGeometry::Triangular)
+      return ::get_stencil_energy_sum<TriangularStencil>(grid, get_group_couplings<TriangularStencil>(J, geometry.J2));
+   if (geometry.lattice == LatticeGeometry::Honeycomb)
+      return ::get_stencil_energy_sum<HoneycombStencil>(grid, get_group_couplings<HoneycombStencil>(J, geometry.J2));
+   if (geometry.lattice == LatticeGeometry::SquareNNN)
+      return ::get_stencil_energy_sum<SquareNNNStencil>(grid, get_group_couplings<SquareNNNStencil>(J, geometry.J2));
+   if (geometry.lattice == LatticeGeometry::Anisotropic)
+      return ::get_stencil_energy_sum<AnisotropicStencil>(grid, get_group_couplings<AnisotropicStencil>(J, geometry.J2));
+   return ::get_stencil_energy_sum<SquareStencil>(grid, get_group_couplings<SquareStencil>(J, geometry.J2));
+}
+
+
+template class CLASS_DECLSPEC magneto::StencilMetropolis<magneto::SquareStencil>;
+template class CLASS_DECLSPEC magneto::StencilMetropolis<magneto::AnisotropicStencil>;
+template class CLASS_DECLSPEC magneto::StencilMetropolis<magneto::TriangularStencil>;
+template class CLASS_DECLSPEC magneto::StencilMetropolis<magneto::HoneycombStencil>;
+template class CLASS_DECLSPEC magneto::StencilMetropolis<magneto::SquareNNNStencil>;
+template class CLASS_DECLSPEC magneto::StencilSW<magneto::SquareStencil>;
+template class CLASS_DECLSPEC magneto::StencilSW<magneto::AnisotropicStencil>;
+template class CLASS_DECLSPEC magneto::StencilSW<magneto::TriangularStencil>;
+template class CLASS_DECLSPEC magneto::StencilSW<magneto::HoneycombStencil>;
+template class CLASS_DECLSPEC magneto::StencilSW<magneto::SquareNNNStencil>;
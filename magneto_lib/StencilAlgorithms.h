@@ -0,0 +1,84 @@
+#pragma once
+
+#include "LatticeAlgorithms.h"
+#include "Stencils.h"
+
+
+namespace magneto {
+
+   /// <summary>Metropolis on the geometry of TStencil. The neighbour sums are unrolled at compile
+   /// time and grouped by coupling, the acceptance of every combination of group sums is
+   /// tabulated. Use get_stencil_algorithm() to get the right instantiation.</summary>
+   template<class TStencil>
+   class StencilMetropolis : public LatticeAlgorithm {
+   public:
+      StencilMetropolis(const int J, const int J2, const double T, RandomStreams& streams);
+      virtual void run(LatticeType& lattice);
+
+      /// <summary>Only rebuilds the acceptance table</summary>
+      virtual bool set_temperature(const double T);
+
+   private:
+      std::shared_ptr<IndexStream> m_lattice_index_buffer;
+      std::shared_ptr<UniformStream> m_random_buffer;
+      std::array<int, TStencil::group_count> m_couplings;
+      std::vector<double> m_acceptance;
+   };
+
+   extern template class CLASS_DECLSPEC StencilMetropolis<SquareStencil>;
+   extern template class CLASS_DECLSPEC StencilMetropolis<AnisotropicStencil>;
+   extern template class CLASS_DECLSPEC StencilMetropolis<TriangularStencil>;
+   extern template class CLASS_DECLSPEC StencilMetropolis<HoneycombStencil>;
+   extern template class CLASS_DECLSPEC StencilMetropolis<SquareNNNStencil>;
+
+
+   /// <summary>Swendsen-Wang on the geometry of TStencil. Satisfied bonds freeze with probability
+   /// 1-exp(-2|J_g|/T) of their group. Clusters aren't recorded, the improved estimators assume
+   /// the square lattice.</summary>
+   template<class TStencil>
+   class StencilSW : public LatticeAlgorithm {
+   public:
+      // One run takes a buffer per forward bond of the stencil and one for the cluster flips
+      StencilSW(const int J, const int J2, const double T, RandomStreams& streams);
+      virtual void run(LatticeType& lattice);
+
+      /// <summary>Only rebuilds the freeze probabilities</summary>
+      virtual bool set_temperature(const double T);
+
+   private:
+      std::shared_ptr<UniformStream> m_random_buffer;
+      std::array<int, TStencil::group_count> m_couplings;
+      std::array<double, TStencil::group_count> m_freeze_probability;
+
+      // Scratch space, kept between runs. Frozen bit f is forward bond f of the site.
+      ClusterScratch m_scratch;
+   };
+
+   extern template class CLASS_DECLSPEC StencilSW<SquareStencil>;
+   extern template class CLASS_DECLSPEC StencilSW<AnisotropicStencil>;
+   extern template class CLASS_DECLSPEC StencilSW<TriangularStencil>;
+   extern template class CLASS_DECLSPEC StencilSW<HoneycombStencil>;
+   extern template class CLASS_DECLSPEC StencilSW<SquareNNNStencil>;
+
+
+   /// <summary>Instantiates TAlgorithm for the lattice geometry, args are passed on to the
+   /// constructor</summary>
+   template<template<class> class TAlgorithm, class... TArgs>
+   std::unique_ptr<LatticeAlgorithm> get_stencil_algorithm(const LatticeGeometry lattice, TArgs&&... args) {
+      if (lattice == LatticeGeometry::Triangular)
+         return std::make_unique<TAlgorithm<TriangularStencil>>(std::forward<TArgs>(args)...);
+      if (lattice == LatticeGeometry::Honeycomb)
+         return std::make_unique<TAlgorithm<HoneycombStencil>>(std::forward<TArgs>(args)...);
+      if (lattice == LatticeGeometry::SquareNNN)
+         return std::make_unique<TAlgorithm<SquareNNNStencil>>(std::forward<TArgs>(args)...);
+      if (lattice == LatticeGeometry::Anisotropic)
+         return std::make_unique<TAlgorithm<AnisotropicStencil>>(std::forward<TArgs>(args)...);
+      return std::make_unique<TAlgorithm<SquareStencil>>(std::forward<TArgs>(args)...);
+   }
+
+
+   /// <summary>Sum over all bonds of the geometry of J_ij s_i s_j. Divided by J it is the bond sum
+   /// of the other lattices.</summary>
+   [[nodiscard]] CLASS_DECLSPEC long long get_stencil_energy_sum(const LatticeType& grid, const int J, const Geometry& geometry);
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstdlib>
+#include <utility>
+
+
+namespace magneto {
+
+   /// <summary>Bond from site (i,j) to site (i+di, j+dj) with the coupling of its group. A bond
+   /// with a parity only exists at the sites with (i+j)%2 == parity.</summary>
+   struct StencilBond {
+      int di;
+      int dj;
+      int group;
+      int parity = -1;
+   };
+
+   // Every stencil lists its forward bonds on the square array, so that every bond of the
+   // lattice belongs to exactly one site. Groups are numbered from 0 and take J, J2.
+
+   struct SquareStencil {
+      static constexpr int group_count = 1;
+      static constexpr std::array<StencilBond, 2> forward_bonds{ { {0, 1, 0}, {1, 0, 0} } };
+   };
+
+   /// <summary>Square lattice with J horizontally and J2 vertically</summary>
+   struct AnisotropicStencil {
+      static constexpr int group_count = 2;
+      static constexpr std::array<StencilBond, 2> forward_bonds{ { {0, 1, 0}, {1, 0, 1} } };
+   };
+
+   /// <summary>Triangular lattice as a square array with one diagonal</summary>
+   struct TriangularStencil {
+      static constexpr int group_count = 1;
+      static constexpr std::array<StencilBond, 3> forward_bonds{ { {0, 1, 0}, {1, 0, 0}, {1, 1, 0} } };
+   };
+
+   /// <summary>Honeycomb lattice as a brick wall: horizontal bonds everywhere, vertical bonds down
+   /// from every even site. Needs even Lx and Ly.</summary>
+   struct HoneycombStencil {
+      static constexpr int group_count = 1;
+      static constexpr std::array<StencilBond, 2> forward_bonds{ { {0, 1, 0}, {1, 0, 0, 0} } };
+   };
+
+   /// <summary>Square lattice with J to the nearest and J2 to the diagonal neighbours</summary>
+   struct SquareNNNStencil {
+      static constexpr int group_count = 2;
+      static constexpr std::array<StencilBond, 4> forward_bonds{ { {0, 1, 0}, {1, 0, 0}, {1, 1, 1}, {1, -1, 1} } };
+   };
+
+
+   /// <summary>All neighbours of a site: the forward bonds followed by the reversed ones</summary>
+   template<class TStencil>
+   constexpr std::array<StencilBond, 2 * TStencil::forward_bonds.size()> get_stencil_neighbours() {
+      constexpr size_t forward_count = TStencil::forward_bonds.size();
+      std::array<StencilBond, 2 * forward_count> neighbours{};
+      for (size_t f = 0; f < forward_count; ++f) {
+         const StencilBond bond = TStencil::forward_bonds[f];
+         neighbours[f] = bond;
+         const int reverse_parity = bond.parity < 0 ? -1 : (bond.parity + std::abs(bond.di) + std::abs(bond.dj)) % 2;
+         neighbours[forward_count + f] = { -bond.di, -bond.dj, bond.group, reverse_parity };
+      }
+      return neighbours;
+   }
+
+
+   /// <summary>Number of neighbours of every site in each group</summary>
+   template<class TStencil>
+   constexpr std::array<int, TStencil::group_count> get_group_neighbour_counts() {
+      std::array<int, TStencil::group_count> counts{};
+      for (const StencilBond& bond : TStencil::forward_bonds)
+         counts[bond.group] += bond.parity < 0 ? 2 : 1;
+      return counts;
+   }
+
+
+   template<class TFun, size_t... N>
+   void for_each_stencil_index(TFun&& fun, std::index_sequence<N...>) {
+      (fun(std::integral_constant<size_t, N>()), ...);
+   }
+
+
+   /// <summary>Calls fun with std::integral_constant indices 0..Count-1, fully unrolled</summary>
+   template<size_t Count, class TFun>
+   void for_each_stencil_index(TFun&& fun) {
+      for_each_stencil_index(std::forward<TFun>(fun), std::make_index_sequence<Count>());
+   }
+
+}
@@ -213,3 +213,8 @@ void magneto::NullImageWriter::snapshot(const LatticeType& /*grid*/, const bool
 
 void magneto::NullImageWriter::end_actions()
 {}
+
+
+void magneto::VisualOutput::snapshot_slice(const FlatLattice<3>& lattice, const int z, const bool last_frame) {
+   snapshot(get_lattice_slice(lattice, z), last_frame);
+}
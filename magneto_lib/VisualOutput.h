@@ -1,6 +1,7 @@
 #pragma once
 
 #include "IsingSystem.h"
+#include "FlatLattice.h"
 #include "Job.h"
 
 namespace magneto {
@@ -9,6 +10,9 @@ namespace magneto {
    public:
       virtual void snapshot(const LatticeType& grid, const bool last_frame = false) = 0;
       virtual void end_actions() = 0;
+
+      /// <summary>Snapshot of the z slice of a three-dimensional lattice</summary>
+      void snapshot_slice(const FlatLattice<3>& lattice, const int z, const bool last_frame = false);
    };
 
 
@@ -0,0 +1,177 @@
+#include "fft_tools.h"
+
+#include <cmath>
+
+
+namespace {
+   constexpr double pi = 3.141592653589793;
+
+   bool is_power_of_two(const size_t n) {
+      return n > 0 && (n & (n - 1)) == 0;
+   }
+
+
+   size_t get_radix2_size(const size_t n) {
+      if (is_power_of_two(n))
+         return n;
+      // Bluestein needs a convolution length of at least 2n-1
+      size_t m = 1;
+      while (m < 2 * n - 1)
+         m <<= 1;
+      return m;
+   }
+
+
+   /// <summary>Transforms the columns of a row-major complex 2D array</summary>
+   void transform_columns(
+      std::vector<std::complex<double>>& data, const size_t Lx, const size_t Ly, const magneto::FFTPlan& plan, const bool inverse
+   ) {
+      std::vector<std::complex<double>> column(Ly);
+      for (size_t j = 0; j < Lx; ++j) {
+         for (size_t i = 0; i < Ly; ++i)
+            column[i] = data[i * Lx + j];
+         plan.transform(column.data(), inverse);
+         for (size_t i = 0; i < Ly; ++i)
+            data[i * Lx + j] = column[i];
+      }
+   }
+
+} // namespace {}
+
+
+magneto::FFTPlan::FFTPlan(const size_t n)
+   : m_n(n)
+   , m_radix2_n(get_radix2_size(n))
+{
+   // Bit reversal permutation and twiddles of the radix-2 transform
+   size_t bits = 0;
+   while ((size_t(1) << bits) < m_radix2_n)
+      ++bits;
+   m_bit_reversal.resize(m_radix2_n);
+   for (size_t k = 0; k < m_radix2_n; ++k) {
+      size_t reversed = 0;
+      for (size_t b = 0; b < bits; ++b)
+         reversed |= ((k >> b) & 1) << (bits - 1 - b);
+      m_bit_reversal[k] = reversed;
+   }
+   for (size_t k = 0; k < m_radix2_n / 2; ++k)
+      m_twiddles.emplace_back(std::polar(1.0, -2.0 * pi * k / m_radix2_n));
+
+   if (is_power_of_two(n))
+      return;
+
+   // Chirp w_k = exp(-i pi k^2/n). k^2 is reduced modulo 2n for accuracy
+   m_chirp.resize(n);
+   for (size_t k = 0; k < n; ++k) {
+      const size_t k2 = (k * k) % (2 * n);
+      m_chirp[k] = std::polar(1.0, -pi * k2 / n);
+   }
+   m_chirp_filter.assign(m_radix2_n, 0.0);
+   m_chirp_filter[0] = std::conj(m_chirp[0]);
+   for (size_t k = 1; k < n; ++k) {
+      m_chirp_filter[k] = std::conj(m_chirp[k]);
+      m_chirp_filter[m_radix2_n - k] = std::conj(m_chirp[k]);
+   }
+   radix2_transform(m_chirp_filter.data(), false);
+}
+
+
+size_t magneto::FFTPlan::size() const {
+   return m_n;
+}
+
+
+void magneto::FFTPlan::transform(std::complex<double>* data, const bool inverse) const {
+   if (m_n == m_radix2_n)
+      radix2_transform(data, inverse);
+   else
+      bluestein_transform(data, inverse);
+}
+
+
+void magneto::FFTPlan::radix2_transform(std::complex<double>* data, const bool inverse) const {
+   const size_t n = m_radix2_n;
+   for (size_t k = 0; k < n; ++k) {
+      if (k < m_bit_reversal[k])
+         std::swap(data[k], data[m_bit_reversal[k]]);
+   }
+   for (size_t len = 2; len <= n; len <<= 1) {
+      const size_t half = len / 2;
+      const size_t step = n / len;
+      for (size_t start = 0; start < n; start += len) {
+         for (size_t k = 0; k < half; ++k) {
+            const std::complex<double> w = inverse ? std::conj(m_twiddles[k * step]) : m_twiddles[k * step];
+            const std::complex<double> u = data[start + k];
+            const std::complex<double> v = data[start + k + half] * w;
+            data[start + k] = u + v;
+            data[start + k + half] = u - v;
+         }
+      }
+   }
+   if (inverse) {
+      for (size_t k = 0; k < n; ++k)
+         data[k] /= static_cast<double>(n);
+   }
+}
+
+
+void magneto::FFTPlan::bluestein_transform(std::complex<double>* data, const bool inverse) const {
+   // The inverse is the conjugated forward transform of the conjugated input
+   std::vector<std::complex<double>> a(m_radix2_n, 0.0);
+   for (size_t k = 0; k < m_n; ++k)
+      a[k] = (inverse ? std::conj(data[k]) : data[k]) * m_chirp[k];
+   radix2_transform(a.data(), false);
+   for (size_t k = 0; k < m_radix2_n; ++k)
+      a[k] *= m_chirp_filter[k];
+   radix2_transform(a.data(), true);
+   for (size_t k = 0; k < m_n; ++k) {
+      const std::complex<double> result = a[k] * m_chirp[k];
+      data[k] = inverse ? std::conj(result) / static_cast<double>(m_n) : result;
+   }
+}
+
+
+std::vector<double> magneto::get_power_spectrum(const std::vector<double>& field, const FFTPlan& plan_x, const FFTPlan& plan_y) {
+   const size_t Lx = plan_x.size();
+   const size_t Ly = plan_y.size();
+   std::vector<std::complex<double>> data(Lx * Ly);
+   std::vector<std::complex<double>> packed(Lx);
+
+   // Row transforms, two real rows a and b packed as a + ib
+   for (size_t i = 0; i < Ly; i += 2) {
+      const bool has_pair = i + 1 < Ly;
+      for (size_t j = 0; j < Lx; ++j)
+         packed[j] = { field[i * Lx + j], has_pair ? field[(i + 1) * Lx + j] : 0.0 };
+      plan_x.transform(packed.data());
+      for (size_t k = 0; k < Lx; ++k) {
+         const std::complex<double> z = packed[k];
+         const std::complex<double> z_mirror = std::conj(packed[(Lx - k) % Lx]);
+         data[i * Lx + k] = 0.5 * (z + z_mirror);
+         if (has_pair)
+            data[(i + 1) * Lx + k] = std::complex<double>(0.0, -0.5) * (z - z_mirror);
+      }
+   }
+   transform_columns(data, Lx, Ly, plan_y, false);
+
+   std::vector<double> power(Lx * Ly);
+   for (size_t k = 0; k < data.size(); ++k)
+      power[k] = std::norm(data[k]);
+   return power;
+}
+
+
+std::vector<double> magneto::get_inverse_transform_real(
+   const std::vector<double>& spectrum, const FFTPlan& plan_x, const FFTPlan& plan_y
+) {
+   const size_t Lx = plan_x.size();
+   const size_t Ly = plan_y.size();
+   std::vector<std::complex<double>> data(std::cbegin(spectrum), std::cend(spectrum));
+   for (size_t i = 0; i < Ly; ++i)
+      plan_x.transform(&data[i * Lx], true);
+   transform_columns(data, Lx, Ly, plan_y, true);
+
+   std::vector<double> result(Lx * Ly);
+   for (size_t k = 0; k < data.size(); ++k)
+      result[k] = data[k].real();
+   return result;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "export_macro.h"
+
+#include <complex>
+#include <vector>
+
+
+namespace magneto {
+
+   /// <summary>Self-contained discrete Fourier transform of a fixed length. Powers of two use an
+   /// iterative radix-2 FFT, all other lengths Bluestein's algorithm on top of it. Twiddle
+   /// factors are computed once per plan.</summary>
+   class CLASS_DECLSPEC FFTPlan {
+   public:
+      explicit FFTPlan(const size_t n);
+
+      /// <summary>In-place transform with exp(-2 pi i jk/n) kernel, or the inverse including the
+      /// 1/n normalization.</summary>
+      void transform(std::complex<double>* data, const bool inverse = false) const;
+      size_t size() const;
+
+   private:
+      void radix2_transform(std::complex<double>* data, const bool inverse) const;
+      void bluestein_transform(std::complex<double>* data, const bool inverse) const;
+
+      size_t m_n;
+      size_t m_radix2_n;
+      std::vector<size_t> m_bit_reversal;
+      std::vector<std::complex<double>> m_twiddles;
+
+      // Bluestein chirp and the transformed, zero padded conjugate chirp
+      std::vector<std::complex<double>> m_chirp;
+      std::vector<std::complex<double>> m_chirp_filter;
+   };
+
+
+   /// <summary>Power spectrum |F(k)|^2 of a real 2D field stored row-major, the plans have the
+   /// length of a row and of a column. Two real rows are transformed at once as one complex row.</summary>
+   CLASS_DECLSPEC std::vector<double> get_power_spectrum(const std::vector<double>& field, const FFTPlan& plan_x, const FFTPlan& plan_y);
+
+   /// <summary>Inverse 2D transform of a real and symmetric spectrum, e.g. to get a correlation
+   /// function from a power spectrum (Wiener-Khinchin)</summary>
+   CLASS_DECLSPEC std::vector<double> get_inverse_transform_real(
+      const std::vector<double>& spectrum, const FFTPlan& plan_x, const FFTPlan& plan_y
+   );
+
+}
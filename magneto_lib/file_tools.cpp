@@ -170,3 +170,27 @@ std::filesystem::path magneto::FileResizer::get_resized_image_path(const std::fi
    new_path.replace_filename(new_filename);
    return new_path;
 }
+
+
+std::optional<magneto::BondCouplings> magneto::get_bond_couplings_from_file(const std::filesystem::path& path) {
+   const std::optional<std::string> contents = get_file_contents(path);
+   if (!contents.has_value()) {
+      magneto::get_logger()->error("Couldn't open bond file {}", path.string());
+      return std::nullopt;
+   }
+   std::stringstream stream(contents.value());
+   BondCouplings couplings;
+   stream >> couplings.Lx >> couplings.Ly;
+   for (std::vector<signed char>* bonds : { &couplings.east, &couplings.south }) {
+      for (unsigned int site = 0; site < couplings.Lx * couplings.Ly; ++site) {
+         int coupling = 0;
+         stream >> coupling;
+         if (!stream || coupling < -127 || coupling > 127) {
+            magneto::get_logger()->error("Bond file {} is malformed at coupling {}", path.string(), site);
+            return std::nullopt;
+         }
+         bonds->emplace_back(static_cast<signed char>(coupling));
+      }
+   }
+   return couplings;
+}
@@ -12,6 +12,10 @@ namespace magneto {
    
    std::optional<LatticeType> get_spin_state_from_png(const std::filesystem::path& path);
 
+   /// <summary>Reads bond couplings from a text file: Lx and Ly, followed by Lx*Ly east and Lx*Ly
+   /// south couplings, row-major. Couplings are integers in [-127, 127].</summary>
+   std::optional<BondCouplings> get_bond_couplings_from_file(const std::filesystem::path& path);
+
    class FileResizer {
    public:
       FileResizer(const std::filesystem::path& path, const int new_x, const int new_y);
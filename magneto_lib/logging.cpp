@@ -1,21 +1,61 @@
 #include "logging.h"
+#include <spdlog/async.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/sinks/basic_file_sink.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
 
 
-std::shared_ptr<spdlog::logger> magneto::get_logger() {
-   const std::string logger_name = "magneto_logger";
-   auto logger = spdlog::get(logger_name);
-   if (!logger) {
+namespace {
+
+   constexpr size_t log_queue_size = 8192;
+
+   // Every logger that was created, so handed out handles stay valid after a shutdown. A deque
+   // doesn't move its elements when it grows.
+   std::mutex logger_mutex;
+   std::deque<std::shared_ptr<spdlog::logger>> loggers;
+   std::atomic<const std::shared_ptr<spdlog::logger>*> current_logger{ nullptr };
+
+
+   /// <summary>Only the first logger truncates the log file, later ones append to it</summary>
+   std::shared_ptr<spdlog::logger> get_new_logger(const bool truncate) {
+      const std::string logger_name = "magneto_logger";
+      spdlog::init_thread_pool(log_queue_size, 1);
       std::vector<spdlog::sink_ptr> sinks;
       sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
-      sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>("log.txt", true));
-      logger = std::make_shared<spdlog::logger>(logger_name,
+      sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>("log.txt", truncate));
+      auto logger = std::make_shared<spdlog::async_logger>(logger_name,
          std::begin(sinks),
-         std::end(sinks));
+         std::end(sinks),
+         spdlog::thread_pool(),
+         spdlog::async_overflow_policy::overrun_oldest);
       spdlog::register_logger(logger);
       logger->set_level(spdlog::level::info);
       spdlog::set_pattern("[%T] %^%v%$");
+      return logger;
+   }
+
+} // namespace {}
+
+
+const std::shared_ptr<spdlog::logger>& magneto::get_logger() {
+   // Published once and read without a lock, the RNG threads ask for it on every buffer fill
+   if (const std::shared_ptr<spdlog::logger>* logger = current_logger.load(std::memory_order_acquire))
+      return *logger;
+
+   const std::lock_guard<std::mutex> lock(logger_mutex);
+   if (current_logger.load(std::memory_order_relaxed) == nullptr) {
+      loggers.emplace_back(get_new_logger(loggers.empty()));
+      current_logger.store(&loggers.back(), std::memory_order_release);
    }
-   return logger;
+   return *current_logger.load(std::memory_order_relaxed);
+}
+
+
+void magneto::shutdown_logger() {
+   // The current logger would keep logging into the destroyed thread pool
+   const std::lock_guard<std::mutex> lock(logger_mutex);
+   current_logger.store(nullptr, std::memory_order_release);
+   spdlog::shutdown();
 }
@@ -6,5 +6,11 @@
 
 
 namespace magneto {
-   CLASS_DECLSPEC std::shared_ptr<spdlog::logger> get_logger();
+   /// <summary>Asynchronous logger, created on first use. Messages go through a bounded queue to
+   /// one worker thread, the oldest ones are dropped if it overflows, so logging never blocks.</summary>
+   CLASS_DECLSPEC const std::shared_ptr<spdlog::logger>& get_logger();
+
+   /// <summary>Writes the queued messages and stops the worker thread, start() calls it at the end.
+   /// The next get_logger() creates a new logger and thread pool, which appends to the log file.</summary>
+   CLASS_DECLSPEC void shutdown_logger();
 }
@@ -6,11 +6,20 @@
 #include "ProgressIndicator.h"
 #include "windows.h"
 #include "LatticeAlgorithms.h"
+#include "MultispinMetropolis.h"
+#include "BatchedMetropolis.h"
+#include "RandomBondAlgorithms.h"
+#include "StencilAlgorithms.h"
+#include "BoundaryAlgorithms.h"
+#include "FlatLattice.h"
+#include "SpinModelAlgorithms.h"
+#include "SnapshotPipeline.h"
 #include "file_tools.h"
 #include "physics_tools.h"
 #include "logging.h"
 
 #include <execution>
+#include <numeric>
 #include <sstream>
 
 
@@ -59,40 +68,163 @@ std::unique_ptr<magneto::VisualOutput> get_visual_output(
 std::unique_ptr<magneto::LatticeAlgorithm> get_lattice_algorithm(
    const magneto::Algorithm& alg, 
    const magneto::LatticeDType& lattice_temps,
-   const int Lx,
-   const int Ly,
-   const int J
+   const magneto::Job& job,
+   magneto::RandomStreams& streams
 ) {
-   if (alg == magneto::Algorithm::Metropolis) {
-         return std::make_unique<magneto::VariableMetropolis>(J, lattice_temps, Lx, Ly);
+   // There are no multi-spin coded, microcanonical or Kawasaki variants for image temperatures
+   if (alg == magneto::Algorithm::Metropolis || alg == magneto::Algorithm::Multispin
+      || alg == magneto::Algorithm::Creutz || alg == magneto::Algorithm::Kawasaki) {
+         return magneto::get_specialized_algorithm<magneto::VariableMetropolis>(job.m_J, job.m_Lx, job.m_Ly, lattice_temps, streams);
    }
    else {
-      return std::make_unique<magneto::VariableSW>(J, lattice_temps, Lx, Ly);
+      return std::make_unique<magneto::VariableSW>(job.m_J, lattice_temps, streams);
    }
 }
 
 
+std::unique_ptr<magneto::LatticeAlgorithm> get_bond_algorithm(
+   const magneto::Algorithm& alg,
+   const double T,
+   const magneto::Job& job,
+   magneto::RandomStreams& streams
+) {
+   if (alg == magneto::Algorithm::SW)
+      return std::make_unique<magneto::BondSW>(job.m_couplings, T, streams);
+   if (magneto::is_power_of_two(job.m_Lx) && magneto::is_power_of_two(job.m_Ly))
+      return std::make_unique<magneto::BondMetropolis<true>>(job.m_couplings, T, streams);
+   return std::make_unique<magneto::BondMetropolis<false>>(job.m_couplings, T, streams);
+}
+
+
 std::unique_ptr<magneto::LatticeAlgorithm> get_lattice_algorithm(
    const magneto::Algorithm& alg,
    const double T,
-   const int Lx,
-   const int Ly,
-   const int J
+   const magneto::Job& job,
+   magneto::RandomStreams& streams
 ) {
-   if (alg == magneto::Algorithm::Metropolis) {
-      return std::make_unique<magneto::Metropolis>(J, T, Lx, Ly);
+   if (job.m_geometry.lattice != magneto::LatticeGeometry::Square) {
+      if (alg == magneto::Algorithm::SW)
+         return magneto::get_stencil_algorithm<magneto::StencilSW>(job.m_geometry.lattice, job.m_J, job.m_geometry.J2, T, streams);
+      return magneto::get_stencil_algorithm<magneto::StencilMetropolis>(job.m_geometry.lattice, job.m_J, job.m_geometry.J2, T, streams);
+   }
+   else if (!magneto::is_periodic_square(job.m_geometry)) {
+      if (alg == magneto::Algorithm::SW)
+         return std::make_unique<magneto::BoundarySW>(job.m_J, T, job.m_geometry, streams);
+      return std::make_unique<magneto::BoundaryMetropolis>(job.m_J, T, job.m_geometry, streams);
+   }
+   else if (job.m_couplings) {
+      return get_bond_algorithm(alg, T, job, streams);
+   }
+   else if (job.m_field) {
+      // Only Metropolis knows about the field
+      std::unique_ptr<magneto::LatticeAlgorithm> algorithm =
+         magneto::get_specialized_algorithm<magneto::Metropolis>(job.m_J, job.m_Lx, job.m_Ly, T, streams);
+      algorithm->set_field(*job.m_field);
+      return algorithm;
+   }
+   else if (alg == magneto::Algorithm::Metropolis) {
+      return magneto::get_specialized_algorithm<magneto::Metropolis>(job.m_J, job.m_Lx, job.m_Ly, T, streams);
+   }
+   else if (alg == magneto::Algorithm::Creutz) {
+      return std::make_unique<magneto::CreutzDemon>(job.m_J, T, job.m_Lx, job.m_Ly);
+   }
+   else if (alg == magneto::Algorithm::Kawasaki) {
+      return std::make_unique<magneto::Kawasaki>(job.m_J, T, streams);
    }
    else {
-      return std::make_unique<magneto::SW>(J, T, Lx, Ly);
+      return std::make_unique<magneto::SW>(job.m_J, T, streams);
    }
 }
 
 
 template<class TTemp>
-void warmup_system(magneto::IsingSystem& system, const TTemp& T, const unsigned int runs) {
-   const auto [Lx, Ly] = magneto::get_dimensions_of_lattice(system.get_lattice());
-   auto alg = get_lattice_algorithm(magneto::Algorithm::SW, T, Lx, Ly, system.get_J());
-   for (unsigned int i = 1; i < runs; ++i) {
+std::unique_ptr<magneto::LatticeAlgorithm> get_lattice_algorithm(
+   const magneto::Algorithm& alg, const TTemp& T, const magneto::Job& job
+) {
+   magneto::RandomStreams streams(job.m_Lx, job.m_Ly);
+   return get_lattice_algorithm(alg, T, job, streams);
+}
+
+
+/// <summary>Composite algorithm for an update schedule, all steps draw from the same random streams</summary>
+template<class TTemp>
+std::unique_ptr<magneto::LatticeAlgorithm> get_scheduled_algorithm(
+   const std::vector<magneto::ScheduleStep>& schedule, const TTemp& T, const magneto::Job& job
+) {
+   magneto::RandomStreams streams(job.m_Lx, job.m_Ly);
+   std::vector<magneto::ScheduledAlgorithm::Component> components;
+   for (const magneto::ScheduleStep& step : schedule)
+      components.emplace_back(get_lattice_algorithm(step.m_algorithm, T, job, streams), step.m_n);
+   return std::make_unique<magneto::ScheduledAlgorithm>(std::move(components));
+}
+
+
+std::string get_algorithm_name(const magneto::Algorithm alg) {
+   if (alg == magneto::Algorithm::Metropolis)
+      return "metropolis";
+   else if (alg == magneto::Algorithm::SW)
+      return "SW";
+   else if (alg == magneto::Algorithm::Multispin)
+      return "multispin";
+   else if (alg == magneto::Algorithm::Creutz)
+      return "creutz";
+   else if (alg == magneto::Algorithm::Kawasaki)
+      return "kawasaki";
+   return "auto";
+}
+
+
+/// <summary>Pilot-runs every candidate algorithm on a copy of the system and returns the one
+/// with the most effectively independent samples per second, i.e. 1/(2 tau_int * time per step).
+/// tau_int is the larger one of energy and magnetization.</summary>
+template<class TTemp>
+magneto::Algorithm select_algorithm(const magneto::IsingSystem& system, const TTemp& T, const magneto::Job& job) {
+   const std::string temp_string = get_temperature_string(T);
+   magneto::Algorithm best_algorithm = magneto::Algorithm::Metropolis;
+   double best_rate = -1.0;
+   std::string decision_details;
+   for (const magneto::Algorithm candidate : { magneto::Algorithm::Metropolis, magneto::Algorithm::SW }) {
+      magneto::IsingSystem pilot_system(system);
+      auto alg = get_lattice_algorithm(candidate, T, job);
+      std::vector<double> energies;
+      std::vector<double> mags;
+      const auto start = std::chrono::steady_clock::now();
+      for (unsigned int i = 0; i < job.m_auto_pilot_runs; ++i) {
+         alg->run(pilot_system.get_lattice_nc());
+         const magneto::PhysicalMeasurement measurement = get_properties(pilot_system);
+         energies.emplace_back(measurement.energy);
+         mags.emplace_back(measurement.magnetization);
+      }
+      const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+      const double time_per_step = duration.count() / std::max(1u, job.m_auto_pilot_runs);
+      const double tau = std::max(
+         magneto::get_integrated_autocorrelation_time(energies),
+         magneto::get_integrated_autocorrelation_time(mags)
+      );
+      const double samples_per_second = 1.0 / (2.0 * tau * time_per_step);
+      decision_details += fmt::format(
+         " {}: tau={:.2f}, {:.3f}ms/step, {:.1f} samples/s;",
+         get_algorithm_name(candidate), tau, 1000.0 * time_per_step, samples_per_second
+      );
+      if (samples_per_second > best_rate) {
+         best_rate = samples_per_second;
+         best_algorithm = candidate;
+      }
+   }
+   magneto::get_logger()->info(
+      "Auto algorithm for T={}: {} chosen.{}", temp_string, get_algorithm_name(best_algorithm), decision_details
+   );
+   return best_algorithm;
+}
+
+
+/// <summary>Start runs with the start schedule of the job, Swendsen-Wang by default</summary>
+template<class TTemp>
+void warmup_system(magneto::IsingSystem& system, const TTemp& T, const magneto::Job& job) {
+   const std::vector<magneto::ScheduleStep> schedule = job.m_start_schedule.empty() ?
+      std::vector<magneto::ScheduleStep>{ {magneto::Algorithm::SW, 1} } : job.m_start_schedule;
+   auto alg = get_scheduled_algorithm(schedule, T, job);
+   for (unsigned int i = 1; i < job.m_start_runs; ++i) {
       alg->run(system.get_lattice_nc());
    }
 }
@@ -107,35 +239,129 @@ double get_t_representation_for_measurements(const magneto::LatticeDType& /*t*/)
 }
 
 
+/// <summary>One correlation accumulator per lattice, or none if correlations aren't measured</summary>
+std::vector<magneto::CorrelationAccumulator> get_correlation_accumulators(const magneto::Job& job, const size_t count) {
+   const magneto::PhysicsConfig& config = job.m_physics_config;
+   if (config.m_correlation_path.empty() && config.m_structure_factor_path.empty())
+      return {};
+   return std::vector<magneto::CorrelationAccumulator>(count, magneto::CorrelationAccumulator(job.m_Lx, job.m_Ly));
+}
+
+
+bool is_correlation_iteration(const magneto::Job& job, const unsigned int iteration) {
+   return job.m_physics_config.m_correlation_stride > 0 && iteration % job.m_physics_config.m_correlation_stride == 0;
+}
+
+
+void set_correlation_results(magneto::PhysicalProperties& properties, const magneto::CorrelationAccumulator& correlation) {
+   properties.correlation_function = correlation.get_correlation_function();
+   properties.structure_factor = correlation.get_structure_factor();
+}
+
+
+/// <summary>Metropolis takes its random numbers from the common source, if there is one</summary>
+std::unique_ptr<magneto::LatticeAlgorithm> get_lattice_algorithm(
+   const magneto::Algorithm& alg,
+   const double T,
+   const magneto::Job& job,
+   const std::shared_ptr<magneto::CommonRandomSource>& common_randoms
+) {
+   if (common_randoms && alg == magneto::Algorithm::Metropolis && !job.m_couplings && magneto::is_periodic_square(job.m_geometry)) {
+      std::unique_ptr<magneto::LatticeAlgorithm> algorithm =
+         magneto::get_specialized_algorithm<magneto::Metropolis>(job.m_J, job.m_Lx, job.m_Ly, T, common_randoms);
+      if (job.m_field)
+         algorithm->set_field(*job.m_field);
+      return algorithm;
+   }
+   return get_lattice_algorithm(alg, T, job);
+}
+
+
+std::unique_ptr<magneto::LatticeAlgorithm> get_lattice_algorithm(
+   const magneto::Algorithm& alg,
+   const magneto::LatticeDType& lattice_temps,
+   const magneto::Job& job,
+   const std::shared_ptr<magneto::CommonRandomSource>& /*common_randoms*/
+) {
+   // Image temperatures are a single lattice, there is nobody to share with
+   return get_lattice_algorithm(alg, lattice_temps, job);
+}
+
+
 template<class TTemp>
 magneto::PhysicalProperties get_physical_properties(
    const TTemp T, 
-   const magneto::Job& job
+   const magneto::Job& job,
+   const std::shared_ptr<magneto::CommonRandomSource>& common_randoms = nullptr
 ) {
    const std::string temp_string = get_temperature_string(T);
    std::unique_ptr<magneto::VisualOutput> visual_output(get_visual_output(job.m_image_mode.m_mode, job.m_Lx, job.m_Ly, job.m_image_mode, temp_string));
-   std::unique_ptr<magneto::LatticeAlgorithm> algorithm(get_lattice_algorithm(job.m_algorithm, T, job.m_Lx, job.m_Ly, job.m_J));
 
    magneto::get_logger()->info("Starting computations for {}X{} System, T={}", job.m_Lx, job.m_Ly, temp_string);
-	magneto::IsingSystem system(job.m_J, job.initial_spins);
+	magneto::IsingSystem system(job.m_J, job.initial_spins, job.m_couplings, job.m_field, job.m_geometry);
+
+   warmup_system(system, T, job);
 
-   warmup_system(system, T, job.m_start_runs);
+   std::unique_ptr<magneto::LatticeAlgorithm> algorithm;
+   if (!job.m_schedule.empty()) {
+      algorithm = get_scheduled_algorithm(job.m_schedule, T, job);
+   }
+   else {
+      const magneto::Algorithm algorithm_type = job.m_algorithm == magneto::Algorithm::Auto ?
+         select_algorithm(system, T, job) : job.m_algorithm;
+      algorithm = get_lattice_algorithm(algorithm_type, T, job, common_randoms);
+   }
 
    // Main iterations
    std::vector<magneto::PhysicalMeasurement> measurements;
-	for (unsigned int i = 1; i < job.m_n; ++i) {
-      visual_output->snapshot(system.get_lattice());
-		measurements.emplace_back(get_properties(system));
-      algorithm->run(system.get_lattice_nc());
-	}
-   visual_output->snapshot(system.get_lattice(), true);
+   magneto::MomentAccumulator moments(job.m_n - 1, job.m_physics_config.m_jackknife_bins);
+   std::vector<magneto::CorrelationAccumulator> correlations = get_correlation_accumulators(job, 1);
+   const auto measure = [&](
+      const magneto::IsingSystem& state, const std::optional<magneto::ClusterStatistics>& cluster_statistics, const unsigned int i
+   ) {
+      visual_output->snapshot(state.get_lattice());
+      if (!correlations.empty() && is_correlation_iteration(job, i))
+         correlations.front().add(state.get_lattice());
+      // Cluster algorithms already know the magnetization of the current state
+      if (cluster_statistics.has_value())
+         measurements.emplace_back(get_properties(state, cluster_statistics.value()));
+      else
+         measurements.emplace_back(get_properties(state));
+      moments.add(measurements.back());
+   };
+   if (job.m_pipeline_depth > 0) {
+      magneto::SnapshotPipeline pipeline(system, job.m_pipeline_depth, [&](const magneto::Snapshot& snapshot) {
+         if (snapshot.is_final)
+            visual_output->snapshot(snapshot.system.get_lattice(), true);
+         else
+            measure(snapshot.system, snapshot.cluster_statistics, snapshot.iteration);
+      });
+      for (unsigned int i = 1; i < job.m_n; ++i) {
+         pipeline.push(system, algorithm->get_cluster_statistics(), i);
+         algorithm->run(system.get_lattice_nc());
+      }
+      pipeline.finish(system);
+   }
+   else {
+      for (unsigned int i = 1; i < job.m_n; ++i) {
+         measure(system, algorithm->get_cluster_statistics(), i);
+         algorithm->run(system.get_lattice_nc());
+      }
+      visual_output->snapshot(system.get_lattice(), true);
+   }
    visual_output->end_actions();
 
    // compute results
    magneto::get_logger()->info("Finished computations for {}X{} System, T={}", job.m_Lx, job.m_Ly, temp_string);
-   magneto::PhysicalProperties props;
-   props.measurements = measurements;
-   return { measurements, get_t_representation_for_measurements(T), job.m_Lx, job.m_Ly };
+   const std::optional<double> measured_temperature = algorithm->get_measured_temperature();
+   if (measured_temperature.has_value())
+      magneto::get_logger()->info("Measured temperature for T={}: {:.4f}", temp_string, measured_temperature.value());
+   magneto::PhysicalProperties props{
+      measurements, get_t_representation_for_measurements(T), job.m_Lx, job.m_Ly, 1, moments.get_bins(), {}, {}
+   };
+   if (!correlations.empty())
+      set_correlation_results(props, correlations.front());
+   return props;
 }
 
 
@@ -150,6 +376,15 @@ void write_results(const std::vector<magneto::PhysicsResult>& results, const mag
             , fmt::arg("cv", result.cv)
             , fmt::arg("M", result.magnetization)
             , fmt::arg("chi", result.chi)
+            , fmt::arg("Ms", result.staggered_magnetization)
+            , fmt::arg("M2", result.m2)
+            , fmt::arg("M2_err", result.m2_err)
+            , fmt::arg("M4", result.m4)
+            , fmt::arg("M4_err", result.m4_err)
+            , fmt::arg("U4", result.binder)
+            , fmt::arg("U4_err", result.binder_err)
+            , fmt::arg("chi_imp", result.chi_improved)
+            , fmt::arg("xi", result.xi)
          );
       }
       catch (const fmt::format_error& /*e*/) {
@@ -160,32 +395,604 @@ void write_results(const std::vector<magneto::PhysicsResult>& results, const mag
 }
 
 
+/// <summary>Writes one line per temperature: the temperature followed by all values of the curve</summary>
+void write_curve_results(
+   const std::vector<magneto::PhysicsResult>& results,
+   const std::filesystem::path& path,
+   const std::function<const std::vector<double>&(const magneto::PhysicsResult&)>& get_curve
+) {
+   if (path.empty())
+      return;
+   std::string file_content;
+   for (const magneto::PhysicsResult& result : results) {
+      file_content += fmt::format("{}", result.temp);
+      for (const double value : get_curve(result))
+         file_content += fmt::format(",{}", value);
+      file_content += "\n";
+   }
+   magneto::write_string_to_file(path, file_content);
+}
+
+
+/// <summary>Runs up to 64 temperatures in one multi-spin coded system. The 64 replicas are
+/// distributed round-robin over the temperatures, their measurements are pooled.</summary>
+std::vector<magneto::PhysicalProperties> get_multispin_physical_properties(
+   const std::vector<double>& temps,
+   const magneto::Job& job
+) {
+   constexpr unsigned int replica_count = magneto::MultispinMetropolis::replica_count;
+   std::array<double, replica_count> replica_temps;
+   for (unsigned int lane = 0; lane < replica_count; ++lane)
+      replica_temps[lane] = temps[lane % temps.size()];
+
+   std::vector<std::unique_ptr<magneto::VisualOutput>> visual_outputs;
+   for (const double t : temps)
+      visual_outputs.emplace_back(get_visual_output(job.m_image_mode.m_mode, job.m_Lx, job.m_Ly, job.m_image_mode, get_temperature_string(t)));
+   const bool needs_snapshots = job.m_image_mode.m_mode == magneto::ImageOrMovie::Movie ||
+      job.m_image_mode.m_mode == magneto::ImageOrMovie::Intervals;
+
+   magneto::get_logger()->info(
+      "Starting computations for {}X{} System, {} replicas at T={}..{}",
+      job.m_Lx, job.m_Ly, replica_count, get_temperature_string(temps.front()), get_temperature_string(temps.back())
+   );
+   magneto::MultispinMetropolis algorithm(job.m_J, replica_temps, job.initial_spins);
+
+   // Swendsen-Wang can't work on the packed lattice, so the warmup uses the algorithm itself
+   for (unsigned int i = 1; i < job.m_start_runs; ++i)
+      algorithm.run();
+
+   std::vector<magneto::PhysicalProperties> properties(temps.size());
+   for (size_t t = 0; t < temps.size(); ++t)
+      properties[t] = { {}, temps[t], job.m_Lx, job.m_Ly, 1, {}, {}, {} };
+   // Lane l runs temperature l % temps.size(). If that doesn't divide the lanes evenly, the first
+   // temperatures get one replica more.
+   std::vector<magneto::MomentAccumulator> moments;
+   for (size_t t = 0; t < temps.size(); ++t) {
+      const unsigned int replicas = static_cast<unsigned int>((replica_count - t + temps.size() - 1) / temps.size());
+      moments.emplace_back((job.m_n - 1) * replicas, job.m_physics_config.m_jackknife_bins);
+   }
+   std::vector<magneto::CorrelationAccumulator> correlations = get_correlation_accumulators(job, temps.size());
+   for (unsigned int i = 1; i < job.m_n; ++i) {
+      if (needs_snapshots) {
+         for (size_t t = 0; t < temps.size(); ++t)
+            visual_outputs[t]->snapshot(algorithm.get_replica_lattice(static_cast<unsigned int>(t)));
+      }
+      if (!correlations.empty() && is_correlation_iteration(job, i)) {
+         for (size_t t = 0; t < temps.size(); ++t)
+            correlations[t].add(algorithm.get_replica_lattice(static_cast<unsigned int>(t)));
+      }
+      const auto replica_measurements = algorithm.get_measurements();
+      for (unsigned int lane = 0; lane < replica_count; ++lane) {
+         properties[lane % temps.size()].measurements.emplace_back(replica_measurements[lane]);
+         moments[lane % temps.size()].add(replica_measurements[lane]);
+      }
+      algorithm.run();
+   }
+   for (size_t t = 0; t < temps.size(); ++t) {
+      properties[t].moment_bins = moments[t].get_bins();
+      if (!correlations.empty())
+         set_correlation_results(properties[t], correlations[t]);
+      visual_outputs[t]->snapshot(algorithm.get_replica_lattice(static_cast<unsigned int>(t)), true);
+      visual_outputs[t]->end_actions();
+   }
+
+   magneto::get_logger()->info(
+      "Finished computations for {}X{} System, {} replicas at T={}..{}",
+      job.m_Lx, job.m_Ly, replica_count, get_temperature_string(temps.front()), get_temperature_string(temps.back())
+   );
+   return properties;
+}
+
+
+/// <summary>Runs a batch of temperatures as lattices of one BatchedMetropolis in a single thread</summary>
+std::vector<magneto::PhysicalProperties> get_batched_physical_properties(
+   const std::vector<double>& temps,
+   const magneto::Job& job
+) {
+   std::vector<std::unique_ptr<magneto::VisualOutput>> visual_outputs;
+   for (const double t : temps)
+      visual_outputs.emplace_back(get_visual_output(job.m_image_mode.m_mode, job.m_Lx, job.m_Ly, job.m_image_mode, get_temperature_string(t)));
+   const bool needs_snapshots = job.m_image_mode.m_mode == magneto::ImageOrMovie::Movie ||
+      job.m_image_mode.m_mode == magneto::ImageOrMovie::Intervals;
+
+   magneto::get_logger()->info(
+      "Starting computations for batch of {} {}X{} Systems, T={}..{}",
+      temps.size(), job.m_Lx, job.m_Ly, get_temperature_string(temps.front()), get_temperature_string(temps.back())
+   );
+   magneto::BatchedMetropolis algorithm(job.m_J, temps, job.initial_spins);
+
+   // The batch shares its random streams, so the warmup uses the algorithm itself
+   for (unsigned int i = 1; i < job.m_start_runs; ++i)
+      algorithm.run();
+
+   std::vector<magneto::PhysicalProperties> properties(temps.size());
+   for (size_t t = 0; t < temps.size(); ++t) {
+      properties[t] = { {}, temps[t], job.m_Lx, job.m_Ly, 1, {}, {}, {} };
+      properties[t].measurements.reserve(job.m_n);
+   }
+   std::vector<magneto::MomentAccumulator> moments(
+      temps.size(), magneto::MomentAccumulator(job.m_n - 1, job.m_physics_config.m_jackknife_bins)
+   );
+   std::vector<magneto::CorrelationAccumulator> correlations = get_correlation_accumulators(job, temps.size());
+   for (unsigned int i = 1; i < job.m_n; ++i) {
+      if (needs_snapshots) {
+         for (size_t t = 0; t < temps.size(); ++t)
+            visual_outputs[t]->snapshot(algorithm.get_lattice(t));
+      }
+      if (!correlations.empty() && is_correlation_iteration(job, i)) {
+         for (size_t t = 0; t < temps.size(); ++t)
+            correlations[t].add(algorithm.get_lattice(t));
+      }
+      const std::vector<magneto::PhysicalMeasurement> batch_measurements = algorithm.get_measurements();
+      for (size_t t = 0; t < temps.size(); ++t) {
+         properties[t].measurements.emplace_back(batch_measurements[t]);
+         moments[t].add(batch_measurements[t]);
+      }
+      algorithm.run();
+   }
+   for (size_t t = 0; t < temps.size(); ++t) {
+      properties[t].moment_bins = moments[t].get_bins();
+      if (!correlations.empty())
+         set_correlation_results(properties[t], correlations[t]);
+      visual_outputs[t]->snapshot(algorithm.get_lattice(t), true);
+      visual_outputs[t]->end_actions();
+   }
+
+   magneto::get_logger()->info(
+      "Finished computations for batch of {} {}X{} Systems, T={}..{}",
+      temps.size(), job.m_Lx, job.m_Ly, get_temperature_string(temps.front()), get_temperature_string(temps.back())
+   );
+   return properties;
+}
+
+
+/// <summary>Runs one temperature of a three-dimensional system on the flat layout. The start runs
+/// use SW, images show one z slice.</summary>
+magneto::PhysicalProperties get_physical_properties_3d(const double T, const magneto::Job& job) {
+   const std::string temp_string = get_temperature_string(T);
+   std::unique_ptr<magneto::VisualOutput> visual_output(get_visual_output(job.m_image_mode.m_mode, job.m_Lx, job.m_Ly, job.m_image_mode, temp_string));
+   const bool needs_snapshots = job.m_image_mode.m_mode == magneto::ImageOrMovie::Movie ||
+      job.m_image_mode.m_mode == magneto::ImageOrMovie::Intervals;
+   const int slice = job.m_image_mode.m_slice >= 0 && job.m_image_mode.m_slice < static_cast<int>(job.m_Lz) ?
+      job.m_image_mode.m_slice : job.m_Lz / 2;
+
+   magneto::get_logger()->info("Starting computations for {}X{}X{} System, T={}", job.m_Lx, job.m_Ly, job.m_Lz, temp_string);
+   const std::array<int, 3> extents{ static_cast<int>(job.m_Lx), static_cast<int>(job.m_Ly), static_cast<int>(job.m_Lz) };
+   magneto::FlatLattice<3> lattice = magneto::get_randomized_flat_lattice<3>(extents);
+   std::unique_ptr<magneto::FlatLatticeAlgorithm<3>> algorithm = std::make_unique<magneto::FlatSW<3>>(job.m_J, T, extents);
+   for (unsigned int i = 1; i < job.m_start_runs; ++i)
+      algorithm->run(lattice);
+
+   // There is no pilot run in 3D, auto means SW
+   if (job.m_algorithm == magneto::Algorithm::Metropolis)
+      algorithm = std::make_unique<magneto::FlatMetropolis<3>>(job.m_J, T, extents);
+
+   std::vector<magneto::PhysicalMeasurement> measurements;
+   measurements.reserve(job.m_n);
+   magneto::MomentAccumulator moments(job.m_n - 1, job.m_physics_config.m_jackknife_bins);
+   for (unsigned int i = 1; i < job.m_n; ++i) {
+      if (needs_snapshots)
+         visual_output->snapshot_slice(lattice, slice);
+      measurements.emplace_back(magneto::get_flat_measurement(lattice));
+      moments.add(measurements.back());
+      algorithm->run(lattice);
+   }
+   visual_output->snapshot_slice(lattice, slice, true);
+   visual_output->end_actions();
+
+   magneto::get_logger()->info("Finished computations for {}X{}X{} System, T={}", job.m_Lx, job.m_Ly, job.m_Lz, temp_string);
+   magneto::PhysicalProperties props{ measurements, T, job.m_Lx, job.m_Ly, job.m_Lz, moments.get_bins(), {}, {} };
+   return props;
+}
+
+
+/// <summary>SW for the ferromagnetic Potts model, Wolff otherwise</summary>
+template<class TModel>
+std::unique_ptr<magneto::ModelAlgorithm<TModel>> get_model_cluster_algorithm(const double T, const magneto::Job& job) {
+   if constexpr (std::is_same_v<TModel, magneto::PottsModel<TModel::bits>>) {
+      if (job.m_J > 0)
+         return std::make_unique<magneto::PottsSW<TModel>>(job.m_J, T, job.m_q);
+   }
+   return std::make_unique<magneto::ModelWolff<TModel>>(job.m_J, T, job.m_q);
+}
+
+
+/// <summary>Runs one temperature of a Potts or clock model. The start runs use the cluster
+/// algorithm, SW and auto propagate with it too.</summary>
+template<class TModel>
+magneto::PhysicalProperties get_model_physical_properties(const double T, const magneto::Job& job) {
+   const std::string temp_string = get_temperature_string(T);
+   magneto::get_logger()->info("Starting computations for {}X{} System with q={}, T={}", job.m_Lx, job.m_Ly, job.m_q, temp_string);
+   magneto::ModelLattice<TModel::bits> lattice = magneto::get_randomized_model_lattice<TModel::bits>(job.m_Lx, job.m_Ly, job.m_q);
+   std::unique_ptr<magneto::ModelAlgorithm<TModel>> algorithm = get_model_cluster_algorithm<TModel>(T, job);
+   for (unsigned int i = 1; i < job.m_start_runs; ++i)
+      algorithm->run(lattice);
+   if (job.m_algorithm == magneto::Algorithm::Metropolis)
+      algorithm = std::make_unique<magneto::ModelMetropolis<TModel>>(job.m_J, T, job.m_q);
+
+   std::vector<magneto::PhysicalMeasurement> measurements;
+   measurements.reserve(job.m_n);
+   magneto::MomentAccumulator moments(job.m_n - 1, job.m_physics_config.m_jackknife_bins);
+   for (unsigned int i = 1; i < job.m_n; ++i) {
+      measurements.emplace_back(magneto::get_model_measurement<TModel>(lattice));
+      moments.add(measurements.back());
+      algorithm->run(lattice);
+   }
+
+   magneto::get_logger()->info("Finished computations for {}X{} System with q={}, T={}", job.m_Lx, job.m_Ly, job.m_q, temp_string);
+   magneto::PhysicalProperties props{ measurements, T, job.m_Lx, job.m_Ly, 1, moments.get_bins(), {}, {} };
+   return props;
+}
+
+
+/// <summary>Picks the model and the packed spin width from the job</summary>
+magneto::PhysicalProperties get_model_physical_properties(const double T, const magneto::Job& job) {
+   const int bits = magneto::get_spin_bits(static_cast<int>(job.m_q));
+   if (job.m_spin_model == magneto::SpinModel::Potts) {
+      if (bits == 1)
+         return get_model_physical_properties<magneto::PottsModel<1>>(T, job);
+      if (bits == 2)
+         return get_model_physical_properties<magneto::PottsModel<2>>(T, job);
+      if (bits == 4)
+         return get_model_physical_properties<magneto::PottsModel<4>>(T, job);
+      return get_model_physical_properties<magneto::PottsModel<8>>(T, job);
+   }
+   if (bits == 1)
+      return get_model_physical_properties<magneto::ClockModel<1>>(T, job);
+   if (bits == 2)
+      return get_model_physical_properties<magneto::ClockModel<2>>(T, job);
+   if (bits == 4)
+      return get_model_physical_properties<magneto::ClockModel<4>>(T, job);
+   return get_model_physical_properties<magneto::ClockModel<8>>(T, job);
+}
+
+
+/// <summary>Splits the temperatures into batches, runs the batches in parallel and joins the
+/// results again in the original order</summary>
+std::vector<magneto::PhysicalProperties> run_job_in_batches(
+   const std::vector<double>& temps,
+   const size_t batch_size,
+   const std::function<std::vector<magneto::PhysicalProperties>(const std::vector<double>&)>& batch_fun
+) {
+   std::vector<std::vector<double>> temp_batches;
+   for (size_t start = 0; start < temps.size(); start += batch_size) {
+      const size_t end = std::min(start + batch_size, temps.size());
+      temp_batches.emplace_back(std::cbegin(temps) + start, std::cbegin(temps) + end);
+   }
+
+   std::vector<std::vector<magneto::PhysicalProperties>> batch_properties(temp_batches.size());
+   std::transform(
+      std::execution::par_unseq,
+      std::cbegin(temp_batches),
+      std::cend(temp_batches),
+      std::begin(batch_properties),
+      batch_fun
+   );
+
+   std::vector<magneto::PhysicalProperties> properties;
+   properties.reserve(temps.size());
+   for (const auto& batch : batch_properties)
+      properties.insert(std::end(properties), std::cbegin(batch), std::cend(batch));
+   return properties;
+}
+
+
 std::vector<magneto::PhysicalProperties> run_job_fixed_t(const magneto::Job& job, const std::vector<double>& temps) {
+   if (job.m_Lz > 1) {
+      std::vector<magneto::PhysicalProperties> properties(temps.size());
+      std::transform(
+         std::execution::par_unseq,
+         std::cbegin(temps),
+         std::cend(temps),
+         std::begin(properties),
+         [&](const double t) {return get_physical_properties_3d(t, job); }
+      );
+      return properties;
+   }
+   if (job.m_spin_model != magneto::SpinModel::Ising) {
+      std::vector<magneto::PhysicalProperties> properties(temps.size());
+      std::transform(
+         std::execution::par_unseq,
+         std::cbegin(temps),
+         std::cend(temps),
+         std::begin(properties),
+         [&](const double t) {return get_model_physical_properties(t, job); }
+      );
+      return properties;
+   }
+
+   // Schedules, bond couplings, fields, other geometries and boundaries aren't available for the packed layouts
+   const bool single_algorithm = job.m_schedule.empty() && !job.m_couplings && !job.m_field
+      && magneto::is_periodic_square(job.m_geometry);
+   if (single_algorithm && job.m_algorithm == magneto::Algorithm::Multispin) {
+      return run_job_in_batches(temps, magneto::MultispinMetropolis::replica_count,
+         [&](const std::vector<double>& batch) {return get_multispin_physical_properties(batch, job); }
+      );
+   }
+   if (single_algorithm && job.m_algorithm == magneto::Algorithm::Metropolis && job.m_batch_size > 1) {
+      return run_job_in_batches(temps, job.m_batch_size,
+         [&](const std::vector<double>& batch) {return get_batched_physical_properties(batch, job); }
+      );
+   }
+
+   // With common random numbers all temperatures run on the same sweeps
+   const std::shared_ptr<magneto::CommonRandomSource> common_randoms = job.m_common_random_numbers ?
+      std::make_shared<magneto::CommonRandomSource>(job.m_Lx, job.m_Ly, temps.size()) : nullptr;
    std::vector<magneto::PhysicalProperties> properties(temps.size());
    std::transform(
       std::execution::par_unseq,
       std::cbegin(temps),
       std::cend(temps),
       std::begin(properties),
-      [&](const double t) {return get_physical_properties(t, job); }
+      [&](const double t) {return get_physical_properties(t, job, common_randoms); }
    );
    return properties;
 }
 
 
+std::vector<magneto::PhysicsResult> get_fixed_t_results(const magneto::Job& job, const std::vector<double>& temps) {
+   const std::vector<magneto::PhysicalProperties> properties = run_job_fixed_t(job, temps);
+   std::vector<magneto::PhysicsResult> results;
+   for (const magneto::PhysicalProperties& prop : properties) {
+      results.emplace_back(magneto::get_physical_results(prop));
+   }
+   return results;
+}
+
+
+/// <summary>Runs the coarse temperature grid, then refines it in rounds around the peaks until
+/// the budget of additional temperatures is spent</summary>
+std::vector<magneto::PhysicsResult> run_job_adaptive(const magneto::Job& job, const std::vector<double>& coarse_temps) {
+   std::vector<magneto::PhysicsResult> results = get_fixed_t_results(job, coarse_temps);
+   const auto by_temp = [](const magneto::PhysicsResult& a, const magneto::PhysicsResult& b) {return a.temp < b.temp; };
+   std::sort(std::begin(results), std::end(results), by_temp);
+
+   unsigned int remaining_budget = job.m_adaptive_budget;
+   while (remaining_budget > 0) {
+      const std::vector<double> new_temps = magneto::get_refinement_temps(results, std::min(remaining_budget, job.m_adaptive_batch));
+      if (new_temps.empty())
+         break;
+      magneto::get_logger()->info(
+         "Adaptive refinement: {} new temperatures in [{}, {}], {} remaining",
+         new_temps.size(), get_temperature_string(new_temps.front()), get_temperature_string(new_temps.back()),
+         remaining_budget - new_temps.size()
+      );
+      const std::vector<magneto::PhysicsResult> new_results = get_fixed_t_results(job, new_temps);
+      results.insert(std::end(results), std::cbegin(new_results), std::cend(new_results));
+      std::sort(std::begin(results), std::end(results), by_temp);
+      remaining_budget -= static_cast<unsigned int>(new_temps.size());
+   }
+   return results;
+}
+
+
+/// <summary>Field and mean magnetization per site of every step of a hysteresis loop</summary>
+using HysteresisLoop = std::vector<std::pair<double, double>>;
+
+
+/// <summary>Runs a hysteresis loop at temperature T: the swept field goes from +h_max down to
+/// -h_max and back up. The algorithm and its random streams live through the whole loop, a field
+/// step only rebuilds the acceptance table.</summary>
+HysteresisLoop get_hysteresis_loop(const double T, const magneto::Job& job) {
+   const std::string temp_string = get_temperature_string(T);
+   magneto::get_logger()->info("Starting hysteresis loop for {}X{} System, T={}", job.m_Lx, job.m_Ly, temp_string);
+   const unsigned int steps = job.m_hysteresis_steps;
+   const auto get_swept_field = [&](const unsigned int step) {
+      const double x = step <= steps ? 1.0 - 2.0 * step / steps : -1.0 + 2.0 * (step - steps) / steps;
+      return x * job.m_hysteresis_field;
+   };
+
+   magneto::IsingSystem system(job.m_J, job.initial_spins);
+   magneto::ExternalField field = *job.m_field;
+   field.h = job.m_field->h + get_swept_field(0);
+   std::unique_ptr<magneto::LatticeAlgorithm> algorithm = get_lattice_algorithm(magneto::Algorithm::Metropolis, T, job);
+   algorithm->set_field(field);
+   for (unsigned int i = 1; i < job.m_start_runs; ++i)
+      algorithm->run(system.get_lattice_nc());
+
+   HysteresisLoop loop;
+   const double N = 1.0 * job.m_Lx * job.m_Ly;
+   for (unsigned int step = 0; step <= 2 * steps; ++step) {
+      field.h = job.m_field->h + get_swept_field(step);
+      algorithm->set_field(field);
+      long long magnetization_sum = 0;
+      for (unsigned int i = 0; i < job.m_hysteresis_iterations; ++i) {
+         algorithm->run(system.get_lattice_nc());
+         magnetization_sum += magneto::get_lattice_observables(system.get_lattice()).magnetization;
+      }
+      loop.emplace_back(field.h, magnetization_sum / (N * job.m_hysteresis_iterations));
+   }
+   magneto::get_logger()->info("Finished hysteresis loop for {}X{} System, T={}", job.m_Lx, job.m_Ly, temp_string);
+   return loop;
+}
+
+
+/// <summary>Runs the hysteresis loops of all temperatures in parallel and writes one line per
+/// field step: temperature, field and magnetization</summary>
+void run_job_hysteresis(const magneto::Job& job, const std::vector<double>& temps) {
+   std::vector<HysteresisLoop> loops(temps.size());
+   std::transform(
+      std::execution::par_unseq,
+      std::cbegin(temps),
+      std::cend(temps),
+      std::begin(loops),
+      [&](const double t) {return get_hysteresis_loop(t, job); }
+   );
+   std::string file_content;
+   for (size_t t = 0; t < temps.size(); ++t) {
+      for (const auto& [h, m] : loops[t])
+         file_content += fmt::format("{},{},{}\n", temps[t], h, m);
+   }
+   magneto::write_string_to_file(job.m_physics_config.m_hysteresis_path, file_content);
+}
+
+
+/// <summary>Energy and magnetization per site and the temperature of every sweep of a
+/// temperature protocol</summary>
+struct ProtocolSeries {
+   std::vector<double> temperatures;
+   std::vector<magneto::PhysicalMeasurement> measurements;
+};
+
+
+bool set_algorithm_temperature(magneto::LatticeAlgorithm& algorithm, const double T) {
+   return algorithm.set_temperature(T);
+}
+
+bool set_algorithm_temperature(magneto::LatticeAlgorithm& algorithm, const magneto::LatticeDType& T) {
+   return algorithm.set_temperatures(T);
+}
+
+
+double get_mean_temperature(const double T) {
+   return T;
+}
+
+double get_mean_temperature(const magneto::LatticeDType& T) {
+   double sum = 0.0;
+   for (const std::vector<double>& row : T)
+      sum += std::accumulate(std::cbegin(row), std::cend(row), 0.0);
+   const auto [Lx, Ly] = magneto::get_dimensions_of_lattice(T);
+   return sum / (1.0 * Lx * Ly);
+}
+
+
+/// <summary>The schedule or the algorithm of the job. There are no pilot runs or packed layouts
+/// during a protocol, auto and multispin use metropolis.</summary>
+template<class TTemp>
+std::unique_ptr<magneto::LatticeAlgorithm> get_protocol_algorithm(const TTemp& T, const magneto::Job& job) {
+   if (!job.m_schedule.empty())
+      return get_scheduled_algorithm(job.m_schedule, T, job);
+   const bool is_packed = job.m_algorithm == magneto::Algorithm::Auto || job.m_algorithm == magneto::Algorithm::Multispin;
+   return get_lattice_algorithm(is_packed ? magneto::Algorithm::Metropolis : job.m_algorithm, T, job);
+}
+
+
+/// <summary>Runs a temperature protocol. The start runs equilibrate at T_start, then every sweep
+/// first sets its temperature get_temperature(sweep). Algorithms that support it only update their
+/// tables and keep their random streams, the others are constructed again.</summary>
+template<class TTemp, class TFun>
+ProtocolSeries get_protocol_series(
+   const TTemp& T_start, const TFun& get_temperature, const magneto::Job& job, const std::string& temp_string
+) {
+   std::unique_ptr<magneto::VisualOutput> visual_output(get_visual_output(job.m_image_mode.m_mode, job.m_Lx, job.m_Ly, job.m_image_mode, temp_string));
+   magneto::get_logger()->info("Starting temperature protocol for {}X{} System, T={}", job.m_Lx, job.m_Ly, temp_string);
+   magneto::IsingSystem system(job.m_J, job.initial_spins, job.m_couplings, job.m_field, job.m_geometry);
+   std::unique_ptr<magneto::LatticeAlgorithm> algorithm = get_protocol_algorithm(T_start, job);
+   for (unsigned int i = 1; i < job.m_start_runs; ++i)
+      algorithm->run(system.get_lattice_nc());
+
+   ProtocolSeries series;
+   bool warned = false;
+   for (unsigned int sweep = 0; sweep < job.m_protocol_sweeps; ++sweep) {
+      const TTemp& T = get_temperature(sweep);
+      if (!set_algorithm_temperature(*algorithm, T)) {
+         if (!warned)
+            magneto::get_logger()->warn("The algorithm can't change its temperature, it is constructed again for every sweep.");
+         warned = true;
+         algorithm = get_protocol_algorithm(T, job);
+      }
+      visual_output->snapshot(system.get_lattice());
+      algorithm->run(system.get_lattice_nc());
+      series.temperatures.emplace_back(get_mean_temperature(T));
+      series.measurements.emplace_back(get_properties(system));
+   }
+   visual_output->snapshot(system.get_lattice(), true);
+   visual_output->end_actions();
+   magneto::get_logger()->info("Finished temperature protocol for {}X{} System, T={}", job.m_Lx, job.m_Ly, temp_string);
+   return series;
+}
+
+
+/// <summary>Temperature of a sweep of a ramp or quench from the protocol start to T. The last
+/// sweep is at T.</summary>
+double get_protocol_temperature(const magneto::Job& job, const double T, const unsigned int sweep) {
+   const double x = (sweep + 1.0) / job.m_protocol_sweeps;
+   if (job.m_protocol == magneto::TempProtocolMode::Linear)
+      return job.m_protocol_start + x * (T - job.m_protocol_start);
+   if (job.m_protocol == magneto::TempProtocolMode::Exponential)
+      return job.m_protocol_start * std::pow(T / job.m_protocol_start, x);
+   return T;
+}
+
+
+/// <summary>One line per sweep, the first column is get_first_column(sweep)</summary>
+template<class TFun>
+std::string get_protocol_lines(const ProtocolSeries& series, const TFun& get_first_column) {
+   std::string lines;
+   for (size_t sweep = 0; sweep < series.measurements.size(); ++sweep) {
+      lines += fmt::format(
+         "{},{},{},{},{}\n", get_first_column(sweep), sweep, series.temperatures[sweep],
+         series.measurements[sweep].energy, series.measurements[sweep].magnetization
+      );
+   }
+   return lines;
+}
+
+
+/// <summary>Runs the ramps or quenches to all temperatures in parallel</summary>
+void run_job_protocol(const magneto::Job& job, const std::vector<double>& temps) {
+   std::vector<ProtocolSeries> series(temps.size());
+   std::transform(
+      std::execution::par_unseq,
+      std::cbegin(temps),
+      std::cend(temps),
+      std::begin(series),
+      [&](const double T) {
+         const auto get_temperature = [&](const unsigned int sweep) {return get_protocol_temperature(job, T, sweep); };
+         return get_protocol_series(job.m_protocol_start, get_temperature, job, get_temperature_string(T));
+      }
+   );
+   std::string file_content;
+   for (size_t t = 0; t < temps.size(); ++t)
+      file_content += get_protocol_lines(series[t], [&](const size_t /*sweep*/) {return temps[t]; });
+   magneto::write_string_to_file(job.m_physics_config.m_protocol_path, file_content);
+}
+
+
+/// <summary>Runs the protocol images and then the temperature image T, each for the same share
+/// of the sweeps. The first column of the output is the image index.</summary>
+void run_job_protocol(const magneto::Job& job, const magneto::LatticeDType& T) {
+   std::vector<const magneto::LatticeDType*> images;
+   for (const magneto::LatticeDType& image : job.m_protocol_images)
+      images.emplace_back(&image);
+   images.emplace_back(&T);
+   const auto get_image_index = [&](const size_t sweep) {return sweep * images.size() / job.m_protocol_sweeps; };
+   const auto get_temperature = [&](const unsigned int sweep) -> const magneto::LatticeDType& {return *images[get_image_index(sweep)]; };
+
+   const ProtocolSeries series = get_protocol_series(*images.front(), get_temperature, job, get_temperature_string(T));
+   magneto::write_string_to_file(job.m_physics_config.m_protocol_path, get_protocol_lines(series, get_image_index));
+}
+
+
 void run_job(const magneto::Job& job, const std::variant<magneto::LatticeDType, std::vector<double>>& temp_variant) {
    struct V {
       V(const magneto::Job& job) : m_job(job) { }
       void operator()(const magneto::LatticeDType& T) {
+         if (m_job.m_protocol == magneto::TempProtocolMode::Images) {
+            run_job_protocol(m_job, T);
+            return;
+         }
          [[maybe_unused]] const magneto::PhysicalProperties properties = get_physical_properties(T, m_job);
       }
       void operator()(const std::vector<double>& T) {
-         const std::vector<magneto::PhysicalProperties> properties = run_job_fixed_t(m_job, T);
-         std::vector<magneto::PhysicsResult> results;
-         for (const magneto::PhysicalProperties& prop : properties) {
-            results.emplace_back(magneto::get_physical_results(prop));
+         if (m_job.m_hysteresis_steps > 0) {
+            run_job_hysteresis(m_job, T);
+            return;
          }
+         if (m_job.m_protocol != magneto::TempProtocolMode::None) {
+            run_job_protocol(m_job, T);
+            return;
+         }
+         const std::vector<magneto::PhysicsResult> results = m_job.m_adaptive_budget > 0 ?
+            run_job_adaptive(m_job, T) : get_fixed_t_results(m_job, T);
          write_results(results, m_job.m_physics_config);
+         write_curve_results(results, m_job.m_physics_config.m_correlation_path,
+            [](const magneto::PhysicsResult& result) -> const std::vector<double>& {return result.correlation_function; }
+         );
+         write_curve_results(results, m_job.m_physics_config.m_structure_factor_path,
+            [](const magneto::PhysicsResult& result) -> const std::vector<double>& {return result.structure_factor; }
+         );
       }
       magneto::Job m_job;
    };
@@ -201,9 +1008,19 @@ void magneto::start() {
    const std::optional<JsonJob> parsed_job = get_parsed_job(default_config_path);
    if (!parsed_job.has_value()) {
       get_logger()->error("No configuration file found at {}", default_config_path.string());
-      return;
+   }
+   else {
+      const auto job_and_temps = get_job(parsed_job.value());
+      if (!job_and_temps.has_value()) {
+         get_logger()->error("The job in {} can't be run", default_config_path.string());
+      }
+      else {
+         const auto& [job, T] = job_and_temps.value();
+         run_job(job, T);
+      }
    }
 
-   const auto [job, T] = get_job(parsed_job.value());
-   run_job(job, T);
+   // Writes the queue and joins the worker thread, static destructors can't do that in a DLL.
+   // Logging afterwards starts a new logger.
+   shutdown_logger();
 }
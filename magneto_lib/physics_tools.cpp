@@ -1,5 +1,8 @@
 #include "physics_tools.h"
+#include "fft_tools.h"
+#include <algorithm>
 #include <numeric>
+#include <cmath>
 
 namespace {
    ///<summary>Computes the mean of anything that implements + and / operators</summary>
@@ -46,6 +49,116 @@ namespace {
    }
 
 
+   /// <summary>Improved estimators of the measurements that come from a cluster algorithm step</summary>
+   std::vector<magneto::PhysicalMeasurement> get_cluster_measurements(
+      const std::vector<magneto::PhysicalMeasurement>& properties
+   ) {
+      std::vector<magneto::PhysicalMeasurement> cluster_measurements;
+      for (const magneto::PhysicalMeasurement& property : properties) {
+         if (property.cluster_m2 > 0.0)
+            cluster_measurements.emplace_back(property);
+      }
+      return cluster_measurements;
+   }
+
+
+   /// <summary>Second moment correlation length from the susceptibility and its counterpart at
+   /// the smallest nonzero wave vector</summary>
+   double get_second_moment_correlation_length(const double m2, const double fourier_m2, const unsigned int L) {
+      constexpr double pi = 3.141592653589793;
+      if (fourier_m2 <= 0.0 || m2 <= fourier_m2)
+         return 0.0;
+      return std::sqrt(m2 / fourier_m2 - 1.0) / (2.0 * std::sin(pi / L));
+   }
+
+
+   /// <summary>Moments and Binder cumulant of the total of all bins except one</summary>
+   struct MomentEstimate {
+      double m2;
+      double m4;
+      double binder;
+   };
+
+   MomentEstimate get_moment_estimate(const magneto::MomentBin& sum) {
+      const double m2 = sum.m2 / sum.count;
+      const double m4 = sum.m4 / sum.count;
+      const double binder = m2 > 0.0 ? 1.0 - m4 / (3.0 * m2 * m2) : 0.0;
+      return { m2, m4, binder };
+   }
+
+
+   /// <summary>Jackknife estimates and errors of the moments over leave-one-out bin sums</summary>
+   void set_moment_results(magneto::PhysicsResult& result, const std::vector<magneto::MomentBin>& bins) {
+      magneto::MomentBin total;
+      for (const magneto::MomentBin& bin : bins) {
+         total.count += bin.count;
+         total.m2 += bin.m2;
+         total.m4 += bin.m4;
+      }
+      if (total.count == 0)
+         return;
+      const MomentEstimate estimate = get_moment_estimate(total);
+      result.m2 = estimate.m2;
+      result.m4 = estimate.m4;
+      result.binder = estimate.binder;
+      if (bins.size() < 2)
+         return;
+
+      std::vector<MomentEstimate> jackknife_estimates;
+      for (const magneto::MomentBin& bin : bins) {
+         const magneto::MomentBin rest{ total.count - bin.count, total.m2 - bin.m2, total.m4 - bin.m4 };
+         if (rest.count > 0)
+            jackknife_estimates.emplace_back(get_moment_estimate(rest));
+      }
+      const double n = static_cast<double>(jackknife_estimates.size());
+      MomentEstimate mean{ 0.0, 0.0, 0.0 };
+      for (const MomentEstimate& e : jackknife_estimates) {
+         mean.m2 += e.m2 / n;
+         mean.m4 += e.m4 / n;
+         mean.binder += e.binder / n;
+      }
+      MomentEstimate variance{ 0.0, 0.0, 0.0 };
+      for (const MomentEstimate& e : jackknife_estimates) {
+         variance.m2 += (e.m2 - mean.m2) * (e.m2 - mean.m2);
+         variance.m4 += (e.m4 - mean.m4) * (e.m4 - mean.m4);
+         variance.binder += (e.binder - mean.binder) * (e.binder - mean.binder);
+      }
+      const double factor = (n - 1.0) / n;
+      result.m2_err = std::sqrt(factor * variance.m2);
+      result.m4_err = std::sqrt(factor * variance.m4);
+      result.binder_err = std::sqrt(factor * variance.binder);
+   }
+
+
+   /// <summary>Per-interval score of one observable: its change over the interval and the
+   /// curvature at both ends, normalized by the observable's range</summary>
+   std::vector<double> get_interval_scores(const std::vector<double>& values) {
+      const auto [min_it, max_it] = std::minmax_element(std::cbegin(values), std::cend(values));
+      const double range = *max_it - *min_it;
+      std::vector<double> scores(values.size() - 1, 0.0);
+      if (range <= 0.0)
+         return scores;
+      std::vector<double> curvatures(values.size(), 0.0);
+      for (size_t k = 1; k + 1 < values.size(); ++k)
+         curvatures[k] = std::abs(values[k - 1] - 2.0 * values[k] + values[k + 1]);
+      for (size_t k = 0; k < scores.size(); ++k) {
+         const double change = std::abs(values[k + 1] - values[k]);
+         scores[k] = std::max({ change, curvatures[k], curvatures[k + 1] }) / range;
+      }
+      return scores;
+   }
+
+
+   /// <summary>Adds a bonus to the two intervals next to the maximum</summary>
+   void add_peak_bonus(std::vector<double>& scores, const std::vector<double>& values) {
+      const size_t peak = std::distance(std::cbegin(values), std::max_element(std::cbegin(values), std::cend(values)));
+      if (peak > 0)
+         scores[peak - 1] += 1.0;
+      if (peak < scores.size())
+         scores[peak] += 1.0;
+   }
+
+
    double get_energy_variance(const std::vector<magneto::PhysicalMeasurement>& properties) {
       return get_variance(get_energies(properties));
    }
@@ -60,7 +173,177 @@ namespace {
 magneto::PhysicsResult magneto::get_physical_results(const PhysicalProperties& properties){
    const double mean_energy = get_mean(get_energies(properties.measurements));
    const double mean_magnetization = get_mean(get_mags(properties.measurements));
-	const double cv = get_energy_variance(properties.measurements) * properties.Lx * properties.Ly / (properties.T * properties.T);
-	const double chi = get_mag_variance(properties.measurements) * properties.Lx * properties.Ly / properties.T;
-	return { properties.T, mean_energy, cv, mean_magnetization, chi };
+   const double N = 1.0 * properties.Lx * properties.Ly * properties.Lz;
+	const double cv = get_energy_variance(properties.measurements) * N / (properties.T * properties.T);
+	const double chi = get_mag_variance(properties.measurements) * N / properties.T;
+	magneto::PhysicsResult result{
+      properties.T, mean_energy, cv, mean_magnetization, chi, get_mean(properties.measurements).staggered_magnetization,
+      0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, {}, {}
+   };
+
+   const std::vector<PhysicalMeasurement> cluster_measurements = get_cluster_measurements(properties.measurements);
+   if (!cluster_measurements.empty()) {
+      const PhysicalMeasurement cluster_mean = get_mean(cluster_measurements);
+      result.chi_improved = cluster_mean.cluster_m2 * N / properties.T;
+      // Each axis has its own smallest wave vector
+      const double xi_x = get_second_moment_correlation_length(cluster_mean.cluster_m2, cluster_mean.cluster_fourier_m2_x, properties.Lx);
+      const double xi_y = get_second_moment_correlation_length(cluster_mean.cluster_m2, cluster_mean.cluster_fourier_m2_y, properties.Ly);
+      result.xi = 0.5 * (xi_x + xi_y);
+   }
+   set_moment_results(result, properties.moment_bins);
+   result.correlation_function = properties.correlation_function;
+   result.structure_factor = properties.structure_factor;
+   return result;
+}
+
+
+double magneto::get_integrated_autocorrelation_time(const std::vector<double>& series) {
+   // Window size in units of tau, as recommended by Sokal
+   constexpr double window_factor = 6.0;
+   const size_t n = series.size();
+   if (n < 2)
+      return 0.5;
+   const double mean = get_mean(series);
+   const double variance = get_variance(series);
+   if (variance <= 0.0)
+      return 0.5;
+
+   double tau = 0.5;
+   for (size_t t = 1; t < n; ++t) {
+      double covariance = 0.0;
+      for (size_t k = 0; k + t < n; ++k)
+         covariance += (series[k] - mean) * (series[k + t] - mean);
+      covariance /= (n - t);
+      tau += covariance / variance;
+      if (t >= window_factor * tau)
+         break;
+   }
+   return std::max(tau, 0.5);
+}
+
+
+std::vector<double> magneto::get_refinement_temps(const std::vector<PhysicsResult>& sorted_results, const unsigned int count) {
+   if (sorted_results.size() < 2)
+      return {};
+   std::vector<double> chis, cvs, binders, binder_errs;
+   for (const PhysicsResult& result : sorted_results) {
+      chis.emplace_back(result.chi);
+      cvs.emplace_back(result.cv);
+      binders.emplace_back(result.binder);
+      binder_errs.emplace_back(result.binder_err);
+   }
+
+   std::vector<double> scores(sorted_results.size() - 1, 0.0);
+   for (const std::vector<double>& values : { chis, cvs, binders }) {
+      const std::vector<double> observable_scores = get_interval_scores(values);
+      for (size_t k = 0; k < scores.size(); ++k)
+         scores[k] += observable_scores[k];
+   }
+   add_peak_bonus(scores, chis);
+   add_peak_bonus(scores, cvs);
+   const auto [min_binder, max_binder] = std::minmax_element(std::cbegin(binders), std::cend(binders));
+   const double binder_range = *max_binder - *min_binder;
+   if (binder_range > 0.0) {
+      for (size_t k = 0; k < scores.size(); ++k)
+         scores[k] += (binder_errs[k] + binder_errs[k + 1]) / binder_range;
+   }
+
+   // Intervals that are already very fine are not split further
+   const double full_range = sorted_results.back().temp - sorted_results.front().temp;
+   const double min_width = 1e-3 * full_range;
+   std::vector<size_t> candidates;
+   for (size_t k = 0; k < scores.size(); ++k) {
+      if (sorted_results[k + 1].temp - sorted_results[k].temp > min_width)
+         candidates.emplace_back(k);
+   }
+   std::sort(std::begin(candidates), std::end(candidates), [&](const size_t a, const size_t b) {return scores[a] > scores[b]; });
+   if (candidates.size() > count)
+      candidates.resize(count);
+
+   std::vector<double> temps;
+   for (const size_t k : candidates)
+      temps.emplace_back(0.5 * (sorted_results[k].temp + sorted_results[k + 1].temp));
+   std::sort(std::begin(temps), std::end(temps));
+   return temps;
+}
+
+
+magneto::MomentAccumulator::MomentAccumulator(const unsigned int expected_count, const unsigned int bin_count)
+   : m_bin_size(std::max(1u, (expected_count + std::max(1u, bin_count) - 1) / std::max(1u, bin_count)))
+{}
+
+
+void magneto::MomentAccumulator::add(const PhysicalMeasurement& measurement) {
+   if (m_bins.empty() || m_bins.back().count == m_bin_size)
+      m_bins.emplace_back();
+   MomentBin& bin = m_bins.back();
+   const double m2 = measurement.magnetization * measurement.magnetization;
+   ++bin.count;
+   bin.m2 += m2;
+   bin.m4 += m2 * m2;
+}
+
+
+const std::vector<magneto::MomentBin>& magneto::MomentAccumulator::get_bins() const {
+   return m_bins;
+}
+
+
+magneto::CorrelationAccumulator::CorrelationAccumulator(const unsigned int Lx, const unsigned int Ly)
+   : m_Lx(Lx)
+   , m_Ly(Ly)
+   , m_plan_x(Lx)
+   , m_plan_y(Ly)
+   , m_spin_field(Lx * Ly)
+   , m_power_sum(Lx * Ly, 0.0)
+   , m_count(0)
+{}
+
+
+void magneto::CorrelationAccumulator::add(const LatticeType& grid) {
+   for (unsigned int i = 0; i < m_Ly; ++i) {
+      for (unsigned int j = 0; j < m_Lx; ++j)
+         m_spin_field[i * m_Lx + j] = grid[i][j];
+   }
+   const std::vector<double> power = get_power_spectrum(m_spin_field, m_plan_x, m_plan_y);
+   for (size_t k = 0; k < power.size(); ++k)
+      m_power_sum[k] += power[k];
+   ++m_count;
+}
+
+
+std::vector<double> magneto::CorrelationAccumulator::get_mean_power_spectrum() const {
+   std::vector<double> mean(m_power_sum);
+   if (m_count == 0)
+      return mean;
+   for (double& value : mean)
+      value /= m_count;
+   return mean;
+}
+
+
+std::vector<double> magneto::CorrelationAccumulator::get_axes_average(const std::vector<double>& field) const {
+   const unsigned int r_max = std::min(m_Lx, m_Ly) / 2;
+   std::vector<double> average;
+   for (unsigned int r = 0; r <= r_max; ++r)
+      average.emplace_back(0.5 * (field[r] + field[r * m_Lx]));
+   return average;
+}
+
+
+std::vector<double> magneto::CorrelationAccumulator::get_correlation_function() const {
+   const double N = 1.0 * m_Lx * m_Ly;
+   std::vector<double> correlation = get_inverse_transform_real(get_mean_power_spectrum(), m_plan_x, m_plan_y);
+   for (double& value : correlation)
+      value /= N;
+   return get_axes_average(correlation);
+}
+
+
+std::vector<double> magneto::CorrelationAccumulator::get_structure_factor() const {
+   const double N = 1.0 * m_Lx * m_Ly;
+   std::vector<double> structure_factor = get_mean_power_spectrum();
+   for (double& value : structure_factor)
+      value /= N;
+   return get_axes_average(structure_factor);
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "IsingSystem.h"
+#include "fft_tools.h"
 
 namespace magneto {
    struct PhysicsResult {
@@ -9,8 +10,87 @@ namespace magneto {
       double cv;
       double magnetization;
       double chi;
+      double staggered_magnetization = 0.0;
+
+      // Magnetization moments <m^2>, <m^4> and the Binder cumulant U4 = 1 - <m^4>/(3<m^2>^2),
+      // with jackknife errors over the moment bins
+      double m2 = 0.0;
+      double m2_err = 0.0;
+      double m4 = 0.0;
+      double m4_err = 0.0;
+      double binder = 0.0;
+      double binder_err = 0.0;
+
+      // Improved estimators, only available for cluster algorithms. chi_improved is the full
+      // susceptibility beta*<M^2>/N, xi the second moment correlation length averaged over both axes.
+      double chi_improved = 0.0;
+      double xi = 0.0;
+
+      // Spin-spin correlation function G(r) and structure factor S(k) along the axes, empty if
+      // they were not measured
+      std::vector<double> correlation_function;
+      std::vector<double> structure_factor;
    };
 
-	PhysicsResult get_physical_results(const PhysicalProperties& properties);
+	CLASS_DECLSPEC PhysicsResult get_physical_results(const PhysicalProperties& properties);
+
+   /// <summary>Integrated autocorrelation time of a time series in units of its steps, with
+   /// Sokal's automatic windowing. 0.5 for uncorrelated data.</summary>
+   CLASS_DECLSPEC double get_integrated_autocorrelation_time(const std::vector<double>& series);
+
+   /// <summary>Proposes up to count new temperatures for an adaptive temperature grid. Intervals
+   /// between the (temperature sorted) results are scored by the change and curvature of chi, cv
+   /// and the Binder cumulant, the uncertainty of the latter and by the proximity to the chi
+   /// and cv peaks. The best intervals get a temperature at their midpoint.
+   /// <para>A job has a single system size, so there are no Binder cumulant crossings between
+   /// sizes to refine around. The slope of the Binder cumulant and its jackknife error on this
+   /// size stand in for them: both are largest where the crossings of other sizes would be.</para>
+   /// </summary>
+   std::vector<double> get_refinement_temps(const std::vector<PhysicsResult>& sorted_results, const unsigned int count);
+
+
+   /// <summary>Streams measurements into bins of fixed size, so that jackknife errors can be
+   /// computed without keeping the time series</summary>
+   class CLASS_DECLSPEC MomentAccumulator {
+   public:
+      /// <summary>Bin size is chosen so that expected_count measurements fill bin_count bins</summary>
+      MomentAccumulator(const unsigned int expected_count, const unsigned int bin_count);
+      void add(const PhysicalMeasurement& measurement);
+      const std::vector<MomentBin>& get_bins() const;
+
+   private:
+      unsigned int m_bin_size;
+      std::vector<MomentBin> m_bins;
+   };
+
+
+   /// <summary>Accumulates the power spectrum of the spin field over many measurements. The
+   /// correlation function G(r) = <s_0 s_r> follows from the mean spectrum by one inverse
+   /// transform (Wiener-Khinchin), so the cost per measurement is one 2D FFT.</summary>
+   class CorrelationAccumulator {
+   public:
+      CorrelationAccumulator(const unsigned int Lx, const unsigned int Ly);
+      void add(const LatticeType& grid);
+
+      /// <summary>G(r) for r in [0, L/2], averaged over x- and y-axis</summary>
+      std::vector<double> get_correlation_function() const;
+
+      /// <summary>S(k) = |F(k)|^2/N for k=2*pi*n/L with n in [0, L/2], averaged over both axes</summary>
+      std::vector<double> get_structure_factor() const;
+
+   private:
+      std::vector<double> get_mean_power_spectrum() const;
+      std::vector<double> get_axes_average(const std::vector<double>& field) const;
+
+      unsigned int m_Lx;
+      unsigned int m_Ly;
+
+      // Built once, the Bluestein chirps of other lengths than powers of two are expensive
+      FFTPlan m_plan_x;
+      FFTPlan m_plan_y;
+      std::vector<double> m_spin_field;
+      std::vector<double> m_power_sum;
+      unsigned int m_count;
+   };
 }
 
@@ -0,0 +1,189 @@
+#include "random_buffers.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+   std::string thread_id_to_string(const std::thread::id& id) {
+      std::stringstream ss;
+      ss << id;
+      return ss.str();
+   }
+
+
+   std::vector<double> get_uniforms(const size_t count, std::mt19937_64& rng) {
+      std::uniform_real_distribution <double > dist_one(0.0, 1.0);
+      std::vector<double> normal_random_vector;
+      normal_random_vector.reserve(count);
+      for (size_t i = 0; i < count; ++i)
+         normal_random_vector.emplace_back(dist_one(rng));
+      return normal_random_vector;
+   }
+
+
+   magneto::IndexPairVector get_lattice_indices(const size_t count, const int Lx, const int Ly, std::mt19937_64& rng) {
+      std::uniform_int_distribution<> dist_lattice_i(0, Ly - 1);
+      std::uniform_int_distribution<> dist_lattice_j(0, Lx - 1);
+      magneto::IndexPairVector indices;
+      indices.reserve(count);
+      for (size_t i = 0; i < count; ++i)
+         indices.emplace_back(dist_lattice_i(rng), dist_lattice_j(rng));
+      return indices;
+   }
+
+
+   /// <summary>Buffers are filled all the time, the thread id is only formatted if debug messages are logged</summary>
+   void log_buffer_done(const char* getter_name) {
+      const std::shared_ptr<spdlog::logger>& logger = magneto::get_logger();
+      if (logger->should_log(spdlog::level::debug))
+         logger->debug("{} done from thread {}", getter_name, thread_id_to_string(std::this_thread::get_id()));
+   }
+
+
+   unsigned int get_time_seed() {
+      return static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count());
+   }
+
+
+   std::shared_ptr<const magneto::SweepRandoms> get_sweep_randoms(const int Lx, const int Ly, const unsigned int seed, const size_t sweep) {
+      std::seed_seq seq{ seed, static_cast<unsigned int>(sweep), static_cast<unsigned int>(sweep >> 32) };
+      std::mt19937_64 rng(seq);
+      auto randoms = std::make_shared<magneto::SweepRandoms>();
+      randoms->indices = get_lattice_indices(static_cast<size_t>(Lx) * Ly, Lx, Ly, rng);
+      randoms->uniforms = get_uniforms(static_cast<size_t>(Lx) * Ly, rng);
+      return randoms;
+   }
+
+} // namespace {}
+
+
+std::vector<double> magneto::RandomBufferGetter::operator()() {
+   std::mt19937_64 rng(get_time_seed());
+   std::vector<double> normal_random_vector = get_uniforms(m_buffer_size, rng);
+   log_buffer_done("get_random_buffer()");
+   return normal_random_vector;
+}
+
+
+magneto::IndexPairVector magneto::LatticeIndexGetter::operator()() {
+   std::mt19937_64 rng(get_time_seed());
+   magneto::IndexPairVector indices = get_lattice_indices(m_buffer_size, m_Lx, m_Ly, rng);
+   log_buffer_done("get_lattice_indices()");
+   return indices;
+}
+
+
+magneto::RandomStreams::RandomStreams(const int Lx, const int Ly, const int max_rng_threads /*= 2*/)
+   : m_Lx(Lx)
+   , m_Ly(Ly)
+   , m_max_rng_threads(max_rng_threads)
+{ }
+
+
+std::shared_ptr<magneto::IndexStream> magneto::RandomStreams::get_lattice_indices() {
+   if (!m_lattice_indices)
+      m_lattice_indices = std::make_shared<IndexStream>(LatticeIndexGetter(m_Lx * m_Ly, m_Lx, m_Ly), m_max_rng_threads);
+   return m_lattice_indices;
+}
+
+
+std::shared_ptr<magneto::UniformStream> magneto::RandomStreams::get_uniforms() {
+   if (!m_uniforms)
+      m_uniforms = std::make_shared<UniformStream>(RandomBufferGetter(m_Lx * m_Ly), m_max_rng_threads);
+   return m_uniforms;
+}
+
+
+std::shared_ptr<magneto::UniformStream> magneto::RandomStreams::get_cluster_uniforms() {
+   if (!m_cluster_uniforms)
+      m_cluster_uniforms = std::make_shared<UniformStream>(RandomBufferGetter(m_Lx * m_Ly), 3 * m_max_rng_threads);
+   return m_cluster_uniforms;
+}
+
+
+magneto::CommonRandomSource::CommonRandomSource(
+   const int Lx, const int Ly, const size_t consumer_count, const int max_rng_threads /*= 2*/
+)
+   : m_Lx(Lx)
+   , m_Ly(Ly)
+   , m_seed(get_time_seed())
+   , m_lookahead(std::max(1, max_rng_threads))
+   // Consumers that run apart each keep their current sweep and their lookahead
+   , m_capacity(std::max<size_t>(1, consumer_count) * (m_lookahead + 1))
+{
+   for (size_t i = 0; i < m_lookahead; ++i)
+      m_producers.emplace_back([this]() {produce(); });
+}
+
+
+magneto::CommonRandomSource::~CommonRandomSource() {
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+   }
+   m_request_added.notify_all();
+   for (std::thread& producer : m_producers)
+      producer.join();
+}
+
+
+std::shared_ptr<const magneto::SweepRandoms> magneto::CommonRandomSource::get_sweep(const size_t sweep) {
+   std::shared_future<std::shared_ptr<const SweepRandoms>> randoms;
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (size_t s = sweep; s <= sweep + m_lookahead; ++s)
+         start_production(s);
+      Entry& entry = m_sweeps.at(sweep);
+      entry.last_access = ++m_access_counter;
+      randoms = entry.randoms;
+      evict_unused();
+   }
+   return randoms.get();
+}
+
+
+void magneto::CommonRandomSource::start_production(const size_t sweep) {
+   // Called with m_mutex held
+   if (m_sweeps.count(sweep) > 0)
+      return;
+   Request request{ sweep, {} };
+   m_sweeps.emplace(sweep, Entry{ request.randoms.get_future().share(), ++m_access_counter });
+   m_requests.emplace_back(std::move(request));
+   m_request_added.notify_one();
+}
+
+
+void magneto::CommonRandomSource::produce() {
+   while (true) {
+      Request request;
+      {
+         std::unique_lock<std::mutex> lock(m_mutex);
+         m_request_added.wait(lock, [&]() {return m_stopping || !m_requests.empty(); });
+         if (m_stopping)
+            return;
+         request = std::move(m_requests.front());
+         m_requests.pop_front();
+      }
+      request.randoms.set_value(get_sweep_randoms(m_Lx, m_Ly, m_seed, request.sweep));
+   }
+}
+
+
+void magneto::CommonRandomSource::evict_unused() {
+   // Least recently used sweeps go first. Unfinished ones stay, dropping them would block.
+   while (m_sweeps.size() > m_capacity) {
+      auto oldest = std::end(m_sweeps);
+      for (auto it = std::begin(m_sweeps); it != std::end(m_sweeps); ++it) {
+         const bool is_ready = it->second.randoms.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+         if (is_ready && (oldest == std::end(m_sweeps) || it->second.last_access < oldest->second.last_access))
+            oldest = it;
+      }
+      if (oldest == std::end(m_sweeps))
+         return;
+      m_sweeps.erase(oldest);
+   }
+}
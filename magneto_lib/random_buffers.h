@@ -0,0 +1,118 @@
+#pragma once
+
+#include "types.h"
+#include "BufferStructure.h"
+#include "export_macro.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+namespace magneto {
+
+   /// <summary>Generator for buffers of uniform random numbers in [0,1)</summary>
+   struct RandomBufferGetter {
+      RandomBufferGetter(const size_t buffer_size) : m_buffer_size(buffer_size) {};
+      std::vector<double> operator()();
+      size_t m_buffer_size;
+   };
+
+
+   /// <summary>Generator for buffers of random lattice index pairs</summary>
+   struct LatticeIndexGetter {
+      LatticeIndexGetter(const size_t buffer_size, const int Lx, const int Ly) : m_buffer_size(buffer_size), m_Lx(Lx), m_Ly(Ly) {};
+      IndexPairVector operator()();
+      size_t m_buffer_size;
+      int m_Lx;
+      int m_Ly;
+   };
+
+
+   using IndexStream = BufferStructure<IndexPairVector>;
+   using UniformStream = BufferStructure<std::vector<double>>;
+
+
+   /// <summary>The random number streams of one lattice, each buffer covers one sweep. Algorithms
+   /// that take turns on the same lattice share them instead of each running its own generator
+   /// threads. A stream is only started when it is first requested.</summary>
+   class CLASS_DECLSPEC RandomStreams {
+   public:
+      RandomStreams(const int Lx, const int Ly, const int max_rng_threads = 2);
+      int get_Lx() const { return m_Lx; }
+      int get_Ly() const { return m_Ly; }
+      std::shared_ptr<IndexStream> get_lattice_indices();
+      std::shared_ptr<UniformStream> get_uniforms();
+
+      /// <summary>Uniforms of the cluster steps, apart from the Metropolis ones. A cluster step reads
+      /// up to three sweeps of them, so the stream runs three times the generator threads.</summary>
+      std::shared_ptr<UniformStream> get_cluster_uniforms();
+
+   private:
+      int m_Lx;
+      int m_Ly;
+      int m_max_rng_threads;
+      std::shared_ptr<IndexStream> m_lattice_indices;
+      std::shared_ptr<UniformStream> m_uniforms;
+      std::shared_ptr<UniformStream> m_cluster_uniforms;
+   };
+
+
+
+   /// <summary>Site indices and uniforms for one sweep</summary>
+   struct SweepRandoms {
+      IndexPairVector indices;
+      std::vector<double> uniforms;
+   };
+
+
+   /// <summary>Common random numbers: one read-only stream of sweeps, shared by many lattices such as
+   /// all temperatures of a job.
+   /// <para>Sweep k only depends on the seed and k, so every consumer sees the same sequence no
+   /// matter when it asks. A pool of producer threads, which live as long as the source, works
+   /// ahead of the requests. Only a window of recently used sweeps is kept; a consumer that falls
+   /// behind it gets an identical regenerated sweep.</para>
+   /// </summary>
+   class CLASS_DECLSPEC CommonRandomSource {
+   public:
+      CommonRandomSource(const int Lx, const int Ly, const size_t consumer_count, const int max_rng_threads = 2);
+
+      /// <summary>Stops the producers, they finish the sweep they are working on</summary>
+      ~CommonRandomSource();
+
+      /// <summary>Blocks until the sweep is available</summary>
+      std::shared_ptr<const SweepRandoms> get_sweep(const size_t sweep);
+
+   private:
+      struct Entry {
+         std::shared_future<std::shared_ptr<const SweepRandoms>> randoms;
+         size_t last_access;
+      };
+      struct Request {
+         size_t sweep;
+         std::promise<std::shared_ptr<const SweepRandoms>> randoms;
+      };
+      void start_production(const size_t sweep);
+      void evict_unused();
+      void produce();
+
+      int m_Lx;
+      int m_Ly;
+      unsigned int m_seed;
+      size_t m_lookahead;
+      size_t m_capacity;
+      size_t m_access_counter = 0;
+      std::mutex m_mutex;
+      std::map<size_t, Entry> m_sweeps;
+
+      // Sweeps waiting for a producer, oldest first. Guarded by m_mutex like the sweeps.
+      std::deque<Request> m_requests;
+      std::condition_variable m_request_added;
+      bool m_stopping = false;
+      std::vector<std::thread> m_producers;
+   };
+
+}
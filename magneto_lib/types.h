@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -13,6 +14,46 @@ namespace magneto {
    using LatticeIType = LatticeTType<int>;
    using LatticeDType = LatticeTType<double>;
 
+   /// <summary>Coupling of every bond for random-bond and spin-glass systems, flat and row-major.
+   /// east[i*Lx+j] couples (i,j) with (i,j+1), south[i*Lx+j] couples (i,j) with
+   /// (i+1,j) in the row below.</summary>
+   struct BondCouplings {
+      unsigned int Lx = 0;
+      unsigned int Ly = 0;
+      std::vector<signed char> east;
+      std::vector<signed char> south;
+   };
+
+   /// <summary>External magnetic field, site i feels h + level_values[levels[i]]. Without levels
+   /// the field is uniform. The levels are row-major and shared, so changing h is cheap.</summary>
+   struct ExternalField {
+      double h = 0.0;
+      std::shared_ptr<const std::vector<unsigned char>> levels;
+      std::vector<double> level_values;
+   };
+
+   enum class LatticeGeometry { Square, Triangular, Honeycomb, SquareNNN, Anisotropic };
+
+   /// <summary>Boundary condition of one axis. Fixed boundaries have ghost spins +1 beyond both
+   /// edges, FixedOpposite has +1 beyond the low and -1 beyond the high edge. Helical wraps into
+   /// the next row (column) of the other axis.</summary>
+   enum class Boundary { Periodic, Open, Fixed, FixedOpposite, Antiperiodic, Helical };
+
+   /// <summary>Lattice geometry and its second coupling: the next-nearest neighbour coupling for
+   /// SquareNNN and the vertical coupling for Anisotropic. J is the (horizontal) nearest neighbour
+   /// coupling. Other boundaries than periodic are only available for the square lattice.</summary>
+   struct Geometry {
+      LatticeGeometry lattice = LatticeGeometry::Square;
+      int J2 = 0;
+      Boundary boundary_x = Boundary::Periodic;
+      Boundary boundary_y = Boundary::Periodic;
+   };
+
+   inline bool is_periodic_square(const Geometry& geometry) {
+      return geometry.lattice == LatticeGeometry::Square
+         && geometry.boundary_x == Boundary::Periodic && geometry.boundary_y == Boundary::Periodic;
+   }
+
    template<class T>
    std::pair<unsigned int, unsigned int> get_dimensions_of_lattice(const magneto::LatticeTType<T>& lattice) {
       const unsigned int Ly = static_cast<unsigned int>(lattice.size());